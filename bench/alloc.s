@@ -0,0 +1,56 @@
+; Allocation churn: 64 live blocks, each of 2M iterations frees one
+; and allocates a replacement of 16 to 527 bytes, writing to both
+; ends of it.
+MOV RK, 0x61
+MOV RP1, 512
+INT
+MOV R7, RR1
+MOV R6, 0
+alloc_fill:
+MOV RK, 0x61
+MOV RP1, 64
+INT
+MOV R1, R7
+ADD R1, R6
+STORE64 RR1, R1, 0
+ADD R6, 8
+CMP R6, 512
+JNE alloc_fill
+MOV R5, 2000000
+MOV R6, 0
+alloc_loop:
+MOV R1, R7
+ADD R1, R6
+LOAD64 R2, R1, 0
+MOV RK, 0x63
+MOV RP1, R2
+INT
+MOV R3, R5
+MUL R3, 7919
+MOV R4, R3
+DIV R4, 512
+MUL R4, 512
+SUB R3, R4
+ADD R3, 16
+MOV RK, 0x61
+MOV RP1, R3
+INT
+MOV R2, RR1
+STORE64 R5, R2, 0
+ADD R2, R3
+SUB R2, 8
+STORE64 R5, R2, 0
+MOV R1, R7
+ADD R1, R6
+STORE64 RR1, R1, 0
+ADD R6, 8
+CMP R6, 512
+JNE alloc_next
+MOV R6, 0
+alloc_next:
+DEC R5
+CMP R5, 0
+JNE alloc_loop
+MOV RK, 0xA
+MOV RP1, 0
+INT
@@ -0,0 +1,26 @@
+; Tight arithmetic: a multiply-add hash over 50M iterations, kept
+; below 65521 so nothing overflows. Exits 1 if the sum is wrong.
+MOV R1, 50000000
+MOV R2, 1
+MOV R3, 0
+arith_loop:
+MUL R2, 31
+ADD R2, R1
+MOV R4, R2
+DIV R4, 65521
+MUL R4, 65521
+SUB R2, R4
+ADD R3, R2
+DEC R1
+CMP R1, 0
+JNE arith_loop
+MOV R8, 1637931769339
+CMP R3, R8
+JNE arith_fail
+MOV RK, 0xA
+MOV RP1, 0
+INT
+arith_fail:
+MOV RK, 0xA
+MOV RP1, 1
+INT
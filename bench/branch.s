@@ -0,0 +1,36 @@
+; Branch-heavy code: Collatz step counts for 1..199999, the odd/even
+; test is a CMP/JNE that flips unpredictably. Exits 1 if the total
+; is wrong.
+MOV R1, 1
+MOV R4, 0
+branch_outer:
+MOV R2, R1
+branch_inner:
+CMP R2, 1
+JE branch_next
+MOV R3, R2
+DIV R3, 2
+MUL R3, 2
+CMP R3, R2
+JNE branch_odd
+DIV R2, 2
+INC R4
+JMP branch_inner
+branch_odd:
+MUL R2, 3
+INC R2
+INC R4
+JMP branch_inner
+branch_next:
+INC R1
+CMP R1, 200000
+JNE branch_outer
+CMP R4, 22938473
+JNE branch_fail
+MOV RK, 0xA
+MOV RP1, 0
+INT
+branch_fail:
+MOV RK, 0xA
+MOV RP1, 1
+INT
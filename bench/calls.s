@@ -0,0 +1,29 @@
+; Deep CALL/RET recursion: 2000 rounds of descending 10000 calls and
+; summing the depths on the way back. Exits 1 if the sum is wrong.
+MOV R5, 2000
+MOV R2, 0
+calls_round:
+MOV R1, 10000
+CALL descend
+DEC R5
+CMP R5, 0
+JNE calls_round
+MOV R8, 100010000000
+CMP R2, R8
+JNE calls_fail
+MOV RK, 0xA
+MOV RP1, 0
+INT
+calls_fail:
+MOV RK, 0xA
+MOV RP1, 1
+INT
+descend:
+CMP R1, 0
+JE descend_done
+DEC R1
+CALL descend
+INC R1
+ADD R2, R1
+descend_done:
+RET
@@ -0,0 +1,23 @@
+; Syscall-heavy output: 8M six byte writes to STDOUT through the
+; engine's output buffer, then a flush.
+MOV RK, 0x61
+MOV RP1, 16
+INT
+MOV R1, RR1
+MOV R2, 0x0A6F6C6C6548
+STORE64 R2, R1, 0
+MOV R5, 8000000
+io_loop:
+MOV RK, 0x1
+MOV RP1, 0x1
+MOV RP2, R1
+MOV RP3, 6
+INT
+DEC R5
+CMP R5, 0
+JNE io_loop
+MOV RK, 0x3
+INT
+MOV RK, 0xA
+MOV RP1, 0
+INT
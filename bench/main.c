@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+// ==================== XBENCH Define ====================
+/*
+	Runs every program RUNS times under the engine with --stats, which
+	prints the executed instruction count and the time spent running
+	them, and reports the median run: guest MIPS, nanoseconds per
+	instruction and the peak RSS of the engine process. The program's
+	own output goes to /dev/null, a run that does not exit with 0 fails
+	the whole benchmark.
+*/
+#define BENCH_RUNS_DEFAULT	5
+#define BENCH_OUTPUT_CHUNK	0x1000
+#define BENCH_STATS_PREFIX	"Stats: "
+
+struct benchRun {
+	unsigned long long instructions;
+	long long ns;
+	long rssKb;
+};
+
+bool benchRun( const char* engine, const char* program, struct benchRun* run );
+bool benchProgram( const char* engine, const char* program, size_t runs );
+const char* benchName( const char* program );
+int benchCompare( const void* a, const void* b );
+// ==================== XBENCH Define ====================
+
+// ==================== XBENCH ====================
+bool benchRun( const char* engine, const char* program, struct benchRun* run ) {
+	int pipes[ 2 ];
+
+	if ( pipe( pipes ) != 0 ) {
+		fprintf( stderr, "Error: Cannot create a pipe.\n" );
+		return false;
+	}
+
+	pid_t pid = fork();
+
+	if ( pid < 0 ) {
+		fprintf( stderr, "Error: Cannot fork.\n" );
+		close( pipes[ 0 ] );
+		close( pipes[ 1 ] );
+		return false;
+	}
+
+	if ( pid == 0 ) {
+		int null = open( "/dev/null", O_RDWR );
+
+		dup2( null, STDIN_FILENO );
+		dup2( null, STDOUT_FILENO );
+		dup2( pipes[ 1 ], STDERR_FILENO );
+		close( pipes[ 0 ] );
+
+		execl( engine, engine, "--stats", program, (char*)NULL );
+		_exit( 127 );
+	}
+
+	close( pipes[ 1 ] );
+
+	// The stats line is the last thing the engine prints
+	size_t size = 0;
+	char* output = NULL;
+	ssize_t got;
+
+	do {
+		output = (char*)realloc( output, size + BENCH_OUTPUT_CHUNK + 1 );
+		got = read( pipes[ 0 ], output + size, BENCH_OUTPUT_CHUNK );
+
+		if ( got > 0 ) {
+			size += (size_t)got;
+		}
+	} while ( got > 0 );
+
+	output[ size ] = (char)0x00;
+	close( pipes[ 0 ] );
+
+	int status;
+	struct rusage usage;
+
+	if ( wait4( pid, &status, 0, &usage ) != pid ) {
+		fprintf( stderr, "Error: Cannot wait for %s.\n", program );
+		free( output );
+		return false;
+	}
+
+	char* stats = NULL;
+	char* found = output;
+
+	while ( ( found = strstr( found, BENCH_STATS_PREFIX ) ) != NULL ) {
+		stats = found;
+		found += strlen( BENCH_STATS_PREFIX );
+	}
+
+	bool result = WIFEXITED( status ) && WEXITSTATUS( status ) == 0 && stats != NULL &&
+		sscanf( stats, BENCH_STATS_PREFIX "%llu instructions in %lld ns", &run->instructions, &run->ns ) == 2;
+
+	if ( !result ) {
+		fprintf( stderr, "Error: %s did not finish cleanly.\n%s", program, output );
+	}
+
+	run->rssKb = usage.ru_maxrss;
+
+	free( output );
+	return result;
+}
+
+bool benchProgram( const char* engine, const char* program, size_t runs ) {
+	struct benchRun* results = (struct benchRun*)calloc( runs, sizeof( struct benchRun ) );
+	if ( results == NULL ) {
+		fprintf( stderr, "Error: Cannot allocate memory.\n" );
+		return false;
+	}
+
+	long rssKb = 0;
+
+	for ( size_t i = 0; i < runs; i++ ) {
+		if ( !benchRun( engine, program, &results[ i ] ) ) {
+			free( results );
+			return false;
+		}
+
+		if ( results[ i ].rssKb > rssKb ) {
+			rssKb = results[ i ].rssKb;
+		}
+	}
+
+	qsort( results, runs, sizeof( struct benchRun ), benchCompare );
+
+	struct benchRun* median = &results[ runs / 2 ];
+	double ns = median->ns > 0 ? (double)median->ns : 1.0;
+	double mips = (double)median->instructions / ns * 1000.0;
+	double perInstruction = median->instructions > 0 ? ns / (double)median->instructions : 0.0;
+
+	fprintf( stdout, "%-12s %14llu %10.1f %10.1f %10.2f %10ld\n", benchName( program ), median->instructions, ns / 1000000.0, mips, perInstruction, rssKb );
+
+	free( results );
+	return true;
+}
+
+const char* benchName( const char* program ) {
+	const char* slash = strrchr( program, '/' );
+	return slash != NULL ? slash + 1 : program;
+}
+
+int benchCompare( const void* a, const void* b ) {
+	long long x = ( (const struct benchRun*)a )->ns;
+	long long y = ( (const struct benchRun*)b )->ns;
+
+	return x < y ? -1 : ( x > y );
+}
+// ==================== XBENCH ====================
+
+// ==================== Main ====================
+int main( int argc, char* argv[] ) {
+	size_t runs = BENCH_RUNS_DEFAULT;
+	int i = 1;
+
+	if ( i + 1 < argc && strcmp( argv[ i ], "-n" ) == 0 ) {
+		runs = (size_t)strtoul( argv[ i + 1 ], NULL, 10 );
+		i += 2;
+
+		if ( runs == 0 ) {
+			fprintf( stderr, "Error: Invalid run count.\n" );
+			exit( EXIT_FAILURE );
+		}
+	}
+
+	if ( argc - i < 2 ) {
+		fprintf( stderr, "Error: Invalid usage.\n" );
+		exit( EXIT_FAILURE );
+	}
+
+	const char* engine = argv[ i++ ];
+	bool status = true;
+
+	fprintf( stdout, "%-12s %14s %10s %10s %10s %10s\n", "program", "instructions", "ms", "MIPS", "ns/inst", "RSS KB" );
+
+	for ( ; i < argc; i++ ) {
+		status = benchProgram( engine, argv[ i ], runs ) && status;
+	}
+
+	exit( status ? EXIT_SUCCESS : EXIT_FAILURE );
+}
+// ==================== Main ====================
@@ -48,6 +48,14 @@ typedef ubyte_t token_kind_t;
 #define REGISTER_RR7	(ubyte_t) 0xBA
 #define REGISTER_RR8	(ubyte_t) 0xBB
 
+#define X8000_LOAD_8	(ubyte_t) 0x11
+#define X8000_LOAD_16	(ubyte_t) 0x12
+#define X8000_LOAD_32	(ubyte_t) 0x13
+#define X8000_LOAD_64	(ubyte_t) 0x14
+#define X8000_STORE_8	(ubyte_t) 0x15
+#define X8000_STORE_16	(ubyte_t) 0x16
+#define X8000_STORE_32	(ubyte_t) 0x17
+#define X8000_STORE_64	(ubyte_t) 0x18
 #define X8000_MOV_R	(ubyte_t) 0x20
 #define X8000_MOV_8	(ubyte_t) 0x21
 #define X8000_MOV_16	(ubyte_t) 0x22
@@ -144,6 +152,14 @@ typedef ubyte_t token_kind_t;
 #define TASM_KEYWORD_MUL	"MUL"
 #define TASM_KEYWORD_DIV	"DIV"
 #define TASM_KEYWORD_INT	"INT"
+#define TASM_KEYWORD_LOAD8	"LOAD8"
+#define TASM_KEYWORD_LOAD16	"LOAD16"
+#define TASM_KEYWORD_LOAD32	"LOAD32"
+#define TASM_KEYWORD_LOAD64	"LOAD64"
+#define TASM_KEYWORD_STORE8	"STORE8"
+#define TASM_KEYWORD_STORE16	"STORE16"
+#define TASM_KEYWORD_STORE32	"STORE32"
+#define TASM_KEYWORD_STORE64	"STORE64"
 
 #define TASM_MODE_R		(ubyte_t) 0x00
 #define TASM_MODE_8		(ubyte_t) 0x08
@@ -152,7 +168,7 @@ typedef ubyte_t token_kind_t;
 #define TASM_MODE_64		(ubyte_t) 0x40
 // ==================== TASM Keywords ====================
 
-#define TASM_KEYWORDS_COUNT 42
+#define TASM_KEYWORDS_COUNT 51
 char* keywords[] = {
 	"IP",
 	"RK",
@@ -186,6 +202,7 @@ char* keywords[] = {
 	"CMP",
 	"JMP",
 	"JE",
+	"JNE",
 	"JNZ",
 	"CALL",
 	"RET",
@@ -196,6 +213,14 @@ char* keywords[] = {
 	"MUL",
 	"DIV",
 	"INT",
+	"LOAD8",
+	"LOAD16",
+	"LOAD32",
+	"LOAD64",
+	"STORE8",
+	"STORE16",
+	"STORE32",
+	"STORE64",
 };
 
 struct token {
@@ -210,10 +235,22 @@ struct label {
 	struct label* next;
 };
 
+/*
+	A jump or call whose label is not defined yet gets a zero target
+	and a fixup; once the whole program is generated every fixup is
+	patched with the label's position.
+*/
+struct fixup {
+	char* name;
+	size_t pos;
+	struct fixup* next;
+};
+
 struct ast {
 	struct token* mid;
 	struct token* right;
 	struct token* left;
+	struct token* offset;
 	struct ast* next;
 };
 
@@ -223,6 +260,8 @@ struct token* tokenStreamHead = NULL;
 struct label* labelStream = NULL;
 struct label* labelStreamHead = NULL;
 
+struct fixup* fixupStream = NULL;
+
 struct ast* astStream = NULL;
 struct ast* astStreamHead = NULL;
 
@@ -234,6 +273,11 @@ struct label* createLabel( char* name, size_t pos );
 struct label* searchLabel( char* name );
 void appendLabel( struct label* _label );
 void freeLabel();
+bool writeSymbolMap( char* path );
+
+void appendFixup( char* name, size_t pos );
+bool resolveFixups();
+void freeFixups();
 
 struct ast* createAst( struct token* mid, struct token* right, struct token* left );
 void appendAst( struct ast* _ast );
@@ -261,9 +305,18 @@ size_t programBinCursor = 0;
 #define CONVERT_TOKEN_BYTE_MODE_32	(ubyte_t) 0x20
 #define CONVERT_TOKEN_BYTE_MODE_64	(ubyte_t) 0x40
 
+/*
+	Immediates are encoded in the narrowest of the 8/16/32/64-bit forms
+	they fit in. The engine zero-extends narrow immediates, so negative
+	numbers always take the 64-bit form. -O0 turns this off and keeps
+	every immediate 64-bit.
+*/
+bool tasmOptimize = true;
+
 ubyte_t convertTokenToByte( char* symbol, int mode );
 ssize_t convertNumberToBytes( char* numstr );
-void tasmCodeGen();
+ubyte_t immediateMode( ssize_t num );
+bool tasmCodeGen();
 void tasmCodeGenFree();
 
 void tasm_init( char* _program, size_t _programSize );
@@ -347,12 +400,71 @@ void freeLabel() {
 	}
 }
 
+bool writeSymbolMap( char* path ) {
+	/*
+		One "0x<offset> <label>" line per label, in source order, so
+		the engine can put names on program addresses.
+	*/
+	FILE* fptr = fopen( path, "w" );
+	if ( fptr == NULL ) {
+		return false;
+	}
+
+	struct label* current = labelStream;
+
+	while ( current != NULL ) {
+		fprintf( fptr, "0x%08zx %s\n", current->pos, current->name );
+		current = current->next;
+	}
+
+	return fclose( fptr ) == 0;
+}
+
+void appendFixup( char* name, size_t pos ) {
+	struct fixup* fx = (struct fixup*)malloc( sizeof( struct fixup ) );
+
+	fx->name = name;
+	fx->pos = pos;
+	fx->next = fixupStream;
+
+	fixupStream = fx;
+}
+
+bool resolveFixups() {
+	struct fixup* current = fixupStream;
+
+	while ( current != NULL ) {
+		struct label* lb = searchLabel( current->name );
+
+		if ( lb == NULL ) {
+			fprintf( stderr, "Error: Unknown label '%s'.\n", current->name );
+			return false;
+		}
+
+		memcpy( &programBin[ current->pos ], &lb->pos, sizeof( size_t ) );
+		current = current->next;
+	}
+
+	return true;
+}
+
+void freeFixups() {
+	struct fixup* current = fixupStream;
+
+	while ( current != NULL ) {
+		struct fixup* _next = current->next;
+		free( current );
+		current = _next;
+	}
+}
+
 struct ast* createAst( struct token* mid, struct token* right, struct token* left ) {
 	struct ast* node = (struct ast*)malloc( sizeof( struct ast ) );
 
 	node->mid = mid;
 	node->right = right;
 	node->left = left;
+	node->offset = NULL;
 	node->next = NULL;
 
 	return node;
@@ -388,6 +500,8 @@ bool isSeparator( size_t pos ) {
 		return false;
 	if ( ch >= 97 && ch <= 122 )
 		return false;
+	if ( ch == '_' )
+		return false;
 	return true;
 }
 
@@ -414,7 +528,10 @@ bool isKeyword( size_t pos ) {
 			}
 		}
 
-		if ( isEqual ) {
+		// A keyword only counts as a whole word, sub1: is a label
+		size_t end = pos + keyIndex;
+
+		if ( isEqual && keyword[ keyIndex ] == (char)0x00 && ( end >= programSize || isSeparator( end ) ) ) {
 			return true;
 		}
 	}
@@ -440,9 +557,7 @@ bool isNumber( size_t pos ) {
 	char ch = program[ pos ];
 
 	if ( ch == '+' || ch == '-' ) {
-		ch = program[ pos + 1 ];
-
-		if ( isDigit( ch ) ) {
+		if ( pos + 1 < programSize && isDigit( pos + 1 ) ) {
 			return true;
 		}
 	}
@@ -504,14 +619,12 @@ char* getNumber( size_t pos ) {
 
 	// Decimal
 	for ( size_t i = pos; i < programSize; i++ ) {
-		ch = program[ i ];
-
-		track = (char*)realloc( track, ++size );
-		track[ size - 1 ] = ch;
-
-		if ( !isDigit( ch ) ) {
+		if ( !isDigit( i ) ) {
 			break;
 		}
+
+		track = (char*)realloc( track, ++size );
+		track[ size - 1 ] = program[ i ];
 	}
 
 	track = (char*)realloc( track, ++size );
@@ -532,8 +645,8 @@ void tasmLexer() {
 		}else if ( ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t' ) {
 			continue;
 		}else if ( ch == ';' ) {
-			while ( i < programSize && ( ch == '\n' || ch == (char)0x00 ) ) {
-				ch = program[ i++ ];
+			while ( i < programSize && program[ i ] != '\n' && program[ i ] != (char)0x00 ) {
+				i++;
 			}
 			continue;
 		}else if ( ch == ',' ) {
@@ -544,7 +657,7 @@ void tasmLexer() {
 			continue;
 		}else if ( isNumber( i - 1 ) ) {
 			char* numstr = getNumber( i - 1 );
-			i += strlen( numstr );
+			i += strlen( numstr ) - 1;
 			appendToken( createToken( numstr, TASM_TOKEN_KIND_NUMBER ) );
 			continue;
 		}else if ( isKeyword( i - 1 ) ) {
@@ -636,10 +749,66 @@ void tasmParser() {
 				}
 				node->left = current;
 
+				appendAst( node );
+			}else if (
+				strcmp( current->value, TASM_KEYWORD_LOAD8 ) == 0 ||
+				strcmp( current->value, TASM_KEYWORD_LOAD16 ) == 0 ||
+				strcmp( current->value, TASM_KEYWORD_LOAD32 ) == 0 ||
+				strcmp( current->value, TASM_KEYWORD_LOAD64 ) == 0 ||
+				strcmp( current->value, TASM_KEYWORD_STORE8 ) == 0 ||
+				strcmp( current->value, TASM_KEYWORD_STORE16 ) == 0 ||
+				strcmp( current->value, TASM_KEYWORD_STORE32 ) == 0 ||
+				strcmp( current->value, TASM_KEYWORD_STORE64 ) == 0
+			) {
+				/*
+					TOKEN:
+						LOAD64 R1, R2, 0x10
+					AST:
+					        LOAD64
+						/\
+					     L /  \ R
+					     R2    R1
+					OFFSET:
+					    0x10
+				*/
+
+				struct ast* node = createAst( current, NULL, NULL );
+
+				current = current->next;
+				if ( current == NULL ) {
+					appendAst( node );
+					continue;
+				}
+				node->right = current;
+
+				current = current->next;
+				if ( current == NULL ) {
+					continue;
+				}
+
+				current = current->next;
+				if ( current == NULL ) {
+					appendAst( node );
+					continue;
+				}
+				node->left = current;
+
+				// The offset is optional
+				if (
+					current->next != NULL &&
+					current->next->kind == TASM_TOKEN_KIND_COMMA &&
+					current->next->next != NULL &&
+					current->next->next->kind == TASM_TOKEN_KIND_NUMBER
+				) {
+					current = current->next->next;
+					node->offset = current;
+				}
+
 				appendAst( node );
 			}else if (
 				strcmp( current->value, TASM_KEYWORD_JMP ) == 0 ||
 				strcmp( current->value, TASM_KEYWORD_JE ) == 0 ||
+				strcmp( current->value, TASM_KEYWORD_JNE ) == 0 ||
 				strcmp( current->value, TASM_KEYWORD_JNZ ) == 0 ||
 				strcmp( current->value, TASM_KEYWORD_CALL ) == 0 ||
 				strcmp( current->value, TASM_KEYWORD_INC ) == 0 ||
@@ -803,6 +972,14 @@ ubyte_t convertTokenToByte( char* symbol, int mode ) {
 	if ( strcmp( symbol, TASM_KEYWORD_INC ) == 0 ) return X8000_INC;
 	if ( strcmp( symbol, TASM_KEYWORD_DEC ) == 0 ) return X8000_DEC;
 	if ( strcmp( symbol, TASM_KEYWORD_INT ) == 0 ) return X8000_INT;
+	if ( strcmp( symbol, TASM_KEYWORD_LOAD8 ) == 0 ) return X8000_LOAD_8;
+	if ( strcmp( symbol, TASM_KEYWORD_LOAD16 ) == 0 ) return X8000_LOAD_16;
+	if ( strcmp( symbol, TASM_KEYWORD_LOAD32 ) == 0 ) return X8000_LOAD_32;
+	if ( strcmp( symbol, TASM_KEYWORD_LOAD64 ) == 0 ) return X8000_LOAD_64;
+	if ( strcmp( symbol, TASM_KEYWORD_STORE8 ) == 0 ) return X8000_STORE_8;
+	if ( strcmp( symbol, TASM_KEYWORD_STORE16 ) == 0 ) return X8000_STORE_16;
+	if ( strcmp( symbol, TASM_KEYWORD_STORE32 ) == 0 ) return X8000_STORE_32;
+	if ( strcmp( symbol, TASM_KEYWORD_STORE64 ) == 0 ) return X8000_STORE_64;
 	if ( strcmp( symbol, TASM_KEYWORD_MOV ) == 0 && mode == 0 ) return X8000_MOV_R;
 	if ( strcmp( symbol, TASM_KEYWORD_MOV ) == 0 && mode == 8 ) return X8000_MOV_8;
 	if ( strcmp( symbol, TASM_KEYWORD_MOV ) == 0 && mode == 16 ) return X8000_MOV_16;
@@ -847,7 +1024,25 @@ ssize_t convertNumberToBytes( char* numstr ) {
 	return (ssize_t)strtoll( numstr, &endptr, base );
 }
 
-void tasmCodeGen() {
+ubyte_t immediateMode( ssize_t num ) {
+	size_t value = (size_t)num;
+
+	if ( tasmOptimize == false ) {
+		return CONVERT_TOKEN_BYTE_MODE_64;
+	}
+
+	if ( value <= 0xFF ) {
+		return CONVERT_TOKEN_BYTE_MODE_8;
+	}else if ( value <= 0xFFFF ) {
+		return CONVERT_TOKEN_BYTE_MODE_16;
+	}else if ( value <= 0xFFFFFFFF ) {
+		return CONVERT_TOKEN_BYTE_MODE_32;
+	}
+
+	return CONVERT_TOKEN_BYTE_MODE_64;
+}
+
+bool tasmCodeGen() {
 	programBin = (ubyte_t*)malloc( programBinCursor );
 	struct ast* node = astStream;
 
@@ -899,22 +1094,73 @@ void tasmCodeGen() {
 						char byt[ 8 ];
 					} numBytes;
 					numBytes.value = num;
+					ubyte_t mode = immediateMode( num );
 
 					programBin = (ubyte_t*)realloc( programBin, ++programBinCursor );
-					programBin[ programBinCursor - 1 ] = convertTokenToByte( node->mid->value, CONVERT_TOKEN_BYTE_MODE_64 );
+					programBin[ programBinCursor - 1 ] = convertTokenToByte( node->mid->value, mode );
 
 					programBin = (ubyte_t*)realloc( programBin, ++programBinCursor );
 					programBin[ programBinCursor - 1 ] = rnodeByte;
 
-					for ( int i = 0; i < 8; i++ ) {
+					// Little-endian, so the low bytes come first
+					for ( int i = 0; i < mode / 8; i++ ) {
 						programBin = (ubyte_t*)realloc( programBin, ++programBinCursor );
 						programBin[ programBinCursor - 1 ] = numBytes.byt[ i ];
 					}
 				}
 			}
+		}else if (
+			strcmp( node->mid->value, TASM_KEYWORD_LOAD8 ) == 0 ||
+			strcmp( node->mid->value, TASM_KEYWORD_LOAD16 ) == 0 ||
+			strcmp( node->mid->value, TASM_KEYWORD_LOAD32 ) == 0 ||
+			strcmp( node->mid->value, TASM_KEYWORD_LOAD64 ) == 0 ||
+			strcmp( node->mid->value, TASM_KEYWORD_STORE8 ) == 0 ||
+			strcmp( node->mid->value, TASM_KEYWORD_STORE16 ) == 0 ||
+			strcmp( node->mid->value, TASM_KEYWORD_STORE32 ) == 0 ||
+			strcmp( node->mid->value, TASM_KEYWORD_STORE64 ) == 0
+		) {
+			/*
+			AST:
+				LOAD64
+				/\
+			     L /  \ R
+			     R2    R1
+			OFFSET:
+			    0x10
+			*/
+
+			struct token* rnode = node->right;
+			struct token* lnode = node->left;
+
+			if ( rnode != NULL && lnode != NULL ) {
+				union {
+					int value;
+					char byt[ 4 ];
+				} offsetBytes;
+				offsetBytes.value = 0;
+
+				if ( node->offset != NULL ) {
+					offsetBytes.value = (int)convertNumberToBytes( node->offset->value );
+				}
+
+				programBin = (ubyte_t*)realloc( programBin, ++programBinCursor );
+				programBin[ programBinCursor - 1 ] = convertTokenToByte( node->mid->value, CONVERT_TOKEN_BYTE_MODE_DEFAULT );
+
+				programBin = (ubyte_t*)realloc( programBin, ++programBinCursor );
+				programBin[ programBinCursor - 1 ] = convertTokenToByte( rnode->value, CONVERT_TOKEN_BYTE_MODE_DEFAULT );
+
+				programBin = (ubyte_t*)realloc( programBin, ++programBinCursor );
+				programBin[ programBinCursor - 1 ] = convertTokenToByte( lnode->value, CONVERT_TOKEN_BYTE_MODE_DEFAULT );
+
+				for ( int i = 0; i < 4; i++ ) {
+					programBin = (ubyte_t*)realloc( programBin, ++programBinCursor );
+					programBin[ programBinCursor - 1 ] = offsetBytes.byt[ i ];
+				}
+			}
 		}else if (
 			strcmp( node->mid->value, TASM_KEYWORD_JMP ) == 0 ||
 			strcmp( node->mid->value, TASM_KEYWORD_JE ) == 0 ||
+			strcmp( node->mid->value, TASM_KEYWORD_JNE ) == 0 ||
 			strcmp( node->mid->value, TASM_KEYWORD_JNZ ) == 0 ||
 			strcmp( node->mid->value, TASM_KEYWORD_CALL ) == 0 ||
 			strcmp( node->mid->value, TASM_KEYWORD_INC ) == 0 ||
@@ -935,15 +1181,17 @@ void tasmCodeGen() {
 			if ( rnode->kind == TASM_TOKEN_KIND_ID ) {
 				struct label* lb = searchLabel( rnode->value );
 
-				if ( lb == NULL ) {
-					lb->pos = (size_t)0x0;
-				}
-
 				union {
 					size_t value;
 					char byt[ 8 ];
 				} posBytes;
-				posBytes.value = lb->pos;
+				posBytes.value = (size_t)0x0;
+
+				if ( lb != NULL ) {
+					posBytes.value = lb->pos;
+				}else {
+					appendFixup( rnode->value, programBinCursor );
+				}
 
 				for ( size_t i = 0; i < 8; i++ ) {
 					programBin = (ubyte_t*)realloc( programBin, ++programBinCursor );
@@ -991,6 +1239,8 @@ void tasmCodeGen() {
 
 		node = node->next;
 	}
+
+	return resolveFixups();
 }
 
 void tasmCodeGenFree() {
@@ -1006,6 +1256,7 @@ void tasm_free() {
 	free( program );
 	freeTokens();
 	freeLabel();
+	freeFixups();
 	freeAst();
 	tasmCodeGenFree();
 }
@@ -1013,13 +1264,11 @@ void tasm_free() {
 
 // ==================== Main ====================
 int main( int argc, char* argv[] ) {
-	if ( argc != 4 ) {
+	if ( argc < 4 ) {
 		if ( argc == 1 ) {
 			fprintf( stderr, "Error: No file specified.\n" );
-		}else if ( argc < 4 ) {
-			fprintf( stderr, "Error: Invalid usage.\n" );
 		}else {
-			fprintf( stderr, "Error: Invalid argv.\n" );
+			fprintf( stderr, "Error: Invalid usage.\n" );
 		}
 
 		exit( EXIT_FAILURE );
@@ -1032,6 +1281,21 @@ int main( int argc, char* argv[] ) {
 
 	char* inputFileAddress = argv[ 1 ];
 	char* outputFileAddress = argv[ 3 ];
+	char* mapFileAddress = NULL;
+
+	// tasm program.s -o program.bin [-m program.map] [-O0]
+	for ( int i = 4; i < argc; i++ ) {
+		if ( strcmp( argv[ i ], "-m" ) == 0 && i + 1 < argc ) {
+			mapFileAddress = argv[ ++i ];
+		}else if ( strcmp( argv[ i ], "-O0" ) == 0 ) {
+			tasmOptimize = false;
+		}else if ( strcmp( argv[ i ], "-O1" ) == 0 ) {
+			tasmOptimize = true;
+		}else {
+			fprintf( stderr, "Error: Invalid argv.\n" );
+			exit( EXIT_FAILURE );
+		}
+	}
 
 	FILE* fptr = fopen( inputFileAddress, "rb" );
 	if ( fptr == NULL ) {
@@ -1057,7 +1321,10 @@ int main( int argc, char* argv[] ) {
 	// printTokenStream();
 	tasmParser();
 	// printAstStream();
-	tasmCodeGen();
+	if ( !tasmCodeGen() ) {
+		tasm_free();
+		exit( EXIT_FAILURE );
+	}
 
 	// printf( "Program ...\n" );
 	// for ( size_t i = 0; i < programBinCursor; i++ ) {
@@ -1084,6 +1351,12 @@ int main( int argc, char* argv[] ) {
 		goto out;
 	}
 
+	// Write the label offsets next to it
+	if ( mapFileAddress != NULL && !writeSymbolMap( mapFileAddress ) ) {
+		fprintf( stderr, "Error: Cannot write the symbol map.\n" );
+		goto out;
+	}
+
 	out:
 		tasm_free();
 		exit( EXIT_SUCCESS );
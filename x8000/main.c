@@ -2,27 +2,57 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <stddef.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#if defined( __linux__ ) && defined( __has_include )
+#if __has_include( <linux/io_uring.h> )
+#include <linux/io_uring.h>
+#endif
+#endif
 
 // ==================== Program Define ====================
 typedef unsigned char ubyte_t;
 
+struct x8000_vm;
+
 #define X8000_EXIT_SUCCESS 0x0
 #define X8000_EXIT_FAILURE 0x1
 
-ubyte_t* program = NULL;
-bool programStatus = true;
-long long exitCode = X8000_EXIT_SUCCESS;
-
-void initProgram( ubyte_t* _program );
-void freeProgram();
-void x8000_exe();
+#define PROGRAM_READ_CHUNK 0x10000
+
+bool loadProgram( struct x8000_vm* vm, const char* path );
+void shareProgram( struct x8000_vm* vm, ubyte_t* _program, size_t _programSize );
+bool openProgram( const char* path, ubyte_t** _program, size_t* _programSize, size_t* _programMapSize );
+bool readProgram( int fd, ubyte_t** _program, size_t* _programSize );
+void closeProgram( ubyte_t* _program, size_t _programMapSize );
+void initProgram( struct x8000_vm* vm );
+void releaseProgram( struct x8000_vm* vm );
+void freeProgram( struct x8000_vm* vm );
+void x8000_exe( struct x8000_vm* vm );
 // ==================== Program Define ====================
 
 // ==================== Registers Define ====================
-typedef long long register_t;
+typedef long long x8000_register_t;
 typedef uintptr_t x8000_address_t;
 
-#define NULL_REG	(register_t) 0x0000000000000000
+#define NULL_REG	(x8000_register_t) 0x0000000000000000
 #define NULL_ADDRESS	(x8000_address_t) 0x0000000000000000
 #define NULL_SP		NULL_ADDRESS
 
@@ -55,54 +85,91 @@ typedef uintptr_t x8000_address_t;
 #define REGISTER_RR7	(ubyte_t) 0xBA
 #define REGISTER_RR8	(ubyte_t) 0xBB
 
+/*
+	The register file is an array indexed by REGISTER_INDEX( reg ), so
+	decoded ops carry the index and every access is a single load or
+	store. The named fields alias the same storage.
+*/
+#define REGISTERS_COUNT 28
+#define REGISTER_INDEX( reg ) (ubyte_t)( (reg) - REGISTER_IP )
+
 struct RegistersStruct {
-	register_t IP	;
-	register_t RK	;
-	register_t RC	;
-	register_t SP	;
-	register_t R1	;
-	register_t R2	;
-	register_t R3	;
-	register_t R4	;
-	register_t R5	;
-	register_t R6	;
-	register_t R7	;
-	register_t R8	;
-	register_t RP1	;
-	register_t RP2	;
-	register_t RP3	;
-	register_t RP4	;
-	register_t RP5	;
-	register_t RP6	;
-	register_t RP7	;
-	register_t RP8	;
-	register_t RR1	;
-	register_t RR2	;
-	register_t RR3	;
-	register_t RR4	;
-	register_t RR5	;
-	register_t RR6	;
-	register_t RR7	;
-	register_t RR8	;
+	union {
+		x8000_register_t regs[ REGISTERS_COUNT ];
+		struct {
+			x8000_register_t IP	;
+			x8000_register_t RK	;
+			x8000_register_t RC	;
+			x8000_register_t SP	;
+			x8000_register_t R1	;
+			x8000_register_t R2	;
+			x8000_register_t R3	;
+			x8000_register_t R4	;
+			x8000_register_t R5	;
+			x8000_register_t R6	;
+			x8000_register_t R7	;
+			x8000_register_t R8	;
+			x8000_register_t RP1	;
+			x8000_register_t RP2	;
+			x8000_register_t RP3	;
+			x8000_register_t RP4	;
+			x8000_register_t RP5	;
+			x8000_register_t RP6	;
+			x8000_register_t RP7	;
+			x8000_register_t RP8	;
+			x8000_register_t RR1	;
+			x8000_register_t RR2	;
+			x8000_register_t RR3	;
+			x8000_register_t RR4	;
+			x8000_register_t RR5	;
+			x8000_register_t RR6	;
+			x8000_register_t RR7	;
+			x8000_register_t RR8	;
+		};
+	};
+
+	/*
+		Condition flags are lazy: CMP only records its two operands and
+		the jumps compare them directly. RC is computed from them the
+		first time an instruction reads it (flagsLazy says it is stale),
+		and a write to RC is turned back into a pair of operands that
+		gives the same flags. The fields follow regs so the JIT can
+		address them as registers REGISTERS_COUNT and up.
+	*/
+	x8000_register_t flagsLeft;
+	x8000_register_t flagsRight;
+	x8000_register_t flagsLazy;
 };
 
-struct RegistersStruct registers;
-x8000_address_t* stackPointer = NULL;
-size_t stackPointerSize = 0;
+/*
+	Call stack
+
+	Return addresses live in a stack allocated once at init with room
+	for stackPointerCapacity calls (--stack-depth on the command line).
+	CALL on a full stack and RET on an empty one fault the program, and
+	the SP register always holds the current call depth.
+*/
+#define STACK_DEPTH_DEFAULT	(size_t) 0x10000
 
-void initRegisters();
-void freeRegisters();
-void resetRegisters();
+void initRegisters( struct x8000_vm* vm );
+void freeRegisters( struct x8000_vm* vm );
+void resetRegisters( struct x8000_vm* vm );
+void materializeFlags( struct x8000_vm* vm );
+void restoreFlags( struct x8000_vm* vm );
 bool isValidRegister( ubyte_t reg );
-void setRegister( ubyte_t reg, register_t val );
-register_t getRegister( ubyte_t reg );
-void pushSP( x8000_address_t address );
-x8000_address_t popSP();
-ubyte_t instructionPeek();
-ubyte_t instructionNext();
+bool pushSP( struct x8000_vm* vm, x8000_address_t address );
+x8000_address_t popSP( struct x8000_vm* vm );
 // ==================== Registers Define ====================
 
 // ==================== Instruction Define ====================
+#define X8000_LOAD_8	(ubyte_t) 0x11
+#define X8000_LOAD_16	(ubyte_t) 0x12
+#define X8000_LOAD_32	(ubyte_t) 0x13
+#define X8000_LOAD_64	(ubyte_t) 0x14
+#define X8000_STORE_8	(ubyte_t) 0x15
+#define X8000_STORE_16	(ubyte_t) 0x16
+#define X8000_STORE_32	(ubyte_t) 0x17
+#define X8000_STORE_64	(ubyte_t) 0x18
 #define X8000_MOV_R	(ubyte_t) 0x20
 #define X8000_MOV_8	(ubyte_t) 0x21
 #define X8000_MOV_16	(ubyte_t) 0x22
@@ -155,106 +222,1160 @@ ubyte_t instructionNext();
 */
 #define CMP_FLAG_EQ (ubyte_t) 0b01000000
 #define CMP_FLAG_NJ (ubyte_t) 0b10000000
+// RC itself is only built when an instruction reads it, see RegistersStruct
+
+/*
+	Fused compare-and-branch ops keep their jump condition as the flag
+	it tests, plus CMP_COND_INVERT for JNE, so taking the branch needs
+	no switch on the jump opcode.
+*/
+#define CMP_COND_INVERT (ubyte_t) 0b00000001
+
+/*
+	Decoded op kinds. They index the handler table and the dispatch
+	table of x8000_exe, so they must stay dense and in the same order.
+*/
+#define X8000_OP_BAD		(ubyte_t) 0x00
+#define X8000_OP_IP		(ubyte_t) 0x01
+#define X8000_OP_MOV_R		(ubyte_t) 0x02
+#define X8000_OP_MOV		(ubyte_t) 0x03
+#define X8000_OP_CMP_R		(ubyte_t) 0x04
+#define X8000_OP_CMP		(ubyte_t) 0x05
+#define X8000_OP_JMP		(ubyte_t) 0x06
+#define X8000_OP_JE		(ubyte_t) 0x07
+#define X8000_OP_JNE		(ubyte_t) 0x08
+#define X8000_OP_JNZ		(ubyte_t) 0x09
+#define X8000_OP_CALL		(ubyte_t) 0x0A
+#define X8000_OP_RET		(ubyte_t) 0x0B
+#define X8000_OP_INC		(ubyte_t) 0x0C
+#define X8000_OP_DEC		(ubyte_t) 0x0D
+#define X8000_OP_ADD_R		(ubyte_t) 0x0E
+#define X8000_OP_ADD		(ubyte_t) 0x0F
+#define X8000_OP_SUB_R		(ubyte_t) 0x10
+#define X8000_OP_SUB		(ubyte_t) 0x11
+#define X8000_OP_MUL_R		(ubyte_t) 0x12
+#define X8000_OP_MUL		(ubyte_t) 0x13
+#define X8000_OP_DIV_R		(ubyte_t) 0x14
+#define X8000_OP_DIV		(ubyte_t) 0x15
+#define X8000_OP_INT		(ubyte_t) 0x16
+#define X8000_OP_MOV_INT	(ubyte_t) 0x17
+#define X8000_OP_CMP_JCC	(ubyte_t) 0x18
+#define X8000_OP_CMP_R_JCC	(ubyte_t) 0x19
+#define X8000_OP_STEP_CMP_JCC	(ubyte_t) 0x1A
+#define X8000_OP_STEP_CMP_R_JCC	(ubyte_t) 0x1B
+#define X8000_OP_JIT		(ubyte_t) 0x1C
+#define X8000_OP_LOAD_8		(ubyte_t) 0x1D
+#define X8000_OP_LOAD_16	(ubyte_t) 0x1E
+#define X8000_OP_LOAD_32	(ubyte_t) 0x1F
+#define X8000_OP_LOAD_64	(ubyte_t) 0x20
+#define X8000_OP_STORE_8	(ubyte_t) 0x21
+#define X8000_OP_STORE_16	(ubyte_t) 0x22
+#define X8000_OP_STORE_32	(ubyte_t) 0x23
+#define X8000_OP_STORE_64	(ubyte_t) 0x24
+#define X8000_OP_RC		(ubyte_t) 0x25
+#define X8000_OPS_COUNT		(ubyte_t) 0x26
+
+struct x8000_op;
+typedef ubyte_t (*x8000_handler_t)( struct x8000_vm* vm, struct x8000_op* op );
 
 ubyte_t handleInstruction( ubyte_t ins );
-ubyte_t x8000_mov();
-ubyte_t x8000_cmp();
-ubyte_t x8000_jmp();
-ubyte_t x8000_je();
-ubyte_t x8000_jne();
-ubyte_t x8000_jnz();
-ubyte_t x8000_call();
-ubyte_t x8000_ret();
-ubyte_t x8000_inc();
-ubyte_t x8000_dec();
-ubyte_t x8000_add();
-ubyte_t x8000_sub();
-ubyte_t x8000_mul();
-ubyte_t x8000_div();
-ubyte_t x8000_int();
+ubyte_t x8000_bad( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_ip( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_mov_r( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_mov( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_cmp_r( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_cmp( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_jmp( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_je( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_jne( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_jnz( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_call( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_ret( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_inc( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_dec( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_add_r( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_add( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_sub_r( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_sub( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_mul_r( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_mul( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_div_r( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_div( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_int( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_mov_int( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_cmp_jcc( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_cmp_r_jcc( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_step_cmp_jcc( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_step_cmp_r_jcc( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_jit( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_load_8( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_load_16( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_load_32( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_load_64( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_store_8( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_store_16( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_store_32( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_store_64( struct x8000_vm* vm, struct x8000_op* op );
+ubyte_t x8000_rc( struct x8000_vm* vm, struct x8000_op* op );
+bool isConditionTaken( struct x8000_vm* vm, ubyte_t cond );
+
+x8000_handler_t handlers[ X8000_OPS_COUNT ] = {
+	x8000_bad,
+	x8000_ip,
+	x8000_mov_r,
+	x8000_mov,
+	x8000_cmp_r,
+	x8000_cmp,
+	x8000_jmp,
+	x8000_je,
+	x8000_jne,
+	x8000_jnz,
+	x8000_call,
+	x8000_ret,
+	x8000_inc,
+	x8000_dec,
+	x8000_add_r,
+	x8000_add,
+	x8000_sub_r,
+	x8000_sub,
+	x8000_mul_r,
+	x8000_mul,
+	x8000_div_r,
+	x8000_div,
+	x8000_int,
+	x8000_mov_int,
+	x8000_cmp_jcc,
+	x8000_cmp_r_jcc,
+	x8000_step_cmp_jcc,
+	x8000_step_cmp_r_jcc,
+	x8000_jit,
+	x8000_load_8,
+	x8000_load_16,
+	x8000_load_32,
+	x8000_load_64,
+	x8000_store_8,
+	x8000_store_16,
+	x8000_store_32,
+	x8000_store_64,
+	x8000_rc,
+};
 // ==================== Instruction Define ====================
 
+// ==================== Decoder Define ====================
+/*
+	The program is decoded once at load time into an array of ops, so
+	the interpreter never touches the raw bytes again. Byte addresses
+	(jump targets, return addresses) are mapped to op indices through
+	ipMap, which holds OP_INDEX_NONE for bytes that do not start an
+	instruction.
+
+	Common sequences are fused into superinstructions by giving the
+	first op of the sequence a fused kind; length is the number of ops
+	it covers. The covered ops are left untouched, so a jump into the
+	middle of a sequence still runs the plain ops from there.
+
+	Every image is run through verifyProgram before it gets here: each
+	opcode is known, each register byte is valid, no instruction runs
+	past the end and every jump or call lands on the start of an
+	instruction. A bad binary is rejected up front with the offset of
+	the first bad instruction, so the only BAD op a verified program
+	can reach is the sentinel after the last instruction.
+*/
+#define OP_INDEX_NONE (size_t) -0x1
+#define OP_FUSE_MAX_LENGTH (ubyte_t) 0xFF
+
+struct x8000_op {
+	ubyte_t kind;
+	ubyte_t opcode;
+	ubyte_t dst;
+	ubyte_t src;
+	ubyte_t length;
+	ubyte_t cond;
+	x8000_register_t imm;
+	x8000_address_t ip;
+	x8000_address_t nextIP;
+	size_t target;
+};
+
+void initDecoder( struct x8000_vm* vm );
+void freeDecoder( struct x8000_vm* vm );
+size_t instructionSize( ubyte_t ins );
+bool isBranchInstruction( ubyte_t ins );
+bool isMemoryInstruction( ubyte_t ins );
+bool verifyProgram( const ubyte_t* program, size_t programSize );
+bool verifyFailure( const ubyte_t* program, size_t pos, const char* reason );
+void decodeInstruction( struct x8000_vm* vm, struct x8000_op* op, size_t pos );
+size_t lookupOp( struct x8000_vm* vm, x8000_address_t address );
+void fuseOps( struct x8000_vm* vm );
+ubyte_t jumpCondition( ubyte_t ins );
+// ==================== Decoder Define ====================
+
+// ==================== JIT Define ====================
+/*
+	On Linux x86-64 hot basic blocks are compiled to native code. Taken
+	branches (and CALL/RET) count hits on the op they land on; once an
+	op reaches JIT_THRESHOLD the block starting there is compiled into
+	jitCode and the op becomes X8000_OP_JIT, which enters the block.
+
+	A block runs up to and including its first JMP/JE/JNE/JNZ/CALL/RET
+	and stops early at anything it cannot compile (INT, memory, IP or RC
+	operands). A block shorter than JIT_BLOCK_MIN_OPS whose branch target
+	(or next op, if it stops early) will not be compiled is left to the
+	interpreter, entering and leaving it costs more than interpreting it.
+
+	Guest registers used by the block are kept in host registers for
+	the whole block and written back on exit. A branch back to the
+	block head stays in native code without touching memory, and every
+	other exit either jumps straight into the compiled block for its
+	target or returns the target op index to x8000_exe. Returns to the
+	interpreter are patched into direct jumps once their target gets
+	compiled. CALL pushes the return address in native code and RET
+	jumps straight to the compiled block of the address it pops; a full
+	or empty call stack or a bad return address is left to the
+	interpreter so the error is reported the same way.
+
+	Every pass through a block adds its op count to instructionCount,
+	the interpreter counts the rest. Build with -DX8000_NO_JIT to leave
+	the interpreter alone.
+*/
+#if defined( __x86_64__ ) && defined( __linux__ ) && !defined( X8000_NO_JIT )
+#define X8000_JIT
+#endif
+
+#define JIT_THRESHOLD		(unsigned int) 0x40
+#define JIT_CODE_SIZE		(size_t) 0x1000000
+#define JIT_BLOCK_MIN_OPS	(size_t) 0x08
+#define JIT_BLOCK_MAX_OPS	(size_t) 0x100
+#define JIT_BLOCK_MAX_BYTES	( JIT_BLOCK_MAX_OPS * 0x40 + 0x800 )
+#define JIT_HOST_REGS_COUNT	10
+
+// The lazy flag operands are handled as two more guest registers
+#define JIT_REGS_COUNT		( REGISTERS_COUNT + 2 )
+#define JIT_FLAGS_LEFT		(ubyte_t) REGISTERS_COUNT
+#define JIT_FLAGS_RIGHT		(ubyte_t) ( REGISTERS_COUNT + 1 )
+#define JIT_FLAGS_LAZY		(ubyte_t) ( REGISTERS_COUNT + 2 )
+
+// x86-64 register numbers
+#define JIT_RAX	0
+#define JIT_RCX	1
+#define JIT_RDX	2
+#define JIT_RBX	3
+#define JIT_RSI	6
+#define JIT_RDI	7
+#define JIT_R8	8
+#define JIT_R9	9
+#define JIT_R10	10
+#define JIT_R11	11
+#define JIT_R12	12
+#define JIT_R13	13
+#define JIT_R14	14
+#define JIT_R15	15
+
+// x86-64 condition codes
+#define JIT_CC_AE	(ubyte_t) 0x03
+#define JIT_CC_Z	(ubyte_t) 0x04
+#define JIT_CC_NZ	(ubyte_t) 0x05
+#define JIT_CC_A	(ubyte_t) 0x07
+
+// Fields of the VM are reached from the register file in rdi
+#define JIT_VM_OFFSET( field )	(uint32_t)(int32_t)( (ptrdiff_t)offsetof( struct x8000_vm, field ) - (ptrdiff_t)offsetof( struct x8000_vm, registers ) )
+
+typedef size_t (*x8000_jit_enter_t)( x8000_register_t* regs, ubyte_t* block );
+
+struct jitPatch {
+	size_t pos;
+	size_t target;
+	struct jitPatch* next;
+};
+
+void initJit( struct x8000_vm* vm );
+void freeJit( struct x8000_vm* vm );
+void jitCount( struct x8000_vm* vm, size_t index );
+bool jitLeaves( struct x8000_vm* vm, size_t index );
+bool jitCompile( struct x8000_vm* vm, size_t head );
+bool isJitInstruction( struct x8000_op* op );
+void jitEmit8( struct x8000_vm* vm, ubyte_t bt );
+void jitEmit32( struct x8000_vm* vm, uint32_t value );
+void jitEmit64( struct x8000_vm* vm, uint64_t value );
+void jitRex( struct x8000_vm* vm, int reg, int rm );
+void jitModRM( struct x8000_vm* vm, int mod, int reg, int rm );
+void jitLoad( struct x8000_vm* vm, int reg, ubyte_t index );
+void jitStore( struct x8000_vm* vm, ubyte_t index, int reg );
+void jitLoadField( struct x8000_vm* vm, int reg, uint32_t offset );
+void jitStoreField( struct x8000_vm* vm, uint32_t offset, int reg );
+void jitMovRI( struct x8000_vm* vm, int reg, x8000_register_t imm );
+void jitAluRR( struct x8000_vm* vm, ubyte_t opcode, int dst, int src );
+void jitAluRI( struct x8000_vm* vm, ubyte_t digit, int dst, x8000_register_t imm );
+void jitImulRR( struct x8000_vm* vm, int dst, int src );
+void jitImulRI( struct x8000_vm* vm, int dst, x8000_register_t imm );
+void jitDiv( struct x8000_vm* vm, int dst, int src );
+size_t jitJcc( struct x8000_vm* vm, ubyte_t cc );
+size_t jitJmp( struct x8000_vm* vm );
+void jitPatchRel32( struct x8000_vm* vm, size_t pos, size_t target );
+void jitExit( struct x8000_vm* vm, size_t target, size_t head, size_t body, int* hostRegs, uint32_t dirty );
+void jitWriteBack( struct x8000_vm* vm, int* hostRegs, uint32_t dirty );
+void jitJump( struct x8000_vm* vm, size_t target );
+void jitCall( struct x8000_vm* vm, struct x8000_op* op );
+void jitReturn( struct x8000_vm* vm, struct x8000_op* op );
+void jitRetry( struct x8000_vm* vm, struct x8000_op* op );
+void jitTraceBranch( struct x8000_vm* vm, x8000_address_t end );
+// ==================== JIT Define ====================
+
+// ==================== Memory Define ====================
+/*
+	Guest memory
+
+	By default guest addresses are host pointers. With --sandbox the
+	guest instead gets one linear region reserved with mmap and every
+	guest address is an offset into it. Only the first memoryLimit
+	bytes after the leading guard are accessible; the guard in front
+	keeps address 0 unusable and everything past the limit up to the
+	end of the reservation stays PROT_NONE, so a stray access faults
+	instead of being checked on every instruction. A fault inside the
+	region is turned into a guest failure by memoryFault.
+
+	The heap takes its slabs and large chunks from a bump pointer.
+	Released chunks go to memoryRanges, a list of free ranges sorted by
+	address where neighbours are merged, and the first range that fits
+	is used before memoryTop moves up again. A range that reaches
+	memoryTop lowers it instead, so memoryTop is the high-water mark of
+	guest memory in use.
+
+	LOAD/STORE go through GUEST_ACCESS, which adds the address masked
+	with memoryMask to memoryBase and checks nothing. In the sandbox the
+	mask keeps the low 32 bits; the reservation covers 4 GiB plus a
+	trailing guard, so even an 8 byte access at the top offset stays
+	inside it. Outside the sandbox the base is NULL and the mask keeps
+	everything, so the address is the host pointer. Only guestPointer,
+	which takes a length, checks its range.
+*/
+#define MEMORY_RESERVE_SIZE	( (size_t) 0x100000000 + MEMORY_GUARD_SIZE )
+#define MEMORY_GUARD_SIZE	(size_t) 0x10000
+#define MEMORY_LIMIT_DEFAULT	(size_t) 0x10000000
+#define MEMORY_LIMIT_MAX	( MEMORY_RESERVE_SIZE - MEMORY_GUARD_SIZE * 2 )
+#define MEMORY_ALIGN		(size_t) 0x10
+
+struct memoryRange {
+	x8000_address_t address;
+	size_t size;
+};
+
+#define GUEST_ACCESS( vm, address ) ( (ubyte_t*)( (uintptr_t)(vm)->memoryBase + ( (uintptr_t)( address ) & (vm)->memoryMask ) ) )
+
+void initMemory( struct x8000_vm* vm );
+void freeMemory( struct x8000_vm* vm );
+void* guestPointer( struct x8000_vm* vm, x8000_address_t address, size_t size );
+x8000_address_t memoryAlloc( struct x8000_vm* vm, size_t size, size_t align );
+void memoryRelease( struct x8000_vm* vm, x8000_address_t address, size_t size );
+bool memoryRangesGrow( struct x8000_vm* vm );
+void memoryFault( int sig, siginfo_t* info, void* context );
+
+// The VM x8000_run is executing on this thread, for memoryFault
+_Thread_local struct x8000_vm* memoryFaultVm = NULL;
+// ==================== Memory Define ====================
+
+// ==================== Heap Define ====================
+/*
+	Guest heap
+
+	MALLOC/REALLOC/FREE are served by the VM instead of going to libc
+	for every request. Small requests are rounded up to a power of two
+	size class and carved out of HEAP_SLAB_SIZE slabs; freed objects go
+	on a per-class free list and are reused first. Anything bigger than
+	the largest class gets its own chunk. REALLOC grows in place while
+	the new size still fits the class.
+
+	None of the bookkeeping lives next to the objects: every slab and
+	large chunk has a heapBlock on the host, found through a hash table
+	keyed by its guest address, a slab keeps a bitmap of its allocated
+	slots and the free lists hold guest addresses. Slabs are aligned to
+	their size, so the slab of an object is its address rounded down.
+	A FREE or REALLOC is only carried out for an address that is the
+	start of a live object, anything else fails the INT, so a guest
+	that scribbles over its heap can only corrupt its own data.
+
+	Slabs and large chunks come from memoryBase when --sandbox is on
+	and from libc otherwise, and are all released at once by freeHeap.
+	--heap-stats prints the per-class counters on exit.
+*/
+#define HEAP_SLAB_SIZE		(size_t) 0x10000
+#define HEAP_CLASSES_COUNT	8
+#define HEAP_CLASS_MIN		(size_t) 0x10
+#define HEAP_CLASS_LARGE	(size_t) 0xFF
+#define HEAP_SLAB_WORDS		( HEAP_SLAB_SIZE / HEAP_CLASS_MIN / 64 )
+#define HEAP_TABLE_MIN		(size_t) 0x40
+
+struct heapBlock {
+	x8000_address_t address;
+	size_t cls;
+	size_t size;
+	struct heapBlock* next;
+	uint64_t used[];
+};
+
+struct heapClass {
+	x8000_address_t* freeList;
+	size_t freeCount;
+	size_t freeCapacity;
+	x8000_address_t cursor;
+	x8000_address_t end;
+	size_t allocs;
+	size_t frees;
+	size_t live;
+	size_t peak;
+	size_t slabs;
+};
+
+void initHeap( struct x8000_vm* vm );
+void freeHeap( struct x8000_vm* vm );
+void printHeapStats( struct x8000_vm* vm );
+x8000_address_t heapChunk( struct x8000_vm* vm, size_t size, size_t align );
+x8000_address_t heapAlloc( struct x8000_vm* vm, size_t size );
+x8000_address_t heapRealloc( struct x8000_vm* vm, x8000_address_t address, size_t size );
+bool heapRelease( struct x8000_vm* vm, x8000_address_t address );
+void heapChunkRelease( struct x8000_vm* vm, x8000_address_t address, size_t size );
+struct heapBlock* heapNewBlock( struct x8000_vm* vm, x8000_address_t address, size_t cls, size_t size );
+bool heapInsert( struct x8000_vm* vm, struct heapBlock* block );
+void heapRemove( struct x8000_vm* vm, struct heapBlock* block );
+struct heapBlock* heapFind( struct x8000_vm* vm, x8000_address_t address, bool large );
+struct heapBlock* heapLookup( struct x8000_vm* vm, x8000_address_t address, size_t* slot );
+size_t heapHash( struct x8000_vm* vm, x8000_address_t address );
+// ==================== Heap Define ====================
+
+// ==================== Output Define ====================
+/*
+	Buffered output
+
+	Guest writes to STDOUT/STDERR are collected in a per-descriptor
+	buffer and handed to the kernel in large chunks. A descriptor that
+	is a terminal is line buffered, anything else is fully buffered,
+	and a buffer size of 0 (--stdout-buffer / --stderr-buffer) writes
+	straight through. Buffers are flushed by the FLUSH syscall, before
+	reading stdin, on EXIT and when the engine stops for any reason.
+*/
+#define OUTPUT_BUFFER_DEFAULT	(size_t) 0x10000
+
+struct outputBuffer {
+	int fd;
+	ubyte_t* data;
+	size_t size;
+	size_t capacity;
+	bool lineBuffered;
+};
+
+void initOutput( struct x8000_vm* vm );
+void freeOutput( struct x8000_vm* vm );
+void initOutputBuffer( struct outputBuffer* output );
+bool flushOutput( struct x8000_vm* vm );
+bool outputFlush( struct outputBuffer* output );
+bool outputAppend( struct outputBuffer* output, const ubyte_t* data, size_t size );
+bool outputWrite( int fd, const ubyte_t* data, size_t size );
+bool outputAppendv( struct outputBuffer* output, struct iovec* vec, int count, size_t total );
+bool outputWritev( int fd, struct iovec* vec, int count );
+// ==================== Output Define ====================
+
+// ==================== Async Define ====================
+/*
+	Async I/O packet
+
+	SUBMIT_READ/SUBMIT_WRITE queue a transfer on a guest buffer and
+	return a ticket right away; POLL checks a ticket without blocking
+	and WAIT blocks until it completes. A completed ticket is released
+	once its result has been returned. Up to ASYNC_SLOTS_COUNT
+	transfers can be in flight at once, and the buffer must stay
+	untouched until its ticket completes.
+
+	Requests go to an io_uring when the kernel provides one, and to a
+	small pool of worker threads doing blocking readv/writev otherwise
+	(or with --no-io-uring). The backend is started on first use, and
+	pending writes are drained before the engine exits.
+*/
+#if defined( IORING_OFF_SQ_RING ) && defined( __NR_io_uring_setup ) && !defined( X8000_NO_IO_URING )
+#define X8000_IO_URING
+#endif
+
+#define ASYNC_SLOTS_COUNT	(size_t) 0x100
+#define ASYNC_THREADS_COUNT	4
+
+#define ASYNC_STATE_FREE	(ubyte_t) 0x00
+#define ASYNC_STATE_PENDING	(ubyte_t) 0x01
+#define ASYNC_STATE_DONE	(ubyte_t) 0x02
+
+#define ASYNC_BACKEND_NONE	(ubyte_t) 0x00
+#define ASYNC_BACKEND_URING	(ubyte_t) 0x01
+#define ASYNC_BACKEND_THREADS	(ubyte_t) 0x02
+
+struct asyncSlot {
+	x8000_register_t ticket;
+	ubyte_t state;
+	bool write;
+	int fd;
+	struct iovec vec;
+	x8000_register_t result;
+	x8000_register_t generation;
+	struct asyncSlot* next;
+};
+
+void initAsync( struct x8000_vm* vm );
+void freeAsync( struct x8000_vm* vm );
+void stopAsync( struct x8000_vm* vm );
+bool asyncStart( struct x8000_vm* vm );
+x8000_register_t asyncSubmit( struct x8000_vm* vm, bool write, int fd, void* buff, size_t size );
+struct asyncSlot* asyncLookup( struct x8000_vm* vm, x8000_register_t ticket );
+bool asyncComplete( struct x8000_vm* vm, struct asyncSlot* slot, bool wait );
+bool uringSetup( struct x8000_vm* vm );
+void uringFree( struct x8000_vm* vm );
+void uringSubmit( struct x8000_vm* vm, struct asyncSlot* slot );
+bool uringReap( struct x8000_vm* vm, bool wait );
+void* asyncWorker( void* arg );
+void asyncUnlock( void* arg );
+// ==================== Async Define ====================
+
+// ==================== Snapshot Define ====================
+/*
+	Snapshots
+
+	SNAPSHOT writes out everything needed to carry on right after the
+	INT that took it: registers, call stack, program image and the used
+	part of guest memory along with the heap bookkeeping. x8000 --restore
+	resumes from the file instead of running the program from the start,
+	so a long setup phase only has to run once.
+
+	Guest addresses are only independent of the host in the sandbox, so
+	that is the only place a snapshot can be taken. The program image
+	and guest memory start on MEMORY_GUARD_SIZE boundaries in the file
+	and are mapped private straight from it, so a restore only reads the
+	pages the resumed program touches. The heap bookkeeping lives on the
+	host and only holds guest addresses, so its blocks, free lists and
+	the released memory ranges are written after the call stack and
+	read back as they are.
+
+	The header carries the raw heap state, a snapshot is only good for
+	the build of the engine that wrote it.
+*/
+#define SNAPSHOT_MAGIC		"X8000SNP"
+#define SNAPSHOT_VERSION	(uint64_t) 0x03
+#define SNAPSHOT_ALIGN( size )	( ( (size_t)( size ) + MEMORY_GUARD_SIZE - 1 ) & ~( MEMORY_GUARD_SIZE - 1 ) )
+
+struct snapshotHeader {
+	char magic[ 8 ];
+	uint64_t version;
+	uint64_t headerSize;
+	uint64_t ip;
+	x8000_register_t regs[ REGISTERS_COUNT ];
+	uint64_t stackSize;
+	uint64_t programOffset;
+	uint64_t programSize;
+	uint64_t memoryOffset;
+	uint64_t memorySize;
+	uint64_t memoryLimit;
+	uint64_t memoryTop;
+	uint64_t memoryRanges;
+	uint64_t memoryBase;
+	struct heapClass heapClasses[ HEAP_CLASSES_COUNT ];
+	uint64_t heapBlocks;
+	uint64_t heapLargeAllocs;
+	uint64_t heapLargeFrees;
+};
+
+struct snapshotBlock {
+	uint64_t address;
+	uint64_t cls;
+	uint64_t size;
+	uint64_t used[ HEAP_SLAB_WORDS ];
+};
+
+bool snapshotSave( struct x8000_vm* vm, const char* path );
+bool snapshotOpen( struct x8000_vm* vm, const char* path, struct snapshotHeader* header, int* fd );
+bool snapshotRestore( struct x8000_vm* vm, const struct snapshotHeader* header, int fd );
+bool snapshotSaveHeap( struct x8000_vm* vm, int fd, off_t offset );
+bool snapshotRestoreHeap( struct x8000_vm* vm, const struct snapshotHeader* header, int fd, off_t offset );
+bool snapshotWrite( int fd, const void* data, size_t size, off_t offset );
+bool snapshotRead( int fd, void* data, size_t size, off_t offset );
+// ==================== Snapshot Define ====================
+
+// ==================== Fork Server Define ====================
+/*
+	Fork server
+
+	With --fork-server PATH the program is loaded, decoded and started
+	once and then stopped at its fork point: the entry, or its first
+	SNAPSHOT with --fork-at-snapshot. From there the engine listens on
+	the Unix socket PATH and forks a copy-on-write child per connection,
+	so a run costs a fork instead of an exec, a load and a warm-up.
+
+	A request is one byte carrying up to FORK_FDS_COUNT descriptors
+	(SCM_RIGHTS) that become the child's STDIN, STDOUT and STDERR, a
+	missing one is /dev/null. The child carries on from the fork point
+	and leaves its exit code and the instructions it ran in a page
+	shared with the server, which sends them back as a forkResult once
+	the child is gone. A child killed by a signal reports 128 + signal.
+
+	Requests are served one at a time, run a server per core for more.
+	The async backend's threads and ring do not survive a fork, so the
+	fork point has to come before the first SUBMIT.
+*/
+#define FORK_BACKLOG		0x10
+#define FORK_FDS_COUNT		3
+#define FORK_SIGNAL_EXIT	0x80
+
+struct forkResult {
+	int64_t exitCode;
+	uint64_t instructionCount;
+};
+
+bool forkServe( struct x8000_vm* vm );
+bool forkRequest( int client, int* fds );
+void forkFinish( struct x8000_vm* vm );
+// ==================== Fork Server Define ====================
+
+// ==================== Profile Define ====================
+/*
+	Profiler
+
+	Built with -DX8000_PROFILE, --profile counts every op x8000_exe
+	dispatches and the clock ticks (the TSC on x86-64, nanoseconds
+	elsewhere) until the next one, and times every syscall by its RK
+	code. Without the define none of it is compiled in and the dispatch
+	loop is untouched.
+
+	The counters are per decoded op, so the report can be broken down
+	per IP and summed per opcode. To keep that exact a profiled VM does
+	not fuse ops and does not compile blocks, so every dispatch is one
+	guest instruction. The report goes to STDERR on exit, sorted by
+	ticks, and --profile-json FILE writes the same data as JSON.
+*/
+#if defined( X8000_PROFILE ) && defined( __x86_64__ )
+#include <x86intrin.h>
+#endif
+
+#define PROFILE_SYSCALLS_COUNT	0x100
+#define PROFILE_OPCODES_COUNT	0x100
+#define PROFILE_TOP_IPS		0x14
+
+#define PROFILE_TABLE_OPCODES	(ubyte_t) 0x00
+#define PROFILE_TABLE_SYSCALLS	(ubyte_t) 0x01
+#define PROFILE_TABLE_IPS	(ubyte_t) 0x02
+
+struct profileCounter {
+	uint64_t count;
+	uint64_t ticks;
+};
+
+struct profileRow {
+	size_t index;
+	struct profileCounter counter;
+};
+
+void initProfile( struct x8000_vm* vm );
+void freeProfile( struct x8000_vm* vm );
+uint64_t profileClock();
+void profileStep( struct x8000_vm* vm, struct x8000_op* op );
+void profileStop( struct x8000_vm* vm );
+ubyte_t profileSyscall( struct x8000_vm* vm );
+void profileReport( struct x8000_vm* vm, FILE* file );
+void profileJson( struct x8000_vm* vm, FILE* file );
+size_t profileRows( struct x8000_vm* vm, ubyte_t table, struct profileRow* rows );
+int profileCompare( const void* a, const void* b );
+const char* opcodeName( ubyte_t opcode );
+const char* syscallName( size_t code );
+// ==================== Profile Define ====================
+
+// ==================== Sample Define ====================
+/*
+	Sampling profiler
+
+	--sample FILE arms a SIGPROF timer ticking SAMPLE_HZ times per
+	second of CPU time while the VM runs. Every tick records the IP and
+	up to SAMPLE_DEPTH_MAX of the innermost return addresses into a
+	buffer allocated up front, since the handler cannot allocate; once
+	it is full the remaining ticks are only counted. Nothing is added
+	to the dispatch loop, the handler reads the op cursor and the call
+	stack as they are, which also means a compiled block is charged to
+	its first instruction.
+
+	On exit the samples are written as folded stacks, one
+	"frame;frame;...;leaf count" line per distinct stack, which is what
+	flame graph tools take. Each frame is named after the nearest label
+	at or before its address, from the symbol map tasm writes with -m
+	(--symbols FILE, or the program's name with a .map extension), and
+	is the raw address when there is none.
+*/
+#define SAMPLE_HZ		997
+#define SAMPLE_DEPTH_MAX	(size_t) 0x80
+#define SAMPLE_BUFFER_SIZE	(size_t) 0x400000
+#define SAMPLE_NAME_SIZE	0x20
+
+struct symbol {
+	x8000_address_t address;
+	char* name;
+};
+
+void initSample( struct x8000_vm* vm );
+void freeSample( struct x8000_vm* vm );
+void sampleStart( struct x8000_vm* vm );
+void sampleStop( struct x8000_vm* vm );
+void sampleSignal( int sig );
+bool sampleWrite( struct x8000_vm* vm, FILE* file );
+int sampleCompare( const void* a, const void* b );
+bool loadSymbols( struct x8000_vm* vm, const char* path );
+const char* symbolOf( struct x8000_vm* vm, x8000_address_t address, char* buff );
+int symbolCompare( const void* a, const void* b );
+const char* symbolsSidecar( const char* program, char* buff, size_t size );
+
+// The VM whose samples SIGPROF takes on this thread
+_Thread_local struct x8000_vm* sampleVm = NULL;
+// ==================== Sample Define ====================
+
+// ==================== Trace Define ====================
+/*
+	Execution trace
+
+	--trace FILE records where control went rather than what every
+	instruction did, so it can stay on: fusion and the JIT keep running
+	and nothing is added to the dispatch of a straight line op. The
+	trace is written to FILE when the program fails (a bad instruction,
+	a failed syscall or a guest memory fault) or when the process gets
+	SIGUSR1, and can be read back with xtrace.
+
+	traceRing holds the last TRACE_ENTRIES taken transfers:
+
+	- A taken JMP/JE/JNE/JNZ/CALL stores the address right after it and
+	  how many more times it was taken in a row, a loop running a
+	  million times is still one entry. The count saturates and then
+	  starts a new entry.
+	- A RET stores TRACE_RET the same way, so a run of returns is one
+	  entry. Where each one went is not stored: only CALL pushes on the
+	  call stack, so xtrace finds it from the CALLs walked before it.
+	- A write to IP stores TRACE_JUMP | the target and the address right
+	  after it.
+
+	Every INT adds RK, RP1-RP3 and RR1 to traceSyscalls, a second ring of
+	TRACE_SYSCALLS records, along with the number of entries before it
+	and the repeat count of the last one, which tell xtrace the pass of
+	a loop it was made in. A syscall does not end a run. The interpreter
+	writes entries where it counts jitHits and compiled blocks write
+	them in native code on their taken exits and RETs, a fall-through or
+	an early stop writes nothing. When tracing is off only a check on
+	traceRing is left in the ops that transfer control and in INT.
+
+	The dump adds the registers and the program image, xtrace walks the
+	program from each entry's target to the next one to list every
+	instruction that ran. Register values are only known at an INT and
+	when the dump is taken; on SIGUSR1 a compiled block may still hold
+	newer ones. An entry only counts once it is complete, so the SIGUSR1
+	handler can dump at any point, and addresses must fit below
+	TRACE_RET.
+
+	traceVm is set on the thread running the traced VM, async workers
+	block SIGUSR1 so the kernel hands it to that thread.
+*/
+#define TRACE_MAGIC		"X8000TRC"
+#define TRACE_VERSION		2
+#define TRACE_ENTRIES		(size_t) 0x80000
+#define TRACE_SYSCALLS		(size_t) 0x4000
+#define TRACE_JUMP		(uint32_t) 0x80000000
+#define TRACE_RET		(uint32_t) 0x40000000
+#define TRACE_LAST_NONE		UINT64_MAX
+
+#define TRACE_REASON_FAULT	(uint32_t) 0x1
+#define TRACE_REASON_SIGNAL	(uint32_t) 0x2
+
+struct traceHeader {
+	char magic[ 8 ];
+	uint32_t version;
+	uint32_t reason;
+	uint64_t instructionCount;
+	uint64_t entriesCount;
+	uint64_t entries;
+	uint64_t syscalls;
+	uint64_t programSize;
+	uint64_t start;
+	uint64_t ip;
+	int64_t regs[ REGISTERS_COUNT ];
+};
+
+struct traceEntry {
+	uint32_t address;
+	uint32_t value;
+};
+
+struct traceSyscall {
+	uint64_t entries;
+	uint32_t ip;
+	uint32_t repeat;
+	int64_t rk;
+	int64_t rp1;
+	int64_t rp2;
+	int64_t rp3;
+	int64_t rr1;
+};
+
+void initTrace( struct x8000_vm* vm );
+void freeTrace( struct x8000_vm* vm );
+void traceStart( struct x8000_vm* vm );
+void traceStop( struct x8000_vm* vm );
+void traceBranch( struct x8000_vm* vm, x8000_address_t end );
+void traceJump( struct x8000_vm* vm, x8000_address_t end, x8000_address_t target );
+void traceAdd( struct x8000_vm* vm, uint32_t address, uint32_t value );
+void traceSyscall( struct x8000_vm* vm, struct x8000_op* op );
+void traceFault( struct x8000_vm* vm );
+void traceSignal( int sig );
+bool traceDump( struct x8000_vm* vm, uint32_t reason );
+
+// The VM SIGUSR1 dumps on this thread
+_Thread_local struct x8000_vm* traceVm = NULL;
+// ==================== Trace Define ====================
+
 // ==================== Syscall Define ====================
 #define SYSCALL_STATUS_SUCCESS (ubyte_t) 0x00
 #define SYSCALL_STATUS_FAILURE (ubyte_t) 0x01
 
 #define SYSCALL_CODE_WRITE	(ubyte_t) 0x01
 #define SYSCALL_CODE_READ	(ubyte_t) 0x02
+#define SYSCALL_CODE_FLUSH	(ubyte_t) 0x03
+#define SYSCALL_CODE_WRITEV	(ubyte_t) 0x04
+#define SYSCALL_CODE_READV	(ubyte_t) 0x05
+#define SYSCALL_CODE_SUBMIT_READ	(ubyte_t) 0x06
+#define SYSCALL_CODE_SUBMIT_WRITE	(ubyte_t) 0x07
+#define SYSCALL_CODE_POLL	(ubyte_t) 0x08
+#define SYSCALL_CODE_WAIT	(ubyte_t) 0x09
+
+/*
+	WRITEV/READV take a guest array of SYSCALL_IOV_SIZE byte entries,
+	each an 8 byte address followed by an 8 byte length, at most
+	SYSCALL_IOV_MAX entries (the Linux IOV_MAX) per call.
+*/
+#define SYSCALL_IOV_SIZE	(size_t) 0x10
+#define SYSCALL_IOV_MAX		0x400
 #define SYSCALL_CODE_EXIT	(ubyte_t) 0x0A
+#define SYSCALL_CODE_SNAPSHOT	(ubyte_t) 0x0B
 #define SYSCALL_CODE_MALLOC	(ubyte_t) 0x61
 #define SYSCALL_CODE_REALLOC	(ubyte_t) 0x62
 #define SYSCALL_CODE_FREE	(ubyte_t) 0x63
 #define SYSCALL_CODE_WBUFF	(ubyte_t) 0x64
+#define SYSCALL_CODE_MEMCPY	(ubyte_t) 0x71
+#define SYSCALL_CODE_MEMMOVE	(ubyte_t) 0x72
+#define SYSCALL_CODE_MEMSET	(ubyte_t) 0x73
+#define SYSCALL_CODE_MEMCMP	(ubyte_t) 0x74
+#define SYSCALL_CODE_MEMCHR	(ubyte_t) 0x75
 
 #define FILE_DESCRIPTOR_STDOUT	(ubyte_t) 0x01
 #define FILE_DESCRIPTOR_STDERR	(ubyte_t) 0x02
 #define FILE_DESCRIPTOR_STDIN	(ubyte_t) 0x03
 
-ubyte_t syscall(
-	register_t rk,
-	register_t rp1,
-	register_t rp2,
-	register_t rp3,
-	register_t rp4,
-	register_t rp5,
-	register_t rp6,
-	register_t rp7,
-	register_t rp8
+ubyte_t x8000_syscall(
+	struct x8000_vm* vm,
+	x8000_register_t rk,
+	x8000_register_t rp1,
+	x8000_register_t rp2,
+	x8000_register_t rp3,
+	x8000_register_t rp4,
+	x8000_register_t rp5,
+	x8000_register_t rp6,
+	x8000_register_t rp7,
+	x8000_register_t rp8
 );
-ubyte_t syscall_write( register_t file_descriptor, x8000_address_t buff, size_t buff_size );
-ubyte_t syscall_read( register_t file_descriptor, x8000_address_t buff, size_t buff_size );
-ubyte_t syscall_exit( register_t status );
-x8000_address_t syscall_malloc( size_t buff_size );
-x8000_address_t syscall_realloc( x8000_address_t address, size_t new_size );
-ubyte_t syscall_free( x8000_address_t address );
-ubyte_t syscall_wbuff( x8000_address_t address, char ch );
+ubyte_t syscall_write( struct x8000_vm* vm, x8000_register_t file_descriptor, x8000_address_t buff, size_t buff_size );
+ubyte_t syscall_read( struct x8000_vm* vm, x8000_register_t file_descriptor, x8000_address_t buff, size_t buff_size );
+ubyte_t syscall_flush( struct x8000_vm* vm, x8000_register_t file_descriptor );
+ubyte_t syscall_writev( struct x8000_vm* vm, x8000_register_t file_descriptor, x8000_address_t iov, size_t iov_count );
+ubyte_t syscall_readv( struct x8000_vm* vm, x8000_register_t file_descriptor, x8000_address_t iov, size_t iov_count );
+ubyte_t syscall_submit( struct x8000_vm* vm, bool write, x8000_register_t file_descriptor, x8000_address_t buff, size_t buff_size );
+ubyte_t syscall_poll( struct x8000_vm* vm, x8000_register_t ticket );
+ubyte_t syscall_wait( struct x8000_vm* vm, x8000_register_t ticket );
+bool guestIovec( struct x8000_vm* vm, x8000_address_t iov, size_t iov_count, struct iovec* vec, size_t* total );
+ubyte_t syscall_exit( struct x8000_vm* vm, x8000_register_t status );
+ubyte_t syscall_snapshot( struct x8000_vm* vm, x8000_address_t path, size_t path_size );
+x8000_address_t syscall_malloc( struct x8000_vm* vm, size_t buff_size );
+x8000_address_t syscall_realloc( struct x8000_vm* vm, x8000_address_t address, size_t new_size );
+ubyte_t syscall_free( struct x8000_vm* vm, x8000_address_t address );
+ubyte_t syscall_wbuff( struct x8000_vm* vm, x8000_address_t address, char ch );
+ubyte_t syscall_memcpy( struct x8000_vm* vm, x8000_address_t dst, x8000_address_t src, size_t size );
+ubyte_t syscall_memmove( struct x8000_vm* vm, x8000_address_t dst, x8000_address_t src, size_t size );
+ubyte_t syscall_memset( struct x8000_vm* vm, x8000_address_t dst, char ch, size_t size );
+ubyte_t syscall_memcmp( struct x8000_vm* vm, x8000_address_t buff1, x8000_address_t buff2, size_t size );
+ubyte_t syscall_memchr( struct x8000_vm* vm, x8000_address_t buff, char ch, size_t size );
 // ==================== Syscall Define ====================
 
 // ==================== X8000 Define ====================
-void x8000_init( ubyte_t* _program );
-void x8000_free();
+/*
+	Virtual machine
+
+	Everything one running program owns lives in an x8000_vm, and every
+	handler, syscall and allocator takes the VM it works on, so any
+	number of them can run side by side on their own threads. The only
+	process-wide pieces are the read-only handler/dispatch tables and
+	the SIGSEGV/SIGBUS handler, which finds the faulting VM through the
+	thread that is running it.
+
+	A VM is loaded with loadProgram, started with x8000_init from a set
+	of x8000_options, driven with x8000_run and torn down by x8000_free.
+	x8000_restore loads and starts one from a snapshot instead.
+*/
+struct x8000_options {
+	size_t stackDepth;
+	size_t memoryLimit;
+	size_t stdoutBuffer;
+	size_t stderrBuffer;
+	bool sandbox;
+	bool heapStats;
+	bool ioUring;
+	int inputFd;
+	int outputFd;
+	int errorFd;
+	const char* forkServer;
+	bool forkAtSnapshot;
+	bool profile;
+	const char* profileJson;
+	const char* sample;
+	const char* symbols;
+	const char* trace;
+};
+
+#define X8000_OPTIONS_DEFAULT { \
+	STACK_DEPTH_DEFAULT, MEMORY_LIMIT_DEFAULT, OUTPUT_BUFFER_DEFAULT, OUTPUT_BUFFER_DEFAULT, \
+	false, false, true, STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, NULL, false, false, NULL, NULL, NULL, NULL \
+}
+
+struct x8000_vm {
+	// Program
+	ubyte_t* program;
+	size_t programSize;
+	size_t programMapSize;
+	bool programShared;
+	bool programStatus;
+	long long exitCode;
+	uint64_t instructionCount;
+
+	// Registers
+	struct RegistersStruct registers;
+	x8000_address_t* stackPointer;
+	size_t stackPointerSize;
+	size_t stackPointerCapacity;
+
+	// Decoder
+	struct x8000_op* ops;
+	size_t opsSize;
+	size_t opCursor;
+	size_t* ipMap;
+
+	// JIT
+	bool jitEnabled;
+	ubyte_t* jitCode;
+	size_t jitCodeSize;
+	size_t jitLeave;
+	x8000_jit_enter_t jitEnter;
+	ubyte_t** jitBlocks;
+	unsigned int* jitHits;
+	struct jitPatch* jitPatches;
+
+	// Memory
+	bool memorySandbox;
+	ubyte_t* memoryBase;
+	uintptr_t memoryMask;
+	size_t memoryLimit;
+	size_t memoryTop;
+	struct memoryRange* memoryRanges;
+	size_t memoryRangesCount;
+	size_t memoryRangesCapacity;
+	sigjmp_buf memoryFaultJump;
+	uintptr_t memoryFaultAddress;
+
+	// Heap
+	struct heapClass heapClasses[ HEAP_CLASSES_COUNT ];
+	struct heapBlock** heapTable;
+	size_t heapTableSize;
+	size_t heapBlocks;
+	size_t heapLargeAllocs;
+	size_t heapLargeFrees;
+	bool heapStats;
+
+	// Output
+	int inputFd;
+	struct outputBuffer outputStdout;
+	struct outputBuffer outputStderr;
+
+	// Async
+	struct asyncSlot asyncSlots[ ASYNC_SLOTS_COUNT ];
+	ubyte_t asyncBackend;
+	bool asyncUring;
+
+#ifdef X8000_IO_URING
+	int uringFd;
+	void* uringSqRing;
+	void* uringCqRing;
+	size_t uringSqRingSize;
+	size_t uringCqRingSize;
+	struct io_uring_sqe* uringSqes;
+	size_t uringSqesSize;
+	unsigned* uringSqHead;
+	unsigned* uringSqTail;
+	unsigned* uringSqMask;
+	unsigned* uringSqArray;
+	unsigned* uringCqHead;
+	unsigned* uringCqTail;
+	unsigned* uringCqMask;
+	struct io_uring_cqe* uringCqes;
+#endif
+
+	pthread_t asyncThreads[ ASYNC_THREADS_COUNT ];
+	size_t asyncThreadsCount;
+	pthread_mutex_t asyncLock;
+	pthread_cond_t asyncWork;
+	pthread_cond_t asyncDone;
+	struct asyncSlot* asyncQueue;
+	struct asyncSlot* asyncQueueTail;
+
+	// Fork server
+	const char* forkServer;
+	bool forkAtSnapshot;
+	struct forkResult* forkResult;
+
+	// Profile
+	bool profile;
+	const char* profileJsonPath;
+
+#ifdef X8000_PROFILE
+	struct profileCounter* profileOps;
+	struct profileCounter profileSyscalls[ PROFILE_SYSCALLS_COUNT ];
+	struct x8000_op* profileLast;
+	uint64_t profileTime;
+#endif
+
+	// Sample
+	const char* samplePath;
+	const char* symbolsPath;
+	uint64_t* samples;
+	size_t samplesSize;
+	size_t samplesDropped;
+	struct symbol* symbols;
+	size_t symbolsCount;
+
+	// Trace
+	const char* tracePath;
+	struct traceEntry* traceRing;
+	struct traceEntry* traceEntry;
+	uint64_t traceCount;
+	uint64_t traceLast;
+	struct traceSyscall* traceSyscalls;
+	uint64_t traceSyscallsCount;
+	x8000_address_t traceStartIP;
+};
+
+void x8000_init( struct x8000_vm* vm, const struct x8000_options* options );
+bool x8000_restore( struct x8000_vm* vm, const char* path, const struct x8000_options* options );
+void x8000_run( struct x8000_vm* vm );
+void x8000_free( struct x8000_vm* vm );
 // ==================== X8000 Define ====================
 
+// ==================== Batch Define ====================
+/*
+	Batch mode
+
+	x8000 --batch jobs.txt -j N runs every job of the list inside this
+	process instead of one process per job. Each line of the list is
+
+		program [input [output]]
+
+	and runs program with input as its STDIN and output (truncated) as
+	its STDOUT; a missing or "-" input/output is /dev/null. Blank lines
+	and lines starting with # are skipped. Every distinct program is
+	loaded once and shared by all of its jobs.
+
+	Jobs are dealt round-robin to one queue per worker. A worker takes
+	its own jobs from the front and, once it runs dry, steals from the
+	back of the other queues, so a few long jobs do not hold the rest
+	back. When every queue is empty the batch is done and a line per
+	job with its exit code and wall time is printed to STDOUT.
+*/
+#define BATCH_LINE_SEPARATORS	" \t\r\n"
+
+struct batchProgram {
+	char* path;
+	ubyte_t* data;
+	size_t size;
+	size_t mapSize;
+	bool loaded;
+	struct batchProgram* next;
+};
+
+struct batchJob {
+	struct batchProgram* program;
+	char* input;
+	char* output;
+	bool started;
+	long long exitCode;
+	double time;
+};
+
+struct batchQueue {
+	pthread_mutex_t lock;
+	size_t* jobs;
+	size_t head;
+	size_t tail;
+};
+
+struct batchProgram* batchPrograms = NULL;
+struct batchJob* batchJobs = NULL;
+size_t batchJobsCount = 0;
+struct batchQueue* batchQueues = NULL;
+size_t batchQueuesCount = 0;
+struct x8000_options batchOptions;
+
+int x8000_batch( const char* path, size_t workers, const struct x8000_options* options );
+bool batchLoad( const char* path );
+struct batchProgram* batchProgramOf( const char* path );
+void batchFree();
+void* batchWorker( void* arg );
+bool batchNext( size_t self, size_t* job );
+void batchRun( struct x8000_vm* vm, struct batchJob* job );
+void batchReport();
+// ==================== Batch Define ====================
+
 // ==================== Registers ====================
-void initRegisters() {
-	resetRegisters();
-
-	stackPointer = (x8000_address_t*)malloc( stackPointerSize );
-}
-
-void freeRegisters() {
-	if ( stackPointer != NULL ) free( stackPointer );
-}
-
-void resetRegisters() {
-	registers.IP = (register_t)-0x1;
-	registers.RK = (register_t)0x0;
-	registers.RC = (register_t)0x0;
-	registers.SP = (register_t)0x0;
-	registers.R1 = (register_t)0x0;
-	registers.R2 = (register_t)0x0;
-	registers.R3 = (register_t)0x0;
-	registers.R4 = (register_t)0x0;
-	registers.R5 = (register_t)0x0;
-	registers.R6 = (register_t)0x0;
-	registers.R7 = (register_t)0x0;
-	registers.R8 = (register_t)0x0;
-	registers.RP1 = (register_t)0x0;
-	registers.RP2 = (register_t)0x0;
-	registers.RP3 = (register_t)0x0;
-	registers.RP4 = (register_t)0x0;
-	registers.RP5 = (register_t)0x0;
-	registers.RP6 = (register_t)0x0;
-	registers.RP7 = (register_t)0x0;
-	registers.RP8 = (register_t)0x0;
-	registers.RR1 = (register_t)0x0;
-	registers.RR2 = (register_t)0x0;
-	registers.RR3 = (register_t)0x0;
-	registers.RR4 = (register_t)0x0;
-	registers.RR5 = (register_t)0x0;
-	registers.RR6 = (register_t)0x0;
-	registers.RR7 = (register_t)0x0;
-	registers.RR8 = (register_t)0x0;
+void initRegisters( struct x8000_vm* vm ) {
+	resetRegisters( vm );
+
+	vm->stackPointerSize = 0;
+	vm->stackPointer = (x8000_address_t*)malloc( vm->stackPointerCapacity * sizeof( x8000_address_t ) );
+
+	if ( vm->stackPointer == NULL ) {
+		vm->stackPointerCapacity = 0;
+	}
+}
+
+void freeRegisters( struct x8000_vm* vm ) {
+	if ( vm->stackPointer != NULL ) free( vm->stackPointer );
+}
+
+void resetRegisters( struct x8000_vm* vm ) {
+	for ( int i = 0; i < REGISTERS_COUNT; i++ ) {
+		vm->registers.regs[ i ] = (x8000_register_t)0x0;
+	}
+
+	vm->registers.IP = (x8000_register_t)-0x1;
+	restoreFlags( vm );
+}
+
+void materializeFlags( struct x8000_vm* vm ) {
+	if ( vm->registers.flagsLazy == 0 ) {
+		return;
+	}
+
+	vm->registers.RC = (x8000_register_t)0x0;
+
+	if ( vm->registers.flagsLeft == vm->registers.flagsRight ) vm->registers.RC |= CMP_FLAG_EQ;
+	if ( vm->registers.flagsLeft != 0 ) vm->registers.RC |= CMP_FLAG_NJ;
+
+	vm->registers.flagsLazy = 0;
+}
+
+void restoreFlags( struct x8000_vm* vm ) {
+	// ( 1, 1 ) EQ | NJ, ( 0, 0 ) EQ, ( 1, 0 ) NJ, ( 0, 1 ) neither
+	vm->registers.flagsLeft = ( vm->registers.RC & CMP_FLAG_NJ ) ? 1 : 0;
+	vm->registers.flagsRight = ( vm->registers.RC & CMP_FLAG_EQ ) ? vm->registers.flagsLeft : !vm->registers.flagsLeft;
+	vm->registers.flagsLazy = 0;
 }
 
 bool isValidRegister( ubyte_t reg ) {
@@ -264,967 +1385,5470 @@ bool isValidRegister( ubyte_t reg ) {
 	return false;
 }
 
-void setRegister( ubyte_t reg, register_t val ) {
-	switch ( reg ) {
-	case REGISTER_IP:
-		registers.IP = val;
-		break;
-	case REGISTER_RK:
-		registers.RK = val;
-		break;
-	case REGISTER_RC:
-		registers.RC = val;
-		break;
-	case REGISTER_SP:
-		registers.SP = val;
-		break;
-	case REGISTER_R1:
-		registers.R1 = val;
-		break;
-	case REGISTER_R2:
-		registers.R2 = val;
-		break;
-	case REGISTER_R3:
-		registers.R3 = val;
-		break;
-	case REGISTER_R4:
-		registers.R4 = val;
-		break;
-	case REGISTER_R5:
-		registers.R5 = val;
-		break;
-	case REGISTER_R6:
-		registers.R6 = val;
-		break;
-	case REGISTER_R7:
-		registers.R7 = val;
-		break;
-	case REGISTER_R8:
-		registers.R8 = val;
-		break;
-	case REGISTER_RP1:
-		registers.RP1 = val;
-		break;
-	case REGISTER_RP2:
-		registers.RP2 = val;
-		break;
-	case REGISTER_RP3:
-		registers.RP3 = val;
-		break;
-	case REGISTER_RP4:
-		registers.RP4 = val;
-		break;
-	case REGISTER_RP5:
-		registers.RP5 = val;
-		break;
-	case REGISTER_RP6:
-		registers.RP6 = val;
-		break;
-	case REGISTER_RP7:
-		registers.RP7 = val;
-		break;
-	case REGISTER_RP8:
-		registers.RP8 = val;
-		break;
-	case REGISTER_RR1:
-		registers.RR1 = val;
-		break;
-	case REGISTER_RR2:
-		registers.RR2 = val;
-		break;
-	case REGISTER_RR3:
-		registers.RR3 = val;
-		break;
-	case REGISTER_RR4:
-		registers.RR4 = val;
-		break;
-	case REGISTER_RR5:
-		registers.RR5 = val;
-		break;
-	case REGISTER_RR6:
-		registers.RR6 = val;
-		break;
-	case REGISTER_RR7:
-		registers.RR7 = val;
-		break;
-	case REGISTER_RR8:
-		registers.RR8 = val;
-		break;
-	}
-}
-
-register_t getRegister( ubyte_t reg ) {
-	switch ( reg ) {
-	case REGISTER_IP:
-		return registers.IP;
-	case REGISTER_RK:
-		return registers.RK;
-	case REGISTER_RC:
-		return registers.RC;
-	case REGISTER_SP:
-		return registers.SP;
-	case REGISTER_R1:
-		return registers.R1;
-	case REGISTER_R2:
-		return registers.R2;
-	case REGISTER_R3:
-		return registers.R3;
-	case REGISTER_R4:
-		return registers.R4;
-	case REGISTER_R5:
-		return registers.R5;
-	case REGISTER_R6:
-		return registers.R6;
-	case REGISTER_R7:
-		return registers.R7;
-	case REGISTER_R8:
-		return registers.R8;
-	case REGISTER_RP1:
-		return registers.RP1;
-	case REGISTER_RP2:
-		return registers.RP2;
-	case REGISTER_RP3:
-		return registers.RP3;
-	case REGISTER_RP4:
-		return registers.RP4;
-	case REGISTER_RP5:
-		return registers.RP5;
-	case REGISTER_RP6:
-		return registers.RP6;
-	case REGISTER_RP7:
-		return registers.RP7;
-	case REGISTER_RP8:
-		return registers.RP8;
-	case REGISTER_RR1:
-		return registers.RR1;
-	case REGISTER_RR2:
-		return registers.RR2;
-	case REGISTER_RR3:
-		return registers.RR3;
-	case REGISTER_RR4:
-		return registers.RR4;
-	case REGISTER_RR5:
-		return registers.RR5;
-	case REGISTER_RR6:
-		return registers.RR6;
-	case REGISTER_RR7:
-		return registers.RR7;
-	case REGISTER_RR8:
-		return registers.RR8;
-	default:
-		return NULL_REG;
+bool pushSP( struct x8000_vm* vm, x8000_address_t address ) {
+	if ( vm->stackPointerSize >= vm->stackPointerCapacity ) {
+		fprintf( stderr, "Error: Call stack overflow (depth %zu).\n", vm->stackPointerCapacity );
+		return false;
 	}
-}
 
-void pushSP( x8000_address_t address ) {
-	stackPointer = (x8000_address_t*)malloc( ++stackPointerSize );
-	stackPointer[ stackPointerSize - 1 ] = address;
+	vm->stackPointer[ vm->stackPointerSize++ ] = address;
+	vm->registers.SP = (x8000_register_t)vm->stackPointerSize;
+
+	return true;
 }
 
-x8000_address_t popSP() {
-	if ( stackPointer == 0 ) {
+x8000_address_t popSP( struct x8000_vm* vm ) {
+	if ( vm->stackPointerSize == 0 ) {
+		fprintf( stderr, "Error: Call stack underflow.\n" );
 		return NULL_SP;
 	}
 
-	x8000_address_t address = stackPointer[ --stackPointerSize ];
-	stackPointer = (x8000_address_t*)malloc( stackPointerSize );
+	x8000_address_t address = vm->stackPointer[ --vm->stackPointerSize ];
+	vm->registers.SP = (x8000_register_t)vm->stackPointerSize;
 
 	return address;
 }
-
-ubyte_t instructionPeek() {
-	return program[ registers.IP ];
-}
-
-ubyte_t instructionNext() {
-	registers.IP++;
-	return instructionPeek();
-}
 // ==================== Registers ====================
 
 // ==================== Instruction ====================
 ubyte_t handleInstruction( ubyte_t ins ) {
 	switch ( ins ) {
 	case X8000_MOV_R:
+		return X8000_OP_MOV_R;
 	case X8000_MOV_8:
 	case X8000_MOV_16:
 	case X8000_MOV_32:
 	case X8000_MOV_64:
-		return x8000_mov();
+		return X8000_OP_MOV;
 	case X8000_CMP_R:
+		return X8000_OP_CMP_R;
 	case X8000_CMP_8:
 	case X8000_CMP_16:
 	case X8000_CMP_32:
 	case X8000_CMP_64:
-		return x8000_cmp();
+		return X8000_OP_CMP;
 	case X8000_JMP:
-		return x8000_jmp();
+		return X8000_OP_JMP;
 	case X8000_JE:
-		return x8000_je();
+		return X8000_OP_JE;
 	case X8000_JNE:
-		return x8000_jne();
+		return X8000_OP_JNE;
 	case X8000_JNZ:
-		return x8000_jnz();
+		return X8000_OP_JNZ;
 	case X8000_CALL:
-		return x8000_call();
+		return X8000_OP_CALL;
 	case X8000_RET:
-		return x8000_ret();
+		return X8000_OP_RET;
 	case X8000_INC:
-		return x8000_inc();
+		return X8000_OP_INC;
 	case X8000_DEC:
-		return x8000_dec();
+		return X8000_OP_DEC;
 	case X8000_ADD_R:
+		return X8000_OP_ADD_R;
 	case X8000_ADD_8:
 	case X8000_ADD_16:
 	case X8000_ADD_32:
 	case X8000_ADD_64:
-		return x8000_add();
+		return X8000_OP_ADD;
 	case X8000_SUB_R:
+		return X8000_OP_SUB_R;
 	case X8000_SUB_8:
 	case X8000_SUB_16:
 	case X8000_SUB_32:
 	case X8000_SUB_64:
-		return x8000_sub();
+		return X8000_OP_SUB;
 	case X8000_MUL_R:
+		return X8000_OP_MUL_R;
 	case X8000_MUL_8:
 	case X8000_MUL_16:
 	case X8000_MUL_32:
 	case X8000_MUL_64:
-		return x8000_mul();
+		return X8000_OP_MUL;
 	case X8000_DIV_R:
+		return X8000_OP_DIV_R;
 	case X8000_DIV_8:
 	case X8000_DIV_16:
 	case X8000_DIV_32:
 	case X8000_DIV_64:
-		return x8000_div();
+		return X8000_OP_DIV;
 	case X8000_INT:
-		return x8000_int();
+		return X8000_OP_INT;
+	case X8000_LOAD_8:
+		return X8000_OP_LOAD_8;
+	case X8000_LOAD_16:
+		return X8000_OP_LOAD_16;
+	case X8000_LOAD_32:
+		return X8000_OP_LOAD_32;
+	case X8000_LOAD_64:
+		return X8000_OP_LOAD_64;
+	case X8000_STORE_8:
+		return X8000_OP_STORE_8;
+	case X8000_STORE_16:
+		return X8000_OP_STORE_16;
+	case X8000_STORE_32:
+		return X8000_OP_STORE_32;
+	case X8000_STORE_64:
+		return X8000_OP_STORE_64;
 	default:
-		return INSTRUCTION_STATUS_FAILURE;
+		return X8000_OP_BAD;
 	}
 }
 
-ubyte_t x8000_mov() {
-	// MOV RK, 0xFF
+ubyte_t x8000_bad( struct x8000_vm* vm, struct x8000_op* op ) {
+	// Running off the end of the program, verifyProgram rejects everything else
+	return INSTRUCTION_STATUS_FAILURE;
+}
 
-	ubyte_t mode = instructionPeek();
-	ubyte_t reg = instructionNext();
+ubyte_t x8000_ip( struct x8000_vm* vm, struct x8000_op* op ) {
+	// MOV R1, IP / MOV IP, R1
 
-	if ( isValidRegister( reg ) == false ) {
-		return INSTRUCTION_STATUS_FAILURE;
-	}
+	/*
+		IP is only materialized for the few instructions that use it as
+		an operand. It holds the address of the last byte of the current
+		instruction, so writing it continues execution at IP + 1.
+	*/
+	vm->registers.IP = (x8000_register_t)( op->nextIP - 1 );
 
-	if ( mode == X8000_MOV_R ) {
-		ubyte_t vreg = instructionNext();
-		if ( isValidRegister( vreg ) == false ) {
+	// MOV IP, RC also reads RC
+	ubyte_t res = x8000_rc( vm, op );
+
+	if ( res == INSTRUCTION_STATUS_SUCCESS && op->dst == REGISTER_INDEX( REGISTER_IP ) ) {
+		size_t index = lookupOp( vm, (x8000_address_t)( vm->registers.IP + 1 ) );
+
+		if ( index == OP_INDEX_NONE ) {
 			return INSTRUCTION_STATUS_FAILURE;
 		}
-		setRegister( reg, getRegister( vreg ) );
-		return INSTRUCTION_STATUS_SUCCESS;
+
+		vm->opCursor = index;
+		if ( vm->traceRing != NULL ) traceJump( vm, op->nextIP, (x8000_address_t)( vm->registers.IP + 1 ) );
 	}
 
-	union buffUnion {
-		ubyte_t bt[ 8 ];
-		register_t reg;
-	};
+	return res;
+}
 
-	union buffUnion buffVal;
-	buffVal.reg = 0;
-
-	if ( mode == X8000_MOV_8 ) {
-		buffVal.bt[ 0 ] = instructionNext();
-		setRegister( reg, buffVal.reg );
-	}else if ( mode == X8000_MOV_16 ) {
-		buffVal.bt[ 0 ] = instructionNext();
-		buffVal.bt[ 1 ] = instructionNext();
-		setRegister( reg, buffVal.reg );
-	}else if ( mode == X8000_MOV_32 ) {
-		buffVal.bt[ 0 ] = instructionNext();
-		buffVal.bt[ 1 ] = instructionNext();
-		buffVal.bt[ 2 ] = instructionNext();
-		buffVal.bt[ 3 ] = instructionNext();
-		setRegister( reg, buffVal.reg );
-	}else if ( mode == X8000_MOV_64 ) {
-		buffVal.bt[ 0 ] = instructionNext();
-		buffVal.bt[ 1 ] = instructionNext();
-		buffVal.bt[ 2 ] = instructionNext();
-		buffVal.bt[ 3 ] = instructionNext();
-		buffVal.bt[ 4 ] = instructionNext();
-		buffVal.bt[ 5 ] = instructionNext();
-		buffVal.bt[ 6 ] = instructionNext();
-		buffVal.bt[ 7 ] = instructionNext();
-		setRegister( reg, buffVal.reg );
-	}else {
-		return INSTRUCTION_STATUS_FAILURE;
-	}
+ubyte_t x8000_mov_r( struct x8000_vm* vm, struct x8000_op* op ) {
+	// MOV RK, R1
+
+	vm->registers.regs[ op->dst ] = vm->registers.regs[ op->src ];
 
 	return INSTRUCTION_STATUS_SUCCESS;
 }
 
-ubyte_t x8000_cmp() {
-	// CMP RK, 0xFF
+ubyte_t x8000_mov( struct x8000_vm* vm, struct x8000_op* op ) {
+	// MOV RK, 0xFF
 
-	ubyte_t mode = instructionPeek();
-	ubyte_t reg = instructionNext();
+	vm->registers.regs[ op->dst ] = op->imm;
 
-	if ( isValidRegister( reg ) == false ) {
-		return INSTRUCTION_STATUS_FAILURE;
-	}
+	return INSTRUCTION_STATUS_SUCCESS;
+}
 
-	registers.RC = (register_t)0x0;
-	register_t r1 = getRegister( reg );
-	register_t r2;
+ubyte_t x8000_cmp_r( struct x8000_vm* vm, struct x8000_op* op ) {
+	// CMP RK, R1
 
-	// Used for non-register value
-	union {
-		ubyte_t bt[ 8 ];
-		x8000_address_t value;
-	} buffUnion;
-	buffUnion.value = 0;
+	vm->registers.flagsLeft = vm->registers.regs[ op->dst ];
+	vm->registers.flagsRight = vm->registers.regs[ op->src ];
+	vm->registers.flagsLazy = 1;
 
-	if ( mode == X8000_CMP_R ) {
-		ubyte_t vreg = instructionNext();
+	return INSTRUCTION_STATUS_SUCCESS;
+}
 
-		if ( isValidRegister( vreg ) == false ) {
-			return INSTRUCTION_STATUS_FAILURE;
-		}
+ubyte_t x8000_cmp( struct x8000_vm* vm, struct x8000_op* op ) {
+	// CMP RK, 0xFF
 
-		r2 = getRegister( vreg );
-	}else if ( mode == X8000_CMP_8 ) {
-		buffUnion.bt[ 0 ] = instructionNext();
-		r2 = buffUnion.value;
-	}else if ( mode == X8000_CMP_16 ) {
-		buffUnion.bt[ 0 ] = instructionNext();
-		buffUnion.bt[ 1 ] = instructionNext();
-		r2 = buffUnion.value;
-	}else if ( mode == X8000_CMP_32 ) {
-		buffUnion.bt[ 0 ] = instructionNext();
-		buffUnion.bt[ 1 ] = instructionNext();
-		buffUnion.bt[ 2 ] = instructionNext();
-		buffUnion.bt[ 3 ] = instructionNext();
-		r2 = buffUnion.value;
-	}else if ( mode == X8000_CMP_64 ) {
-		buffUnion.bt[ 0 ] = instructionNext();
-		buffUnion.bt[ 1 ] = instructionNext();
-		buffUnion.bt[ 2 ] = instructionNext();
-		buffUnion.bt[ 3 ] = instructionNext();
-		buffUnion.bt[ 4 ] = instructionNext();
-		buffUnion.bt[ 5 ] = instructionNext();
-		buffUnion.bt[ 6 ] = instructionNext();
-		buffUnion.bt[ 7 ] = instructionNext();
-		r2 = buffUnion.value;
-	}
-
-	if ( r1 == r2 ) registers.RC |= CMP_FLAG_EQ;
-	if ( r1 != 0 ) registers.RC |= CMP_FLAG_NJ;
+	vm->registers.flagsLeft = vm->registers.regs[ op->dst ];
+	vm->registers.flagsRight = op->imm;
+	vm->registers.flagsLazy = 1;
 
 	return INSTRUCTION_STATUS_SUCCESS;
 }
 
-ubyte_t x8000_jmp() {
+ubyte_t x8000_jmp( struct x8000_vm* vm, struct x8000_op* op ) {
 	// JMP 0xFFFFFFFFFFFFFFFF
 
-	union {
-		ubyte_t bt[ 8 ];
-		x8000_address_t value;
-	} buff;
-	buff.value = 0;
-
-	for ( int i = 0; i < 8; i++ ) {
-		buff.bt[ i ] = instructionNext();
-	}
-
-	setRegister( REGISTER_IP, buff.value );
+	vm->opCursor = op->target;
+	jitCount( vm, vm->opCursor );
+	if ( vm->traceRing != NULL ) traceBranch( vm, op->nextIP );
 
 	return INSTRUCTION_STATUS_SUCCESS;
 }
 
-ubyte_t x8000_je() {
-	union {
-		ubyte_t bt[ 8 ];
-		x8000_address_t value;
-	} buffAddress;
-	buffAddress.value = 0;
-
-	for ( int i = 0; i < 8; i++ ) {
-		buffAddress.bt[ i ] = instructionNext();
+ubyte_t x8000_je( struct x8000_vm* vm, struct x8000_op* op ) {
+	if ( vm->registers.flagsLeft == vm->registers.flagsRight ) {
+		vm->opCursor = op->target;
+		jitCount( vm, vm->opCursor );
+		if ( vm->traceRing != NULL ) traceBranch( vm, op->nextIP );
 	}
 
-	register_t flag = registers.RC;
-
-	flag <<= 1;
-	flag >>= 7;
+	return INSTRUCTION_STATUS_SUCCESS;
+}
 
-	if ( flag ) {
-		registers.IP = buffAddress.value;
+ubyte_t x8000_jne( struct x8000_vm* vm, struct x8000_op* op ) {
+	if ( vm->registers.flagsLeft != vm->registers.flagsRight ) {
+		vm->opCursor = op->target;
+		jitCount( vm, vm->opCursor );
+		if ( vm->traceRing != NULL ) traceBranch( vm, op->nextIP );
 	}
 
 	return INSTRUCTION_STATUS_SUCCESS;
 }
 
-ubyte_t x8000_jne() {
-	union {
-		ubyte_t bt[ 8 ];
-		x8000_address_t value;
-	} buffAddress;
-	buffAddress.value = 0;
-
-	for ( int i = 0; i < 8; i++ ) {
-		buffAddress.bt[ i ] = instructionNext();
+ubyte_t x8000_jnz( struct x8000_vm* vm, struct x8000_op* op ) {
+	if ( vm->registers.flagsLeft != 0 ) {
+		vm->opCursor = op->target;
+		jitCount( vm, vm->opCursor );
+		if ( vm->traceRing != NULL ) traceBranch( vm, op->nextIP );
 	}
 
-	register_t flag = registers.RC;
+	return INSTRUCTION_STATUS_SUCCESS;
+}
 
-	flag <<= 1;
-	flag >>= 7;
+ubyte_t x8000_call( struct x8000_vm* vm, struct x8000_op* op ) {
+	// CALL 0xFFFFFFFFFFFFFFFF
 
-	if ( !flag ) {
-		registers.IP = buffAddress.value;
+	if ( pushSP( vm, op->nextIP ) == false ) {
+		return INSTRUCTION_STATUS_FAILURE;
 	}
 
+	vm->opCursor = op->target;
+	jitCount( vm, vm->opCursor );
+	if ( vm->traceRing != NULL ) traceBranch( vm, op->nextIP );
+
 	return INSTRUCTION_STATUS_SUCCESS;
 }
 
-ubyte_t x8000_jnz() {
-	union {
-		ubyte_t bt[ 8 ];
-		x8000_address_t value;
-	} buffAddress;
-	buffAddress.value = 0;
+ubyte_t x8000_ret( struct x8000_vm* vm, struct x8000_op* op ) {
+	x8000_address_t address = popSP( vm );
 
-	for ( int i = 0; i < 8; i++ ) {
-		buffAddress.bt[ i ] = instructionNext();
+	if ( address == NULL_ADDRESS ) {
+		return INSTRUCTION_STATUS_FAILURE;
 	}
 
-	register_t flag = registers.RC;
-
-	flag >>= 7;
+	size_t index = lookupOp( vm, address );
 
-	if ( flag ) {
-		registers.IP = buffAddress.value;
+	if ( index == OP_INDEX_NONE ) {
+		return INSTRUCTION_STATUS_FAILURE;
 	}
 
+	vm->opCursor = index;
+	jitCount( vm, vm->opCursor );
+	if ( vm->traceRing != NULL ) traceBranch( vm, TRACE_RET );
+
 	return INSTRUCTION_STATUS_SUCCESS;
 }
 
-ubyte_t x8000_call() {
-	// CALL 0xFFFFFFFFFFFFFFFF
-
-	union {
-		ubyte_t bt[ 8 ];
-		x8000_address_t value;
-	} buffAddress;
-	buffAddress.value = 0;
-
-	for ( int i = 0; i < 8; i++ ) {
-		buffAddress.bt[ i ] = instructionNext();
-	}
+ubyte_t x8000_inc( struct x8000_vm* vm, struct x8000_op* op ) {
+	// INC RK
 
-	pushSP( registers.IP );
-	registers.IP = buffAddress.value;
+	vm->registers.regs[ op->dst ] += 1;
 
 	return INSTRUCTION_STATUS_SUCCESS;
 }
 
-ubyte_t x8000_ret() {
-	x8000_address_t address = popSP();
-
-	if ( address == NULL_ADDRESS ) {
-		return INSTRUCTION_STATUS_FAILURE;
-	}
+ubyte_t x8000_dec( struct x8000_vm* vm, struct x8000_op* op ) {
+	// DEC RK
 
-	registers.IP = address;
+	vm->registers.regs[ op->dst ] -= 1;
 
 	return INSTRUCTION_STATUS_SUCCESS;
 }
 
-ubyte_t x8000_inc() {
-	// INC RK
+ubyte_t x8000_add_r( struct x8000_vm* vm, struct x8000_op* op ) {
+	// ADD RK, R1
 
-	ubyte_t reg = instructionNext();
+	vm->registers.regs[ op->dst ] += vm->registers.regs[ op->src ];
 
-	if ( isValidRegister( reg ) == false ) {
-		return INSTRUCTION_STATUS_FAILURE;
-	}
+	return INSTRUCTION_STATUS_SUCCESS;
+}
+
+ubyte_t x8000_add( struct x8000_vm* vm, struct x8000_op* op ) {
+	// ADD RK, 0xFF
 
-	setRegister( reg, getRegister( reg ) + 1 );
+	vm->registers.regs[ op->dst ] += op->imm;
 
 	return INSTRUCTION_STATUS_SUCCESS;
 }
 
-ubyte_t x8000_dec() {
-		// INC RK
+ubyte_t x8000_sub_r( struct x8000_vm* vm, struct x8000_op* op ) {
+	// SUB RK, R1
 
-	ubyte_t reg = instructionNext();
+	vm->registers.regs[ op->dst ] -= vm->registers.regs[ op->src ];
 
-	if ( isValidRegister( reg ) == false ) {
-		return INSTRUCTION_STATUS_FAILURE;
-	}
+	return INSTRUCTION_STATUS_SUCCESS;
+}
+
+ubyte_t x8000_sub( struct x8000_vm* vm, struct x8000_op* op ) {
+	// SUB RK, 0xFF
 
-	setRegister( reg, getRegister( reg ) - 1 );
+	vm->registers.regs[ op->dst ] -= op->imm;
 
 	return INSTRUCTION_STATUS_SUCCESS;
 }
 
-ubyte_t x8000_add() {
-	// ADD RK, 0xFF
+ubyte_t x8000_mul_r( struct x8000_vm* vm, struct x8000_op* op ) {
+	// MUL RK, R1
 
-	ubyte_t mode = instructionPeek();
-	ubyte_t reg = instructionNext();
+	vm->registers.regs[ op->dst ] *= vm->registers.regs[ op->src ];
 
-	if ( isValidRegister( reg ) == false ) {
-		return INSTRUCTION_STATUS_FAILURE;
-	}
+	return INSTRUCTION_STATUS_SUCCESS;
+}
 
-	register_t r1 = getRegister( reg );
-	register_t r2;
+ubyte_t x8000_mul( struct x8000_vm* vm, struct x8000_op* op ) {
+	// MUL RK, 0xFF
 
-	if ( mode == X8000_ADD_R ) {
-		ubyte_t vreg = instructionNext();
+	vm->registers.regs[ op->dst ] *= op->imm;
 
-		if ( isValidRegister( vreg ) == false ) {
-			return INSTRUCTION_STATUS_FAILURE;
-		}
+	return INSTRUCTION_STATUS_SUCCESS;
+}
+
+ubyte_t x8000_div_r( struct x8000_vm* vm, struct x8000_op* op ) {
+	// DIV RK, R1
 
-		r2 = getRegister( vreg );
-		setRegister( reg, ( r1 + r2 ) );
+	x8000_register_t r1 = vm->registers.regs[ op->dst ];
+	x8000_register_t r2 = vm->registers.regs[ op->src ];
 
-		return INSTRUCTION_STATUS_SUCCESS;
+	if ( r1 == 0 || r2 == 0 ) {
+		vm->registers.regs[ op->dst ] = 0;
+	}else if ( r2 == -1 ) {
+		// Negate instead, so that the minimum divided by -1 wraps to itself
+		vm->registers.regs[ op->dst ] = (x8000_register_t)( 0 - (uint64_t)r1 );
+	}else {
+		vm->registers.regs[ op->dst ] = ( r1 / r2 );
 	}
 
-	union {
-		ubyte_t bt[ 8 ];
-		register_t reg;
-	} buffUnion;
-	buffUnion.reg = 0;
+	return INSTRUCTION_STATUS_SUCCESS;
+}
+
+ubyte_t x8000_div( struct x8000_vm* vm, struct x8000_op* op ) {
+	// DIV RK, 0xFF
 
+	x8000_register_t r1 = vm->registers.regs[ op->dst ];
+	x8000_register_t r2 = op->imm;
 
-	if ( mode == X8000_ADD_8 ) {
-		buffUnion.bt[ 0 ] = instructionNext();
-		r2 = buffUnion.reg;
-	}else if ( mode == X8000_ADD_16 ) {
-		buffUnion.bt[ 0 ] = instructionNext();
-		buffUnion.bt[ 1 ] = instructionNext();
-		r2 = buffUnion.reg;
-	}else if ( mode == X8000_ADD_32 ) {
-		buffUnion.bt[ 0 ] = instructionNext();
-		buffUnion.bt[ 1 ] = instructionNext();
-		buffUnion.bt[ 2 ] = instructionNext();
-		buffUnion.bt[ 3 ] = instructionNext();
-		r2 = buffUnion.reg;
-	}else if ( mode == X8000_ADD_64 ) {
-		buffUnion.bt[ 0 ] = instructionNext();
-		buffUnion.bt[ 1 ] = instructionNext();
-		buffUnion.bt[ 2 ] = instructionNext();
-		buffUnion.bt[ 3 ] = instructionNext();
-		buffUnion.bt[ 4 ] = instructionNext();
-		buffUnion.bt[ 5 ] = instructionNext();
-		buffUnion.bt[ 6 ] = instructionNext();
-		buffUnion.bt[ 7 ] = instructionNext();
-		r2 = buffUnion.reg;
+	if ( r1 == 0 || r2 == 0 ) {
+		vm->registers.regs[ op->dst ] = 0;
+	}else if ( r2 == -1 ) {
+		// Negate instead, so that the minimum divided by -1 wraps to itself
+		vm->registers.regs[ op->dst ] = (x8000_register_t)( 0 - (uint64_t)r1 );
 	}else {
-		return INSTRUCTION_STATUS_FAILURE;
+		vm->registers.regs[ op->dst ] = ( r1 / r2 );
 	}
 
-	setRegister( reg, ( r1 + r2 ) );
-
 	return INSTRUCTION_STATUS_SUCCESS;
 }
 
-ubyte_t x8000_sub() {
-	// SUB RK, 0xFF
+ubyte_t x8000_int( struct x8000_vm* vm, struct x8000_op* op ) {
+	ubyte_t res;
+
+#ifdef X8000_PROFILE
+	if ( vm->profileOps != NULL ) {
+		res = profileSyscall( vm );
+	}else
+#endif
+	{
+		res = x8000_syscall(
+			vm,
+			vm->registers.RK,
+			vm->registers.RP1,
+			vm->registers.RP2,
+			vm->registers.RP3,
+			vm->registers.RP4,
+			vm->registers.RP5,
+			vm->registers.RP6,
+			vm->registers.RP7,
+			vm->registers.RP8
+		);
+	}
 
-	ubyte_t mode = instructionPeek();
-	ubyte_t reg = instructionNext();
+	if ( vm->traceRing != NULL ) traceSyscall( vm, op );
 
-	if ( isValidRegister( reg ) == false ) {
-		return INSTRUCTION_STATUS_FAILURE;
-	}
+	return res;
+}
 
-	register_t r1 = getRegister( reg );
-	register_t r2;
+ubyte_t x8000_mov_int( struct x8000_vm* vm, struct x8000_op* op ) {
+	// MOV RK, 0x1 / MOV RP1, 0x1 / ... / INT
 
-	if ( mode == X8000_SUB_R ) {
-		ubyte_t vreg = instructionNext();
+	for ( ubyte_t i = 0; i < op->length - 1; i++ ) {
+		struct x8000_op* mov = op + i;
 
-		if ( isValidRegister( vreg ) == false ) {
-			return INSTRUCTION_STATUS_FAILURE;
+		if ( mov->opcode == X8000_MOV_R ) {
+			vm->registers.regs[ mov->dst ] = vm->registers.regs[ mov->src ];
+		}else {
+			vm->registers.regs[ mov->dst ] = mov->imm;
 		}
+	}
 
-		r2 = getRegister( vreg );
-		setRegister( reg, ( r1 - r2 ) );
+	vm->opCursor += op->length - 1;
 
-		return INSTRUCTION_STATUS_SUCCESS;
-	}
+	return x8000_int( vm, op + op->length - 1 );
+}
 
-	union {
-		ubyte_t bt[ 8 ];
-		register_t reg;
-	} buffUnion;
-	buffUnion.reg = 0;
+ubyte_t x8000_cmp_jcc( struct x8000_vm* vm, struct x8000_op* op ) {
+	// CMP RK, 0xFF / JE 0xFFFFFFFFFFFFFFFF
 
-	if ( mode == X8000_SUB_8 ) {
-		buffUnion.bt[ 0 ] = instructionNext();
-		r2 = buffUnion.reg;
-	}else if ( mode == X8000_SUB_16 ) {
-		buffUnion.bt[ 0 ] = instructionNext();
-		buffUnion.bt[ 1 ] = instructionNext();
-		r2 = buffUnion.reg;
-	}else if ( mode == X8000_SUB_32 ) {
-		buffUnion.bt[ 0 ] = instructionNext();
-		buffUnion.bt[ 1 ] = instructionNext();
-		buffUnion.bt[ 2 ] = instructionNext();
-		buffUnion.bt[ 3 ] = instructionNext();
-		r2 = buffUnion.reg;
-	}else if ( mode == X8000_SUB_64 ) {
-		buffUnion.bt[ 0 ] = instructionNext();
-		buffUnion.bt[ 1 ] = instructionNext();
-		buffUnion.bt[ 2 ] = instructionNext();
-		buffUnion.bt[ 3 ] = instructionNext();
-		buffUnion.bt[ 4 ] = instructionNext();
-		buffUnion.bt[ 5 ] = instructionNext();
-		buffUnion.bt[ 6 ] = instructionNext();
-		buffUnion.bt[ 7 ] = instructionNext();
-		r2 = buffUnion.reg;
+	x8000_cmp( vm, op );
+	if ( isConditionTaken( vm, op->cond ) ) {
+		vm->opCursor = op->target;
+		jitCount( vm, vm->opCursor );
+		if ( vm->traceRing != NULL ) traceBranch( vm, op[ op->length - 1 ].nextIP );
 	}else {
-		return INSTRUCTION_STATUS_FAILURE;
+		vm->opCursor += 1;
 	}
 
-	setRegister( reg, ( r1 - r2 ) );
-
 	return INSTRUCTION_STATUS_SUCCESS;
 }
 
-ubyte_t x8000_mul() {
-	// MUL RK, 0xFF
-
-	ubyte_t mode = instructionPeek();
-	ubyte_t reg = instructionNext();
+ubyte_t x8000_cmp_r_jcc( struct x8000_vm* vm, struct x8000_op* op ) {
+	// CMP RK, R1 / JE 0xFFFFFFFFFFFFFFFF
 
-	if ( isValidRegister( reg ) == false ) {
-		return INSTRUCTION_STATUS_FAILURE;
+	x8000_cmp_r( vm, op );
+	if ( isConditionTaken( vm, op->cond ) ) {
+		vm->opCursor = op->target;
+		jitCount( vm, vm->opCursor );
+		if ( vm->traceRing != NULL ) traceBranch( vm, op[ op->length - 1 ].nextIP );
+	}else {
+		vm->opCursor += 1;
 	}
 
-	register_t r1 = getRegister( reg );
-	register_t r2;
-
-	if ( mode == X8000_MUL_R ) {
-		ubyte_t vreg = instructionNext();
+	return INSTRUCTION_STATUS_SUCCESS;
+}
+
+ubyte_t x8000_step_cmp_jcc( struct x8000_vm* vm, struct x8000_op* op ) {
+	// INC R1 / CMP R1, 0xFF / JNE 0xFFFFFFFFFFFFFFFF
+
+	vm->registers.regs[ op->dst ] += op->imm;
+	x8000_cmp( vm, op + 1 );
+	if ( isConditionTaken( vm, op->cond ) ) {
+		vm->opCursor = op->target;
+		jitCount( vm, vm->opCursor );
+		if ( vm->traceRing != NULL ) traceBranch( vm, op[ op->length - 1 ].nextIP );
+	}else {
+		vm->opCursor += 2;
+	}
+
+	return INSTRUCTION_STATUS_SUCCESS;
+}
+
+ubyte_t x8000_step_cmp_r_jcc( struct x8000_vm* vm, struct x8000_op* op ) {
+	// INC R1 / CMP R1, R2 / JNE 0xFFFFFFFFFFFFFFFF
+
+	vm->registers.regs[ op->dst ] += op->imm;
+	x8000_cmp_r( vm, op + 1 );
+	if ( isConditionTaken( vm, op->cond ) ) {
+		vm->opCursor = op->target;
+		jitCount( vm, vm->opCursor );
+		if ( vm->traceRing != NULL ) traceBranch( vm, op[ op->length - 1 ].nextIP );
+	}else {
+		vm->opCursor += 2;
+	}
+
+	return INSTRUCTION_STATUS_SUCCESS;
+}
+
+ubyte_t x8000_load_8( struct x8000_vm* vm, struct x8000_op* op ) {
+	// LOAD8 R1, R2, 0xFF
+
+	vm->registers.regs[ op->dst ] = *GUEST_ACCESS( vm, vm->registers.regs[ op->src ] + op->imm );
+
+	return INSTRUCTION_STATUS_SUCCESS;
+}
+
+ubyte_t x8000_load_16( struct x8000_vm* vm, struct x8000_op* op ) {
+	// LOAD16 R1, R2, 0xFF
+
+	uint16_t value;
+	memcpy( &value, GUEST_ACCESS( vm, vm->registers.regs[ op->src ] + op->imm ), sizeof( value ) );
+	vm->registers.regs[ op->dst ] = (x8000_register_t)value;
+
+	return INSTRUCTION_STATUS_SUCCESS;
+}
+
+ubyte_t x8000_load_32( struct x8000_vm* vm, struct x8000_op* op ) {
+	// LOAD32 R1, R2, 0xFF
+
+	uint32_t value;
+	memcpy( &value, GUEST_ACCESS( vm, vm->registers.regs[ op->src ] + op->imm ), sizeof( value ) );
+	vm->registers.regs[ op->dst ] = (x8000_register_t)value;
+
+	return INSTRUCTION_STATUS_SUCCESS;
+}
+
+ubyte_t x8000_load_64( struct x8000_vm* vm, struct x8000_op* op ) {
+	// LOAD64 R1, R2, 0xFF
+
+	uint64_t value;
+	memcpy( &value, GUEST_ACCESS( vm, vm->registers.regs[ op->src ] + op->imm ), sizeof( value ) );
+	vm->registers.regs[ op->dst ] = (x8000_register_t)value;
+
+	return INSTRUCTION_STATUS_SUCCESS;
+}
+
+ubyte_t x8000_store_8( struct x8000_vm* vm, struct x8000_op* op ) {
+	// STORE8 R1, R2, 0xFF
+
+	*GUEST_ACCESS( vm, vm->registers.regs[ op->src ] + op->imm ) = (ubyte_t)vm->registers.regs[ op->dst ];
+
+	return INSTRUCTION_STATUS_SUCCESS;
+}
+
+ubyte_t x8000_store_16( struct x8000_vm* vm, struct x8000_op* op ) {
+	// STORE16 R1, R2, 0xFF
+
+	uint16_t value = (uint16_t)vm->registers.regs[ op->dst ];
+	memcpy( GUEST_ACCESS( vm, vm->registers.regs[ op->src ] + op->imm ), &value, sizeof( value ) );
+
+	return INSTRUCTION_STATUS_SUCCESS;
+}
+
+ubyte_t x8000_store_32( struct x8000_vm* vm, struct x8000_op* op ) {
+	// STORE32 R1, R2, 0xFF
+
+	uint32_t value = (uint32_t)vm->registers.regs[ op->dst ];
+	memcpy( GUEST_ACCESS( vm, vm->registers.regs[ op->src ] + op->imm ), &value, sizeof( value ) );
+
+	return INSTRUCTION_STATUS_SUCCESS;
+}
+
+ubyte_t x8000_store_64( struct x8000_vm* vm, struct x8000_op* op ) {
+	// STORE64 R1, R2, 0xFF
+
+	uint64_t value = (uint64_t)vm->registers.regs[ op->dst ];
+	memcpy( GUEST_ACCESS( vm, vm->registers.regs[ op->src ] + op->imm ), &value, sizeof( value ) );
+
+	return INSTRUCTION_STATUS_SUCCESS;
+}
+
+ubyte_t x8000_rc( struct x8000_vm* vm, struct x8000_op* op ) {
+	// MOV R1, RC / MOV RC, R1
+
+	materializeFlags( vm );
+
+	ubyte_t res = handlers[ handleInstruction( op->opcode ) ]( vm, op );
+
+	// Unless the op was a CMP, RC now holds the flags
+	if ( vm->registers.flagsLazy == 0 ) {
+		restoreFlags( vm );
+	}
+
+	return res;
+}
+
+bool isConditionTaken( struct x8000_vm* vm, ubyte_t cond ) {
+	bool flag;
+
+	if ( cond & CMP_FLAG_EQ ) {
+		flag = vm->registers.flagsLeft == vm->registers.flagsRight;
+	}else {
+		flag = vm->registers.flagsLeft != 0;
+	}
+
+	return flag != ( ( cond & CMP_COND_INVERT ) != 0 );
+}
+// ==================== Instruction ====================
+
+// ==================== Decoder ====================
+void initDecoder( struct x8000_vm* vm ) {
+	// Every instruction is at least one byte, plus the trailing sentinel
+	vm->ops = (struct x8000_op*)malloc( sizeof( struct x8000_op ) * ( vm->programSize + 1 ) );
+	vm->ipMap = (size_t*)malloc( sizeof( size_t ) * ( vm->programSize + 1 ) );
+	vm->opsSize = 0;
+	vm->opCursor = 0;
+
+	for ( size_t i = 0; i <= vm->programSize; i++ ) {
+		vm->ipMap[ i ] = OP_INDEX_NONE;
+	}
+
+	size_t pos = 0;
+	while ( pos < vm->programSize ) {
+		vm->ipMap[ pos ] = vm->opsSize;
+		decodeInstruction( vm, &vm->ops[ vm->opsSize ], pos );
+		pos = vm->ops[ vm->opsSize++ ].nextIP;
+	}
+
+	// Running off the end of the program is a failure, not a read past the buffer
+	vm->ipMap[ vm->programSize ] = vm->opsSize;
+	vm->ops[ vm->opsSize ].kind = X8000_OP_BAD;
+	vm->ops[ vm->opsSize ].opcode = (ubyte_t)0x00;
+	vm->ops[ vm->opsSize ].dst = (ubyte_t)0x00;
+	vm->ops[ vm->opsSize ].src = (ubyte_t)0x00;
+	vm->ops[ vm->opsSize ].length = (ubyte_t)0x01;
+	vm->ops[ vm->opsSize ].cond = (ubyte_t)0x00;
+	vm->ops[ vm->opsSize ].imm = NULL_REG;
+	vm->ops[ vm->opsSize ].ip = vm->programSize;
+	vm->ops[ vm->opsSize ].nextIP = vm->programSize;
+	vm->ops[ vm->opsSize ].target = OP_INDEX_NONE;
+	vm->opsSize++;
+
+	vm->ops = (struct x8000_op*)realloc( vm->ops, sizeof( struct x8000_op ) * vm->opsSize );
+
+	// Jump targets can point forward, so they are resolved once every op is known
+	for ( size_t i = 0; i < vm->opsSize; i++ ) {
+		if ( vm->ops[ i ].kind == X8000_OP_BAD || !isBranchInstruction( vm->ops[ i ].opcode ) ) {
+			continue;
+		}
+
+		size_t index = lookupOp( vm, (x8000_address_t)vm->ops[ i ].imm );
+
+		if ( index == OP_INDEX_NONE ) {
+			// Rejected by verifyProgram, kept so that decoding never depends on it
+			index = vm->opsSize - 1;
+		}
+
+		vm->ops[ i ].target = index;
+	}
+
+	// A profile sees every instruction on its own
+	if ( vm->profile == false ) {
+		fuseOps( vm );
+	}
+}
+
+void freeDecoder( struct x8000_vm* vm ) {
+	if ( vm->ops != NULL ) free( vm->ops );
+	if ( vm->ipMap != NULL ) free( vm->ipMap );
+}
+
+size_t instructionSize( ubyte_t ins ) {
+	switch ( ins ) {
+	case X8000_RET:
+	case X8000_INT:
+		return 1;
+	case X8000_INC:
+	case X8000_DEC:
+		return 2;
+	case X8000_MOV_R:
+	case X8000_CMP_R:
+	case X8000_ADD_R:
+	case X8000_SUB_R:
+	case X8000_MUL_R:
+	case X8000_DIV_R:
+	case X8000_MOV_8:
+	case X8000_CMP_8:
+	case X8000_ADD_8:
+	case X8000_SUB_8:
+	case X8000_MUL_8:
+	case X8000_DIV_8:
+		return 3;
+	case X8000_MOV_16:
+	case X8000_CMP_16:
+	case X8000_ADD_16:
+	case X8000_SUB_16:
+	case X8000_MUL_16:
+	case X8000_DIV_16:
+		return 4;
+	case X8000_MOV_32:
+	case X8000_CMP_32:
+	case X8000_ADD_32:
+	case X8000_SUB_32:
+	case X8000_MUL_32:
+	case X8000_DIV_32:
+		return 6;
+	case X8000_LOAD_8:
+	case X8000_LOAD_16:
+	case X8000_LOAD_32:
+	case X8000_LOAD_64:
+	case X8000_STORE_8:
+	case X8000_STORE_16:
+	case X8000_STORE_32:
+	case X8000_STORE_64:
+		return 7;
+	case X8000_JMP:
+	case X8000_JE:
+	case X8000_JNE:
+	case X8000_JNZ:
+	case X8000_CALL:
+		return 9;
+	case X8000_MOV_64:
+	case X8000_CMP_64:
+	case X8000_ADD_64:
+	case X8000_SUB_64:
+	case X8000_MUL_64:
+	case X8000_DIV_64:
+		return 10;
+	default:
+		return 1;
+	}
+}
+
+bool isBranchInstruction( ubyte_t ins ) {
+	return (
+		ins == X8000_JMP ||
+		ins == X8000_JE ||
+		ins == X8000_JNE ||
+		ins == X8000_JNZ ||
+		ins == X8000_CALL
+	);
+}
+
+bool isMemoryInstruction( ubyte_t ins ) {
+	return ins >= X8000_LOAD_8 && ins <= X8000_STORE_64;
+}
+
+bool verifyProgram( const ubyte_t* program, size_t programSize ) {
+	// Marks the bytes that start an instruction, jump targets are checked against it afterwards
+	ubyte_t* starts = (ubyte_t*)calloc( programSize + 1, sizeof( ubyte_t ) );
+	if ( starts == NULL ) {
+		fprintf( stdout, "Error: Cannot verify the program.\n" );
+		return false;
+	}
+
+	bool status = true;
+	size_t pos = 0;
+
+	while ( status && pos < programSize ) {
+		ubyte_t ins = program[ pos ];
+		size_t size = instructionSize( ins );
+
+		starts[ pos ] = (ubyte_t)0x01;
+
+		if ( handleInstruction( ins ) == X8000_OP_BAD ) {
+			status = verifyFailure( program, pos, "unknown opcode" );
+		}else if ( size > programSize - pos ) {
+			status = verifyFailure( program, pos, "truncated instruction" );
+		}else if ( size >= 2 && !isBranchInstruction( ins ) && isValidRegister( program[ pos + 1 ] ) == false ) {
+			status = verifyFailure( program, pos, "invalid destination register" );
+		}else if (
+			( isMemoryInstruction( ins ) ||
+			ins == X8000_MOV_R ||
+			ins == X8000_CMP_R ||
+			ins == X8000_ADD_R ||
+			ins == X8000_SUB_R ||
+			ins == X8000_MUL_R ||
+			ins == X8000_DIV_R ) &&
+			isValidRegister( program[ pos + 2 ] ) == false
+		) {
+			status = verifyFailure( program, pos, "invalid source register" );
+		}
+
+		pos += size;
+	}
+
+	for ( pos = 0; status && pos < programSize; pos += instructionSize( program[ pos ] ) ) {
+		if ( !isBranchInstruction( program[ pos ] ) ) {
+			continue;
+		}
+
+		uint64_t target;
+		memcpy( &target, &program[ pos + 1 ], sizeof( target ) );
+
+		if ( target >= programSize ) {
+			status = verifyFailure( program, pos, "jump target out of range" );
+		}else if ( starts[ target ] == (ubyte_t)0x00 ) {
+			status = verifyFailure( program, pos, "jump target inside an instruction" );
+		}
+	}
+
+	free( starts );
+	return status;
+}
+
+bool verifyFailure( const ubyte_t* program, size_t pos, const char* reason ) {
+	fprintf( stdout, "Error: Invalid program at offset 0x%zx (opcode 0x%02x): %s.\n", pos, program[ pos ], reason );
+	return false;
+}
+
+void decodeInstruction( struct x8000_vm* vm, struct x8000_op* op, size_t pos ) {
+	ubyte_t ins = vm->program[ pos ];
+	size_t size = instructionSize( ins );
+
+	op->kind = handleInstruction( ins );
+	op->opcode = ins;
+	op->dst = (ubyte_t)0x00;
+	op->src = (ubyte_t)0x00;
+	op->length = (ubyte_t)0x01;
+	op->cond = (ubyte_t)0x00;
+	op->imm = NULL_REG;
+	op->ip = pos;
+	op->nextIP = pos + size;
+	op->target = OP_INDEX_NONE;
+
+	if ( op->kind == X8000_OP_BAD ) {
+		return;
+	}
+
+	if ( pos + size > vm->programSize ) {
+		op->kind = X8000_OP_BAD;
+		op->nextIP = vm->programSize;
+		return;
+	}
+
+	union {
+		ubyte_t bt[ 8 ];
+		x8000_register_t reg;
+	} buffUnion;
+	buffUnion.reg = 0;
+
+	if ( isBranchInstruction( ins ) ) {
+		// JMP 0xFFFFFFFFFFFFFFFF
+		for ( int i = 0; i < 8; i++ ) {
+			buffUnion.bt[ i ] = vm->program[ pos + 1 + i ];
+		}
+		op->imm = buffUnion.reg;
+		return;
+	}
+
+	if ( size == 1 ) {
+		// RET / INT
+		return;
+	}
+
+	ubyte_t dst = vm->program[ pos + 1 ];
+	ubyte_t src = (ubyte_t)0x00;
+
+	if ( isValidRegister( dst ) == false ) {
+		op->kind = X8000_OP_BAD;
+		return;
+	}
+
+	if ( size == 2 ) {
+		// INC RK
+	}else if ( isMemoryInstruction( ins ) ) {
+		// LOAD64 R1, R2, 0xFFFFFFFF
+		src = vm->program[ pos + 2 ];
+
+		if ( isValidRegister( src ) == false ) {
+			op->kind = X8000_OP_BAD;
+			return;
+		}
+
+		int32_t offset;
+		memcpy( &offset, &vm->program[ pos + 3 ], sizeof( offset ) );
+
+		op->src = REGISTER_INDEX( src );
+		op->imm = (x8000_register_t)offset;
+	}else if (
+		ins == X8000_MOV_R ||
+		ins == X8000_CMP_R ||
+		ins == X8000_ADD_R ||
+		ins == X8000_SUB_R ||
+		ins == X8000_MUL_R ||
+		ins == X8000_DIV_R
+	) {
+		src = vm->program[ pos + 2 ];
+
+		if ( isValidRegister( src ) == false ) {
+			op->kind = X8000_OP_BAD;
+			return;
+		}
+
+		op->src = REGISTER_INDEX( src );
+	}else {
+		for ( size_t i = 0; i < size - 2; i++ ) {
+			buffUnion.bt[ i ] = vm->program[ pos + 2 + i ];
+		}
+		op->imm = buffUnion.reg;
+	}
+
+	op->dst = REGISTER_INDEX( dst );
+
+	if ( dst == REGISTER_IP || src == REGISTER_IP ) {
+		op->kind = X8000_OP_IP;
+	}else if ( dst == REGISTER_RC || src == REGISTER_RC ) {
+		op->kind = X8000_OP_RC;
+	}
+}
+
+void fuseOps( struct x8000_vm* vm ) {
+	// Each op only looks at the kinds of the ops after it, which are not fused yet
+	for ( size_t i = 0; i < vm->opsSize; i++ ) {
+		struct x8000_op* op = &vm->ops[ i ];
+		ubyte_t kind = op->kind;
+
+		if ( kind == X8000_OP_MOV || kind == X8000_OP_MOV_R ) {
+			// MOV RK, 0x1 / MOV RP1, R1 / ... / INT
+			size_t j = i;
+
+			while ( j < vm->opsSize && j - i < OP_FUSE_MAX_LENGTH - 1 && ( vm->ops[ j ].kind == X8000_OP_MOV || vm->ops[ j ].kind == X8000_OP_MOV_R ) ) {
+				j++;
+			}
+
+			if ( j < vm->opsSize && vm->ops[ j ].kind == X8000_OP_INT ) {
+				op->kind = X8000_OP_MOV_INT;
+				op->length = (ubyte_t)( j - i + 1 );
+			}
+		}else if ( ( kind == X8000_OP_CMP || kind == X8000_OP_CMP_R ) && i + 1 < vm->opsSize ) {
+			// CMP R1, 0xFF / JE 0xFFFFFFFFFFFFFFFF
+			struct x8000_op* jump = &vm->ops[ i + 1 ];
+			ubyte_t cond = jumpCondition( jump->kind );
+
+			if ( cond != (ubyte_t)0x00 ) {
+				op->kind = kind == X8000_OP_CMP ? X8000_OP_CMP_JCC : X8000_OP_CMP_R_JCC;
+				op->length = 2;
+				op->cond = cond;
+				op->target = jump->target;
+			}
+		}else if ( ( kind == X8000_OP_INC || kind == X8000_OP_DEC ) && i + 2 < vm->opsSize ) {
+			// INC R1 / CMP R1, 0xFF / JNE 0xFFFFFFFFFFFFFFFF
+			struct x8000_op* cmp = &vm->ops[ i + 1 ];
+			struct x8000_op* jump = &vm->ops[ i + 2 ];
+			ubyte_t cond = jumpCondition( jump->kind );
+
+			if ( ( cmp->kind == X8000_OP_CMP || cmp->kind == X8000_OP_CMP_R ) && cond != (ubyte_t)0x00 ) {
+				op->kind = cmp->kind == X8000_OP_CMP ? X8000_OP_STEP_CMP_JCC : X8000_OP_STEP_CMP_R_JCC;
+				op->length = 3;
+				op->cond = cond;
+				op->imm = kind == X8000_OP_INC ? 1 : -1;
+				op->target = jump->target;
+			}
+		}
+	}
+}
+
+ubyte_t jumpCondition( ubyte_t kind ) {
+	switch ( kind ) {
+	case X8000_OP_JE:
+		return CMP_FLAG_EQ;
+	case X8000_OP_JNE:
+		return CMP_FLAG_EQ | CMP_COND_INVERT;
+	case X8000_OP_JNZ:
+		return CMP_FLAG_NJ;
+	default:
+		return (ubyte_t)0x00;
+	}
+}
+
+size_t lookupOp( struct x8000_vm* vm, x8000_address_t address ) {
+	if ( address > vm->programSize ) {
+		return OP_INDEX_NONE;
+	}
+
+	return vm->ipMap[ address ];
+}
+// ==================== Decoder ====================
+
+// ==================== JIT ====================
+void initJit( struct x8000_vm* vm ) {
+	vm->jitEnabled = false;
+	vm->jitCode = NULL;
+	vm->jitCodeSize = 0;
+	vm->jitLeave = 0;
+	vm->jitEnter = NULL;
+	vm->jitBlocks = NULL;
+	vm->jitHits = NULL;
+	vm->jitPatches = NULL;
+
+#ifdef X8000_JIT
+	vm->jitHits = (unsigned int*)calloc( vm->opsSize, sizeof( unsigned int ) );
+	vm->jitBlocks = (ubyte_t**)calloc( vm->opsSize, sizeof( ubyte_t* ) );
+
+	// So does a compiled block, which would hide them
+	if ( vm->profile ) {
+		return;
+	}
+
+	void* code = mmap( NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if ( code == MAP_FAILED || vm->jitHits == NULL || vm->jitBlocks == NULL ) {
+		// Without a code region the interpreter simply keeps running everything
+		return;
+	}
+
+	vm->jitCode = (ubyte_t*)code;
+
+	/*
+		jitEnter( regs, block ):
+			save the callee-saved registers blocks may use, then jump to
+			the block with the guest register file in rdi.
+		jitLeave:
+			restore them and return the op index left in rax.
+	*/
+	jitEmit8( vm, 0x53 );		// push rbx
+	jitEmit8( vm, 0x41 ); jitEmit8( vm, 0x54 );	// push r12
+	jitEmit8( vm, 0x41 ); jitEmit8( vm, 0x55 );	// push r13
+	jitEmit8( vm, 0x41 ); jitEmit8( vm, 0x56 );	// push r14
+	jitEmit8( vm, 0x41 ); jitEmit8( vm, 0x57 );	// push r15
+
+	jitEmit8( vm, 0xFF ); jitEmit8( vm, 0xE6 );	// jmp rsi
+
+	vm->jitLeave = vm->jitCodeSize;
+
+	jitEmit8( vm, 0x41 ); jitEmit8( vm, 0x5F );	// pop r15
+	jitEmit8( vm, 0x41 ); jitEmit8( vm, 0x5E );	// pop r14
+	jitEmit8( vm, 0x41 ); jitEmit8( vm, 0x5D );	// pop r13
+	jitEmit8( vm, 0x41 ); jitEmit8( vm, 0x5C );	// pop r12
+	jitEmit8( vm, 0x5B );		// pop rbx
+	jitEmit8( vm, 0xC3 );		// ret
+
+	if ( mprotect( vm->jitCode, JIT_CODE_SIZE, PROT_READ | PROT_EXEC ) != 0 ) {
+		return;
+	}
+
+	vm->jitEnter = (x8000_jit_enter_t)vm->jitCode;
+	vm->jitEnabled = true;
+#endif
+}
+
+void freeJit( struct x8000_vm* vm ) {
+	if ( vm->jitCode != NULL ) munmap( vm->jitCode, JIT_CODE_SIZE );
+	if ( vm->jitHits != NULL ) free( vm->jitHits );
+	if ( vm->jitBlocks != NULL ) free( vm->jitBlocks );
+
+	struct jitPatch* current = vm->jitPatches;
+
+	while ( current != NULL ) {
+		struct jitPatch* _next = current->next;
+		free( current );
+		current = _next;
+	}
+}
+
+bool jitLeaves( struct x8000_vm* vm, size_t index ) {
+	// Not compilable, or already got hot and was turned down
+	return index >= vm->opsSize || isJitInstruction( &vm->ops[ index ] ) == false ||
+		( vm->jitHits[ index ] >= JIT_THRESHOLD && vm->jitBlocks[ index ] == NULL );
+}
+
+void jitCount( struct x8000_vm* vm, size_t index ) {
+#ifdef X8000_JIT
+	if ( ++vm->jitHits[ index ] == JIT_THRESHOLD ) {
+		jitCompile( vm, index );
+	}
+#endif
+}
+
+bool jitCompile( struct x8000_vm* vm, size_t head ) {
+	if ( vm->jitEnabled == false || vm->jitBlocks[ head ] != NULL ) {
+		return false;
+	}
+
+	if ( vm->jitCodeSize + JIT_BLOCK_MAX_BYTES > JIT_CODE_SIZE ) {
+		// Out of code space, everything not compiled yet stays interpreted
+		vm->jitEnabled = false;
+		return false;
+	}
+
+	/*
+		First pass: find where the block ends and give every guest
+		register it touches a host register. Registers read before they
+		are written get loaded on entry, and every written register is
+		stored back on exit.
+	*/
+	static const int hostPool[ JIT_HOST_REGS_COUNT ] = {
+		JIT_RCX, JIT_RSI, JIT_R8, JIT_R9, JIT_R10,
+		JIT_RBX, JIT_R12, JIT_R13, JIT_R14, JIT_R15
+	};
+	const ubyte_t left = JIT_FLAGS_LEFT;
+	const ubyte_t right = JIT_FLAGS_RIGHT;
+
+	int hostRegs[ JIT_REGS_COUNT ];
+	uint32_t load = 0;
+	uint32_t dirty = 0;
+	int hostUsed = 0;
+	size_t end = head;
+
+	for ( int i = 0; i < JIT_REGS_COUNT; i++ ) {
+		hostRegs[ i ] = -1;
+	}
+
+	while ( end < vm->opsSize && end - head < JIT_BLOCK_MAX_OPS && isJitInstruction( &vm->ops[ end ] ) ) {
+		struct x8000_op* op = &vm->ops[ end ];
+		uint32_t reads = 0;
+		uint32_t writes = 0;
+
+		switch ( op->opcode ) {
+		case X8000_MOV_R:
+			reads = 1u << op->src;
+			writes = 1u << op->dst;
+			break;
+		case X8000_MOV_8:
+		case X8000_MOV_16:
+		case X8000_MOV_32:
+		case X8000_MOV_64:
+			writes = 1u << op->dst;
+			break;
+		case X8000_CMP_R:
+			reads = ( 1u << op->dst ) | ( 1u << op->src );
+			writes = ( 1u << left ) | ( 1u << right );
+			break;
+		case X8000_CMP_8:
+		case X8000_CMP_16:
+		case X8000_CMP_32:
+		case X8000_CMP_64:
+			reads = 1u << op->dst;
+			writes = ( 1u << left ) | ( 1u << right );
+			break;
+		case X8000_JMP:
+		case X8000_CALL:
+		case X8000_RET:
+			break;
+		case X8000_JE:
+		case X8000_JNE:
+			reads = ( 1u << left ) | ( 1u << right );
+			break;
+		case X8000_JNZ:
+			reads = 1u << left;
+			break;
+		case X8000_INC:
+		case X8000_DEC:
+			reads = 1u << op->dst;
+			writes = 1u << op->dst;
+			break;
+		case X8000_ADD_R:
+		case X8000_SUB_R:
+		case X8000_MUL_R:
+		case X8000_DIV_R:
+			reads = ( 1u << op->dst ) | ( 1u << op->src );
+			writes = 1u << op->dst;
+			break;
+		default:
+			reads = 1u << op->dst;
+			writes = 1u << op->dst;
+			break;
+		}
+
+		int needed = 0;
+		for ( int i = 0; i < JIT_REGS_COUNT; i++ ) {
+			if ( ( ( reads | writes ) & ( 1u << i ) ) && hostRegs[ i ] == -1 ) {
+				needed++;
+			}
+		}
+
+		if ( hostUsed + needed > JIT_HOST_REGS_COUNT ) {
+			break;
+		}
+
+		for ( int i = 0; i < JIT_REGS_COUNT; i++ ) {
+			if ( ( ( reads | writes ) & ( 1u << i ) ) && hostRegs[ i ] == -1 ) {
+				hostRegs[ i ] = hostPool[ hostUsed++ ];
+			}
+		}
+
+		load |= reads & ~dirty;
+		dirty |= writes;
+		end++;
+
+		if ( isBranchInstruction( op->opcode ) || op->opcode == X8000_RET ) {
+			break;
+		}
+	}
+
+	if ( end == head ) {
+		return false;
+	}
+
+	struct x8000_op* exit = &vm->ops[ end - 1 ];
+	size_t next = isBranchInstruction( exit->opcode ) ? exit->target : end;
+
+	if ( end - head < JIT_BLOCK_MIN_OPS && exit->opcode != X8000_RET && next != head && jitLeaves( vm, next ) ) {
+		// Hands straight back to the interpreter, too short to pay for jitEnter
+		return false;
+	}
+
+	// Second pass: emit the block
+	if ( mprotect( vm->jitCode, JIT_CODE_SIZE, PROT_READ | PROT_WRITE ) != 0 ) {
+		vm->jitEnabled = false;
+		return false;
+	}
+
+	size_t entry = vm->jitCodeSize;
+
+	for ( int i = 0; i < JIT_REGS_COUNT; i++ ) {
+		if ( load & ( 1u << i ) ) {
+			jitLoad( vm, hostRegs[ i ], (ubyte_t)i );
+		}
+	}
+
+	size_t body = vm->jitCodeSize;
+
+	// add qword [rdi + instructionCount], ops in the block
+	jitEmit8( vm, 0x48 );
+	jitEmit8( vm, 0x81 );
+	jitModRM( vm, 2, 0, JIT_RDI );
+	jitEmit32( vm, JIT_VM_OFFSET( instructionCount ) );
+	jitEmit32( vm, (uint32_t)( end - head ) );
+
+	// mov qword [rdi + opCursor], head + 1, chained blocks never return so the sampler looks here
+	if ( vm->samples != NULL ) {
+		jitEmit8( vm, 0x48 );
+		jitEmit8( vm, 0xC7 );
+		jitModRM( vm, 2, 0, JIT_RDI );
+		jitEmit32( vm, JIT_VM_OFFSET( opCursor ) );
+		jitEmit32( vm, (uint32_t)( head + 1 ) );
+	}
+
+	for ( size_t i = head; i < end; i++ ) {
+		struct x8000_op* op = &vm->ops[ i ];
+		int dst = hostRegs[ op->dst ];
+		int src = hostRegs[ op->src ];
+
+		switch ( op->opcode ) {
+		case X8000_MOV_R:
+			jitAluRR( vm, 0x89, dst, src );
+			break;
+		case X8000_MOV_8:
+		case X8000_MOV_16:
+		case X8000_MOV_32:
+		case X8000_MOV_64:
+			jitMovRI( vm, dst, op->imm );
+			break;
+		case X8000_CMP_R:
+			jitAluRR( vm, 0x89, hostRegs[ left ], dst );
+			jitAluRR( vm, 0x89, hostRegs[ right ], src );
+			break;
+		case X8000_CMP_8:
+		case X8000_CMP_16:
+		case X8000_CMP_32:
+		case X8000_CMP_64:
+			jitAluRR( vm, 0x89, hostRegs[ left ], dst );
+			jitMovRI( vm, hostRegs[ right ], op->imm );
+			break;
+		case X8000_INC:
+			jitAluRI( vm, 0x00, dst, 1 );
+			break;
+		case X8000_DEC:
+			jitAluRI( vm, 0x05, dst, 1 );
+			break;
+		case X8000_ADD_R:
+			jitAluRR( vm, 0x01, dst, src );
+			break;
+		case X8000_ADD_8:
+		case X8000_ADD_16:
+		case X8000_ADD_32:
+		case X8000_ADD_64:
+			jitAluRI( vm, 0x00, dst, op->imm );
+			break;
+		case X8000_SUB_R:
+			jitAluRR( vm, 0x29, dst, src );
+			break;
+		case X8000_SUB_8:
+		case X8000_SUB_16:
+		case X8000_SUB_32:
+		case X8000_SUB_64:
+			jitAluRI( vm, 0x05, dst, op->imm );
+			break;
+		case X8000_MUL_R:
+			jitImulRR( vm, dst, src );
+			break;
+		case X8000_MUL_8:
+		case X8000_MUL_16:
+		case X8000_MUL_32:
+		case X8000_MUL_64:
+			jitImulRI( vm, dst, op->imm );
+			break;
+		case X8000_DIV_R:
+			jitDiv( vm, dst, src );
+			break;
+		case X8000_DIV_8:
+		case X8000_DIV_16:
+		case X8000_DIV_32:
+		case X8000_DIV_64:
+			if ( op->imm == 0 ) {
+				jitMovRI( vm, dst, 0 );
+			}else {
+				jitMovRI( vm, JIT_R11, op->imm );
+				jitDiv( vm, dst, JIT_R11 );
+			}
+			break;
+		}
+	}
+
+	struct x8000_op* last = &vm->ops[ end - 1 ];
+
+	if ( last->opcode == X8000_JMP ) {
+		if ( vm->traceRing != NULL ) jitTraceBranch( vm, last->nextIP );
+		jitExit( vm, last->target, head, body, hostRegs, dirty );
+	}else if ( last->opcode == X8000_JE || last->opcode == X8000_JNE || last->opcode == X8000_JNZ ) {
+		ubyte_t cc;
+
+		if ( last->opcode == X8000_JNZ ) {
+			jitAluRR( vm, 0x85, hostRegs[ left ], hostRegs[ left ] );	// test left, left
+			cc = JIT_CC_NZ;
+		}else {
+			jitAluRR( vm, 0x39, hostRegs[ left ], hostRegs[ right ] );	// cmp left, right
+			cc = last->opcode == X8000_JE ? JIT_CC_Z : JIT_CC_NZ;
+		}
+
+		if ( last->target == head && vm->traceRing == NULL ) {
+			jitPatchRel32( vm, jitJcc( vm, cc ), body );
+			jitExit( vm, end, head, body, hostRegs, dirty );
+		}else {
+			size_t taken = jitJcc( vm, cc );
+			jitExit( vm, end, head, body, hostRegs, dirty );
+			jitPatchRel32( vm, taken, vm->jitCodeSize );
+			if ( vm->traceRing != NULL ) jitTraceBranch( vm, last->nextIP );
+			jitExit( vm, last->target, head, body, hostRegs, dirty );
+		}
+	}else if ( last->opcode == X8000_CALL ) {
+		jitWriteBack( vm, hostRegs, dirty );
+		jitCall( vm, last );
+		if ( vm->traceRing != NULL ) jitTraceBranch( vm, last->nextIP );
+		jitJump( vm, last->target );
+	}else if ( last->opcode == X8000_RET ) {
+		jitWriteBack( vm, hostRegs, dirty );
+		jitReturn( vm, last );
+	}else {
+		jitExit( vm, end, head, body, hostRegs, dirty );
+	}
+
+	// Blocks that were waiting for this one can now jump straight into it
+	struct jitPatch** link = &vm->jitPatches;
+
+	while ( *link != NULL ) {
+		struct jitPatch* patch = *link;
+
+		if ( patch->target == head ) {
+			jitPatchRel32( vm, patch->pos, entry );
+			*link = patch->next;
+			free( patch );
+		}else {
+			link = &patch->next;
+		}
+	}
+
+	if ( mprotect( vm->jitCode, JIT_CODE_SIZE, PROT_READ | PROT_EXEC ) != 0 ) {
+		vm->jitEnabled = false;
+		return false;
+	}
+
+	vm->jitBlocks[ head ] = vm->jitCode + entry;
+	vm->ops[ head ].kind = X8000_OP_JIT;
+
+	return true;
+}
+
+bool isJitInstruction( struct x8000_op* op ) {
+	if ( op->kind == X8000_OP_BAD || op->kind == X8000_OP_IP || op->kind == X8000_OP_RC ) {
+		return false;
+	}
+
+	switch ( op->opcode ) {
+	case X8000_MOV_R:
+	case X8000_MOV_8:
+	case X8000_MOV_16:
+	case X8000_MOV_32:
+	case X8000_MOV_64:
+	case X8000_CMP_R:
+	case X8000_CMP_8:
+	case X8000_CMP_16:
+	case X8000_CMP_32:
+	case X8000_CMP_64:
+	case X8000_JMP:
+	case X8000_JE:
+	case X8000_JNE:
+	case X8000_JNZ:
+	case X8000_CALL:
+	case X8000_RET:
+	case X8000_INC:
+	case X8000_DEC:
+	case X8000_ADD_R:
+	case X8000_ADD_8:
+	case X8000_ADD_16:
+	case X8000_ADD_32:
+	case X8000_ADD_64:
+	case X8000_SUB_R:
+	case X8000_SUB_8:
+	case X8000_SUB_16:
+	case X8000_SUB_32:
+	case X8000_SUB_64:
+	case X8000_MUL_R:
+	case X8000_MUL_8:
+	case X8000_MUL_16:
+	case X8000_MUL_32:
+	case X8000_MUL_64:
+	case X8000_DIV_R:
+	case X8000_DIV_8:
+	case X8000_DIV_16:
+	case X8000_DIV_32:
+	case X8000_DIV_64:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void jitEmit8( struct x8000_vm* vm, ubyte_t bt ) {
+	vm->jitCode[ vm->jitCodeSize++ ] = bt;
+}
+
+void jitEmit32( struct x8000_vm* vm, uint32_t value ) {
+	memcpy( vm->jitCode + vm->jitCodeSize, &value, 4 );
+	vm->jitCodeSize += 4;
+}
+
+void jitEmit64( struct x8000_vm* vm, uint64_t value ) {
+	memcpy( vm->jitCode + vm->jitCodeSize, &value, 8 );
+	vm->jitCodeSize += 8;
+}
+
+void jitRex( struct x8000_vm* vm, int reg, int rm ) {
+	jitEmit8( vm, 0x48 | ( ( reg & 8 ) >> 1 ) | ( ( rm & 8 ) >> 3 ) );
+}
+
+void jitModRM( struct x8000_vm* vm, int mod, int reg, int rm ) {
+	jitEmit8( vm, (ubyte_t)( ( mod << 6 ) | ( ( reg & 7 ) << 3 ) | ( rm & 7 ) ) );
+}
+
+void jitLoad( struct x8000_vm* vm, int reg, ubyte_t index ) {
+	jitLoadField( vm, reg, index * sizeof( x8000_register_t ) );
+}
+
+void jitStore( struct x8000_vm* vm, ubyte_t index, int reg ) {
+	jitStoreField( vm, index * sizeof( x8000_register_t ), reg );
+}
+
+void jitLoadField( struct x8000_vm* vm, int reg, uint32_t offset ) {
+	// mov reg, [rdi + offset]
+	jitRex( vm, reg, JIT_RDI );
+	jitEmit8( vm, 0x8B );
+	jitModRM( vm, 2, reg, JIT_RDI );
+	jitEmit32( vm, offset );
+}
+
+void jitStoreField( struct x8000_vm* vm, uint32_t offset, int reg ) {
+	// mov [rdi + offset], reg
+	jitRex( vm, reg, JIT_RDI );
+	jitEmit8( vm, 0x89 );
+	jitModRM( vm, 2, reg, JIT_RDI );
+	jitEmit32( vm, offset );
+}
+
+void jitMovRI( struct x8000_vm* vm, int reg, x8000_register_t imm ) {
+	if ( imm >= INT32_MIN && imm <= INT32_MAX ) {
+		// mov reg, simm32
+		jitRex( vm, 0, reg );
+		jitEmit8( vm, 0xC7 );
+		jitModRM( vm, 3, 0, reg );
+		jitEmit32( vm, (uint32_t)imm );
+	}else {
+		// movabs reg, imm64
+		jitRex( vm, 0, reg );
+		jitEmit8( vm, 0xB8 + ( reg & 7 ) );
+		jitEmit64( vm, (uint64_t)imm );
+	}
+}
+
+void jitAluRR( struct x8000_vm* vm, ubyte_t opcode, int dst, int src ) {
+	// mov/add/sub/cmp/test dst, src
+	jitRex( vm, src, dst );
+	jitEmit8( vm, opcode );
+	jitModRM( vm, 3, src, dst );
+}
+
+void jitAluRI( struct x8000_vm* vm, ubyte_t digit, int dst, x8000_register_t imm ) {
+	if ( imm >= INT32_MIN && imm <= INT32_MAX ) {
+		// add/sub dst, simm32
+		jitRex( vm, 0, dst );
+		jitEmit8( vm, 0x81 );
+		jitModRM( vm, 3, digit, dst );
+		jitEmit32( vm, (uint32_t)imm );
+	}else {
+		jitMovRI( vm, JIT_R11, imm );
+		jitAluRR( vm, digit == 0x00 ? 0x01 : 0x29, dst, JIT_R11 );
+	}
+}
+
+void jitImulRR( struct x8000_vm* vm, int dst, int src ) {
+	// imul dst, src
+	jitRex( vm, dst, src );
+	jitEmit8( vm, 0x0F );
+	jitEmit8( vm, 0xAF );
+	jitModRM( vm, 3, dst, src );
+}
+
+void jitImulRI( struct x8000_vm* vm, int dst, x8000_register_t imm ) {
+	if ( imm >= INT32_MIN && imm <= INT32_MAX ) {
+		// imul dst, dst, simm32
+		jitRex( vm, dst, dst );
+		jitEmit8( vm, 0x69 );
+		jitModRM( vm, 3, dst, dst );
+		jitEmit32( vm, (uint32_t)imm );
+	}else {
+		jitMovRI( vm, JIT_R11, imm );
+		jitImulRR( vm, dst, JIT_R11 );
+	}
+}
+
+void jitDiv( struct x8000_vm* vm, int dst, int src ) {
+	// Same as x8000_div: a zero on either side gives zero, -1 negates
+	jitAluRR( vm, 0x89, JIT_RAX, dst );		// mov rax, dst
+	jitAluRR( vm, 0x85, src, src );		// test src, src
+	size_t zero = jitJcc( vm, JIT_CC_Z );
+	jitAluRR( vm, 0x85, JIT_RAX, JIT_RAX );	// test rax, rax
+	size_t done = jitJcc( vm, JIT_CC_Z );
+	jitRex( vm, 0, src );			// cmp src, -1
+	jitEmit8( vm, 0x83 );
+	jitModRM( vm, 3, 7, src );
+	jitEmit8( vm, 0xFF );
+	size_t divide = jitJcc( vm, JIT_CC_NZ );
+	jitEmit8( vm, 0x48 ); jitEmit8( vm, 0xF7 ); jitEmit8( vm, 0xD8 );	// neg rax, idiv would trap on the minimum
+	size_t negated = jitJmp( vm );
+	jitPatchRel32( vm, divide, vm->jitCodeSize );
+	jitEmit8( vm, 0x48 ); jitEmit8( vm, 0x99 );	// cqo
+	jitRex( vm, 0, src );			// idiv src
+	jitEmit8( vm, 0xF7 );
+	jitModRM( vm, 3, 7, src );
+	size_t skip = jitJmp( vm );
+	jitPatchRel32( vm, zero, vm->jitCodeSize );
+	jitEmit8( vm, 0x31 ); jitEmit8( vm, 0xC0 );	// xor eax, eax
+	jitPatchRel32( vm, done, vm->jitCodeSize );
+	jitPatchRel32( vm, skip, vm->jitCodeSize );
+	jitPatchRel32( vm, negated, vm->jitCodeSize );
+	jitAluRR( vm, 0x89, dst, JIT_RAX );		// mov dst, rax
+}
+
+size_t jitJcc( struct x8000_vm* vm, ubyte_t cc ) {
+	// jcc rel32, patched by the caller
+	jitEmit8( vm, 0x0F );
+	jitEmit8( vm, 0x80 | cc );
+	jitEmit32( vm, 0 );
+	return vm->jitCodeSize - 4;
+}
+
+size_t jitJmp( struct x8000_vm* vm ) {
+	// jmp rel32, patched by the caller
+	jitEmit8( vm, 0xE9 );
+	jitEmit32( vm, 0 );
+	return vm->jitCodeSize - 4;
+}
+
+void jitPatchRel32( struct x8000_vm* vm, size_t pos, size_t target ) {
+	int32_t rel = (int32_t)( (ssize_t)target - (ssize_t)( pos + 4 ) );
+	memcpy( vm->jitCode + pos, &rel, 4 );
+}
+
+void jitExit( struct x8000_vm* vm, size_t target, size_t head, size_t body, int* hostRegs, uint32_t dirty ) {
+	if ( target == head ) {
+		// Looping on itself, everything is still in host registers
+		jitPatchRel32( vm, jitJmp( vm ), body );
+		return;
+	}
+
+	jitWriteBack( vm, hostRegs, dirty );
+	jitJump( vm, target );
+}
+
+void jitWriteBack( struct x8000_vm* vm, int* hostRegs, uint32_t dirty ) {
+	for ( int i = 0; i < JIT_REGS_COUNT; i++ ) {
+		if ( dirty & ( 1u << i ) ) {
+			jitStore( vm, (ubyte_t)i, hostRegs[ i ] );
+		}
+	}
+
+	if ( dirty & ( 1u << JIT_FLAGS_LEFT ) ) {
+		// mov qword [rdi + flagsLazy], 1
+		jitEmit8( vm, 0x48 );
+		jitEmit8( vm, 0xC7 );
+		jitModRM( vm, 2, 0, JIT_RDI );
+		jitEmit32( vm, JIT_FLAGS_LAZY * sizeof( x8000_register_t ) );
+		jitEmit32( vm, 1 );
+	}
+}
+
+void jitJump( struct x8000_vm* vm, size_t target ) {
+	if ( vm->jitBlocks[ target ] != NULL ) {
+		jitPatchRel32( vm, jitJmp( vm ), (size_t)( vm->jitBlocks[ target ] - vm->jitCode ) );
+		return;
+	}
+
+	// mov rax, target / jmp jitLeave, redirected once target is compiled
+	jitEmit8( vm, 0x48 );
+	jitEmit8( vm, 0xB8 );
+	jitEmit64( vm, (uint64_t)target );
+
+	struct jitPatch* patch = (struct jitPatch*)malloc( sizeof( struct jitPatch ) );
+	patch->pos = jitJmp( vm );
+	patch->target = target;
+	patch->next = vm->jitPatches;
+	vm->jitPatches = patch;
+
+	jitPatchRel32( vm, patch->pos, vm->jitLeave );
+}
+
+void jitCall( struct x8000_vm* vm, struct x8000_op* op ) {
+	// Same as pushSP, a full stack leaves it to x8000_call to fail
+	jitLoadField( vm, JIT_RAX, JIT_VM_OFFSET( stackPointerSize ) );
+	jitRex( vm, JIT_RAX, JIT_RDI );			// cmp rax, [rdi + stackPointerCapacity]
+	jitEmit8( vm, 0x3B );
+	jitModRM( vm, 2, JIT_RAX, JIT_RDI );
+	jitEmit32( vm, JIT_VM_OFFSET( stackPointerCapacity ) );
+	size_t full = jitJcc( vm, JIT_CC_AE );
+
+	jitLoadField( vm, JIT_RDX, JIT_VM_OFFSET( stackPointer ) );
+	jitMovRI( vm, JIT_R11, (x8000_register_t)op->nextIP );
+	jitEmit8( vm, 0x4C ); jitEmit8( vm, 0x89 ); jitEmit8( vm, 0x1C ); jitEmit8( vm, 0xC2 );	// mov [rdx + rax * 8], r11
+	jitEmit8( vm, 0x48 ); jitEmit8( vm, 0xFF ); jitEmit8( vm, 0xC0 );	// inc rax
+	jitStoreField( vm, JIT_VM_OFFSET( stackPointerSize ), JIT_RAX );
+	jitStore( vm, REGISTER_INDEX( REGISTER_SP ), JIT_RAX );
+
+	size_t done = jitJmp( vm );
+	jitPatchRel32( vm, full, vm->jitCodeSize );
+	jitRetry( vm, op );
+	jitPatchRel32( vm, done, vm->jitCodeSize );
+}
+
+void jitReturn( struct x8000_vm* vm, struct x8000_op* op ) {
+	// Same as x8000_ret, anything it would reject is left to it
+	jitLoadField( vm, JIT_RAX, JIT_VM_OFFSET( stackPointerSize ) );
+	jitAluRR( vm, 0x85, JIT_RAX, JIT_RAX );	// test rax, rax
+	size_t empty = jitJcc( vm, JIT_CC_Z );
+
+	jitLoadField( vm, JIT_RDX, JIT_VM_OFFSET( stackPointer ) );
+	jitEmit8( vm, 0x48 ); jitEmit8( vm, 0x8B ); jitEmit8( vm, 0x54 ); jitEmit8( vm, 0xC2 ); jitEmit8( vm, 0xF8 );	// mov rdx, [rdx + rax * 8 - 8]
+	jitMovRI( vm, JIT_R11, (x8000_register_t)vm->programSize );
+	jitAluRR( vm, 0x39, JIT_RDX, JIT_R11 );	// cmp rdx, r11
+	size_t outside = jitJcc( vm, JIT_CC_A );
+
+	jitMovRI( vm, JIT_R11, (x8000_register_t)(uintptr_t)vm->ipMap );
+	jitEmit8( vm, 0x49 ); jitEmit8( vm, 0x8B ); jitEmit8( vm, 0x14 ); jitEmit8( vm, 0xD3 );	// mov rdx, [r11 + rdx * 8]
+	jitEmit8( vm, 0x48 ); jitEmit8( vm, 0x83 ); jitEmit8( vm, 0xFA ); jitEmit8( vm, 0xFF );	// cmp rdx, -1
+	size_t inside = jitJcc( vm, JIT_CC_Z );
+
+	jitEmit8( vm, 0x48 ); jitEmit8( vm, 0xFF ); jitEmit8( vm, 0xC8 );	// dec rax
+	jitStoreField( vm, JIT_VM_OFFSET( stackPointerSize ), JIT_RAX );
+	jitStore( vm, REGISTER_INDEX( REGISTER_SP ), JIT_RAX );
+
+	if ( vm->traceRing != NULL ) jitTraceBranch( vm, TRACE_RET );
+
+	// Straight into the compiled block for the return address, if there is one
+	jitAluRR( vm, 0x89, JIT_RAX, JIT_RDX );	// mov rax, rdx
+	jitMovRI( vm, JIT_R11, (x8000_register_t)(uintptr_t)vm->jitBlocks );
+	jitEmit8( vm, 0x49 ); jitEmit8( vm, 0x8B ); jitEmit8( vm, 0x14 ); jitEmit8( vm, 0xC3 );	// mov rdx, [r11 + rax * 8]
+	jitAluRR( vm, 0x85, JIT_RDX, JIT_RDX );	// test rdx, rdx
+	jitPatchRel32( vm, jitJcc( vm, JIT_CC_Z ), vm->jitLeave );
+	jitEmit8( vm, 0xFF ); jitEmit8( vm, 0xE2 );	// jmp rdx
+
+	jitPatchRel32( vm, empty, vm->jitCodeSize );
+	jitPatchRel32( vm, outside, vm->jitCodeSize );
+	jitPatchRel32( vm, inside, vm->jitCodeSize );
+	jitRetry( vm, op );
+}
+
+void jitRetry( struct x8000_vm* vm, struct x8000_op* op ) {
+	// sub qword [rdi + instructionCount], 1 / mov rax, op / jmp jitLeave, the interpreter counts it again
+	jitEmit8( vm, 0x48 );
+	jitEmit8( vm, 0x83 );
+	jitModRM( vm, 2, 5, JIT_RDI );
+	jitEmit32( vm, JIT_VM_OFFSET( instructionCount ) );
+	jitEmit8( vm, 0x01 );
+
+	jitEmit8( vm, 0x48 );
+	jitEmit8( vm, 0xB8 );
+	jitEmit64( vm, (uint64_t)( op - vm->ops ) );
+	jitPatchRel32( vm, jitJmp( vm ), vm->jitLeave );
+}
+
+void jitTraceBranch( struct x8000_vm* vm, x8000_address_t end ) {
+	// Same as traceBranch, only rax and the flags are used so host registers stay live
+	jitEmit8( vm, 0x48 );				// cmp qword [rdi + traceLast], end
+	jitEmit8( vm, 0x81 );
+	jitModRM( vm, 2, 7, JIT_RDI );
+	jitEmit32( vm, JIT_VM_OFFSET( traceLast ) );
+	jitEmit32( vm, (uint32_t)end );
+	size_t fresh = jitJcc( vm, JIT_CC_NZ );
+
+	jitLoadField( vm, JIT_RAX, JIT_VM_OFFSET( traceEntry ) );
+	jitEmit8( vm, 0x83 ); jitEmit8( vm, 0x40 ); jitEmit8( vm, 0x04 ); jitEmit8( vm, 0x01 );	// add dword [rax + 4], 1
+	size_t done = jitJcc( vm, JIT_CC_AE );
+	jitEmit8( vm, 0xFF ); jitEmit8( vm, 0x48 ); jitEmit8( vm, 0x04 );	// dec dword [rax + 4], back to saturated
+
+	// rax = &traceRing[ traceCount & ( TRACE_ENTRIES - 1 ) ], which becomes traceEntry
+	jitPatchRel32( vm, fresh, vm->jitCodeSize );
+	jitLoadField( vm, JIT_RAX, JIT_VM_OFFSET( traceCount ) );
+	jitEmit8( vm, 0x48 ); jitEmit8( vm, 0x25 );	// and rax, TRACE_ENTRIES - 1
+	jitEmit32( vm, (uint32_t)( TRACE_ENTRIES - 1 ) );
+	jitEmit8( vm, 0x48 ); jitEmit8( vm, 0xC1 ); jitEmit8( vm, 0xE0 ); jitEmit8( vm, 0x03 );	// shl rax, 3
+	jitRex( vm, JIT_RAX, JIT_RDI );			// add rax, [rdi + traceRing]
+	jitEmit8( vm, 0x03 );
+	jitModRM( vm, 2, JIT_RAX, JIT_RDI );
+	jitEmit32( vm, JIT_VM_OFFSET( traceRing ) );
+	jitStoreField( vm, JIT_VM_OFFSET( traceEntry ), JIT_RAX );
+	jitEmit8( vm, 0x48 ); jitEmit8( vm, 0xC7 ); jitEmit8( vm, 0x00 );	// mov qword [rax], end
+	jitEmit32( vm, (uint32_t)end );
+	jitEmit8( vm, 0x48 );				// mov qword [rdi + traceLast], end
+	jitEmit8( vm, 0xC7 );
+	jitModRM( vm, 2, 0, JIT_RDI );
+	jitEmit32( vm, JIT_VM_OFFSET( traceLast ) );
+	jitEmit32( vm, (uint32_t)end );
+	jitEmit8( vm, 0x48 );				// inc qword [rdi + traceCount]
+	jitEmit8( vm, 0xFF );
+	jitModRM( vm, 2, 0, JIT_RDI );
+	jitEmit32( vm, JIT_VM_OFFSET( traceCount ) );
+
+	jitPatchRel32( vm, done, vm->jitCodeSize );
+}
+
+ubyte_t x8000_jit( struct x8000_vm* vm, struct x8000_op* op ) {
+	vm->opCursor = vm->jitEnter( vm->registers.regs, vm->jitBlocks[ op - vm->ops ] );
+
+	// Where compiled code leaves off is as hot as a branch target
+	jitCount( vm, vm->opCursor );
+
+	return INSTRUCTION_STATUS_SUCCESS;
+}
+// ==================== JIT ====================
+
+// ==================== Memory ====================
+void initMemory( struct x8000_vm* vm ) {
+	vm->memoryBase = NULL;
+	vm->memoryMask = UINTPTR_MAX;
+	vm->memoryTop = MEMORY_GUARD_SIZE;
+	vm->memoryRanges = NULL;
+	vm->memoryRangesCount = 0;
+	vm->memoryRangesCapacity = 0;
+	vm->memoryFaultAddress = 0;
+
+	if ( vm->memorySandbox == false ) {
+		return;
+	}
+
+	void* region = mmap( NULL, MEMORY_RESERVE_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+	if ( region == MAP_FAILED ) {
+		fprintf( stdout, "Error: Cannot reserve guest memory.\n" );
+		exit( EXIT_FAILURE );
+	}
+
+	vm->memoryBase = (ubyte_t*)region;
+	vm->memoryMask = UINT32_MAX;
+
+	if ( mprotect( vm->memoryBase + MEMORY_GUARD_SIZE, vm->memoryLimit, PROT_READ | PROT_WRITE ) != 0 ) {
+		fprintf( stdout, "Error: Cannot commit guest memory.\n" );
+		exit( EXIT_FAILURE );
+	}
+
+	struct sigaction action;
+	memset( &action, 0, sizeof( action ) );
+	action.sa_sigaction = memoryFault;
+	action.sa_flags = SA_SIGINFO;
+	sigemptyset( &action.sa_mask );
+	sigaction( SIGSEGV, &action, NULL );
+	sigaction( SIGBUS, &action, NULL );
+}
+
+void freeMemory( struct x8000_vm* vm ) {
+	if ( vm->memoryBase != NULL ) {
+		munmap( vm->memoryBase, MEMORY_RESERVE_SIZE );
+		vm->memoryBase = NULL;
+	}
+
+	free( vm->memoryRanges );
+	vm->memoryRanges = NULL;
+	vm->memoryRangesCount = 0;
+	vm->memoryRangesCapacity = 0;
+}
+
+void* guestPointer( struct x8000_vm* vm, x8000_address_t address, size_t size ) {
+	if ( vm->memorySandbox == false ) {
+		return (void*)address;
+	}
+
+	// Anything inside the reservation is left to the guard pages
+	if ( address > MEMORY_RESERVE_SIZE || size > MEMORY_RESERVE_SIZE - address ) {
+		return NULL;
+	}
+
+	return vm->memoryBase + address;
+}
+
+x8000_address_t memoryAlloc( struct x8000_vm* vm, size_t size, size_t align ) {
+	size_t limit = MEMORY_GUARD_SIZE + vm->memoryLimit;
+	size_t block = ( size + MEMORY_ALIGN - 1 ) & ~( MEMORY_ALIGN - 1 );
+
+	if ( size > vm->memoryLimit ) {
+		return NULL_ADDRESS;
+	}
+
+	// First fit among the released ranges, lowest address first
+	for ( size_t i = 0; i < vm->memoryRangesCount; i++ ) {
+		struct memoryRange* range = &vm->memoryRanges[ i ];
+		size_t address = ( range->address + align - 1 ) & ~( align - 1 );
+		size_t end = range->address + range->size;
+
+		if ( address > end || block > end - address ) {
+			continue;
+		}
+
+		size_t front = address - range->address;
+		size_t back = end - address - block;
+
+		if ( front != 0 && back != 0 ) {
+			// Split in two, the slot has to exist before the range is touched
+			if ( memoryRangesGrow( vm ) == false ) {
+				return NULL_ADDRESS;
+			}
+
+			range = &vm->memoryRanges[ i ];
+			memmove( range + 2, range + 1, ( vm->memoryRangesCount - i - 1 ) * sizeof( struct memoryRange ) );
+			range[ 1 ].address = address + block;
+			range[ 1 ].size = back;
+			range->size = front;
+			vm->memoryRangesCount++;
+		}else if ( front != 0 ) {
+			range->size = front;
+		}else if ( back != 0 ) {
+			range->address = address + block;
+			range->size = back;
+		}else {
+			memmove( range, range + 1, ( vm->memoryRangesCount - i - 1 ) * sizeof( struct memoryRange ) );
+			vm->memoryRangesCount--;
+		}
+
+		return (x8000_address_t)address;
+	}
+
+	size_t top = vm->memoryTop;
+	size_t address = ( top + align - 1 ) & ~( align - 1 );
+
+	if ( address > limit || block > limit - address ) {
+		return NULL_ADDRESS;
+	}
+
+	vm->memoryTop = address + block;
+
+	// What the alignment skipped over is free for smaller chunks
+	if ( address != top ) {
+		memoryRelease( vm, (x8000_address_t)top, address - top );
+	}
+
+	return (x8000_address_t)address;
+}
+
+void memoryRelease( struct x8000_vm* vm, x8000_address_t address, size_t size ) {
+	size_t block = ( size + MEMORY_ALIGN - 1 ) & ~( MEMORY_ALIGN - 1 );
+	size_t low = 0;
+	size_t high = vm->memoryRangesCount;
+
+	if ( address == NULL_ADDRESS || block == 0 ) {
+		return;
+	}
+
+	// The first range above the chunk
+	while ( low < high ) {
+		size_t middle = low + ( high - low ) / 2;
+
+		if ( vm->memoryRanges[ middle ].address < address ) {
+			low = middle + 1;
+		}else {
+			high = middle;
+		}
+	}
+
+	struct memoryRange* ranges = vm->memoryRanges;
+	bool before = low > 0 && ranges[ low - 1 ].address + ranges[ low - 1 ].size == address;
+	bool after = low < vm->memoryRangesCount && address + block == ranges[ low ].address;
+	size_t index = low;
+
+	if ( before && after ) {
+		ranges[ low - 1 ].size += block + ranges[ low ].size;
+		memmove( ranges + low, ranges + low + 1, ( vm->memoryRangesCount - low - 1 ) * sizeof( struct memoryRange ) );
+		vm->memoryRangesCount--;
+		index = low - 1;
+	}else if ( before ) {
+		ranges[ low - 1 ].size += block;
+		index = low - 1;
+	}else if ( after ) {
+		ranges[ low ].address = address;
+		ranges[ low ].size += block;
+	}else {
+		// Out of host memory for the list, the chunk stays lost until exit
+		if ( memoryRangesGrow( vm ) == false ) {
+			return;
+		}
+
+		ranges = vm->memoryRanges;
+		memmove( ranges + low + 1, ranges + low, ( vm->memoryRangesCount - low ) * sizeof( struct memoryRange ) );
+		ranges[ low ].address = address;
+		ranges[ low ].size = block;
+		vm->memoryRangesCount++;
+	}
+
+	// A range that reaches the top goes back to the bump pointer
+	if ( index == vm->memoryRangesCount - 1 && ranges[ index ].address + ranges[ index ].size == vm->memoryTop ) {
+		vm->memoryTop = ranges[ index ].address;
+		vm->memoryRangesCount--;
+	}
+}
+
+bool memoryRangesGrow( struct x8000_vm* vm ) {
+	if ( vm->memoryRangesCount < vm->memoryRangesCapacity ) {
+		return true;
+	}
+
+	size_t capacity = vm->memoryRangesCapacity == 0 ? HEAP_TABLE_MIN : vm->memoryRangesCapacity * 2;
+	struct memoryRange* ranges = (struct memoryRange*)realloc( vm->memoryRanges, capacity * sizeof( struct memoryRange ) );
+
+	if ( ranges == NULL ) {
+		return false;
+	}
+
+	vm->memoryRanges = ranges;
+	vm->memoryRangesCapacity = capacity;
+
+	return true;
+}
+
+void memoryFault( int sig, siginfo_t* info, void* context ) {
+	struct x8000_vm* vm = memoryFaultVm;
+	uintptr_t address = (uintptr_t)info->si_addr;
+	uintptr_t base = vm == NULL ? 0 : (uintptr_t)vm->memoryBase;
+
+	if ( vm == NULL || vm->memoryBase == NULL || address < base || address >= base + MEMORY_RESERVE_SIZE ) {
+		// Not a guest access, crash the way we would have without the handler
+		signal( sig, SIG_DFL );
+		return;
+	}
+
+	vm->memoryFaultAddress = address - base;
+	siglongjmp( vm->memoryFaultJump, 1 );
+}
+// ==================== Memory ====================
+
+// ==================== Heap ====================
+void initHeap( struct x8000_vm* vm ) {
+	memset( vm->heapClasses, 0, sizeof( vm->heapClasses ) );
+	vm->heapTable = NULL;
+	vm->heapTableSize = 0;
+	vm->heapBlocks = 0;
+	vm->heapLargeAllocs = 0;
+	vm->heapLargeFrees = 0;
+}
+
+void freeHeap( struct x8000_vm* vm ) {
+	if ( vm->heapStats ) {
+		printHeapStats( vm );
+	}
+
+	for ( size_t i = 0; i < vm->heapTableSize; i++ ) {
+		struct heapBlock* block = vm->heapTable[ i ];
+
+		while ( block != NULL ) {
+			struct heapBlock* _next = block->next;
+
+			// In the sandbox the chunks live in the guest region and go with it
+			if ( vm->memorySandbox == false ) {
+				free( (void*)block->address );
+			}
+
+			free( block );
+			block = _next;
+		}
+	}
+
+	for ( size_t i = 0; i < HEAP_CLASSES_COUNT; i++ ) {
+		free( vm->heapClasses[ i ].freeList );
+	}
+
+	free( vm->heapTable );
+	memset( vm->heapClasses, 0, sizeof( vm->heapClasses ) );
+	vm->heapTable = NULL;
+	vm->heapTableSize = 0;
+	vm->heapBlocks = 0;
+}
+
+void printHeapStats( struct x8000_vm* vm ) {
+	fprintf( stderr, "%-8s %10s %10s %10s %10s %8s\n", "class", "allocs", "frees", "live", "peak", "slabs" );
+
+	for ( size_t i = 0; i < HEAP_CLASSES_COUNT; i++ ) {
+		struct heapClass* cls = &vm->heapClasses[ i ];
+
+		fprintf( stderr, "%-8zu %10zu %10zu %10zu %10zu %8zu\n", HEAP_CLASS_MIN << i, cls->allocs, cls->frees, cls->live, cls->peak, cls->slabs );
+	}
+
+	fprintf( stderr, "%-8s %10zu %10zu %10zu\n", "large", vm->heapLargeAllocs, vm->heapLargeFrees, vm->heapLargeAllocs - vm->heapLargeFrees );
+}
+
+x8000_address_t heapChunk( struct x8000_vm* vm, size_t size, size_t align ) {
+	if ( vm->memorySandbox ) {
+		return memoryAlloc( vm, size, align );
+	}
+
+	void* chunk = align > MEMORY_ALIGN ? aligned_alloc( align, size ) : malloc( size );
+
+	return (x8000_address_t)chunk;
+}
+
+void heapChunkRelease( struct x8000_vm* vm, x8000_address_t address, size_t size ) {
+	if ( vm->memorySandbox ) {
+		memoryRelease( vm, address, size );
+	}else {
+		free( (void*)address );
+	}
+}
+
+x8000_address_t heapAlloc( struct x8000_vm* vm, size_t size ) {
+	size_t index = 0;
+
+	while ( index < HEAP_CLASSES_COUNT && ( HEAP_CLASS_MIN << index ) < size ) {
+		index++;
+	}
+
+	if ( index == HEAP_CLASSES_COUNT ) {
+		x8000_address_t address = heapChunk( vm, size, MEMORY_ALIGN );
+		if ( address == NULL_ADDRESS ) {
+			return NULL_ADDRESS;
+		}
+
+		if ( heapNewBlock( vm, address, HEAP_CLASS_LARGE, size ) == NULL ) {
+			heapChunkRelease( vm, address, size );
+			return NULL_ADDRESS;
+		}
+
+		vm->heapLargeAllocs++;
+
+		return address;
+	}
+
+	struct heapClass* cls = &vm->heapClasses[ index ];
+	size_t width = HEAP_CLASS_MIN << index;
+	x8000_address_t address;
+
+	if ( cls->freeCount != 0 ) {
+		address = cls->freeList[ --cls->freeCount ];
+	}else {
+		// The width divides the slab, so the cursor always lands on end
+		if ( cls->cursor == cls->end ) {
+			x8000_address_t slab = heapChunk( vm, HEAP_SLAB_SIZE, HEAP_SLAB_SIZE );
+			if ( slab == NULL_ADDRESS ) {
+				return NULL_ADDRESS;
+			}
+
+			if ( heapNewBlock( vm, slab, index, HEAP_SLAB_SIZE ) == NULL ) {
+				heapChunkRelease( vm, slab, HEAP_SLAB_SIZE );
+				return NULL_ADDRESS;
+			}
+
+			cls->cursor = slab;
+			cls->end = slab + HEAP_SLAB_SIZE;
+			cls->slabs++;
+		}
+
+		address = cls->cursor;
+		cls->cursor += width;
+	}
+
+	struct heapBlock* slab = heapFind( vm, address & ~( HEAP_SLAB_SIZE - 1 ), false );
+	size_t slot = ( address - slab->address ) / width;
+
+	slab->used[ slot / 64 ] |= (uint64_t)1 << ( slot % 64 );
+
+	cls->allocs++;
+	if ( ++cls->live > cls->peak ) cls->peak = cls->live;
+
+	return address;
+}
+
+x8000_address_t heapRealloc( struct x8000_vm* vm, x8000_address_t address, size_t size ) {
+	if ( address == NULL_ADDRESS ) {
+		return heapAlloc( vm, size );
+	}
+
+	size_t slot;
+	struct heapBlock* block = heapLookup( vm, address, &slot );
+
+	if ( block == NULL ) {
+		fprintf( stderr, "Error: REALLOC of an invalid address 0x%lx.\n", (unsigned long)address );
+		return NULL_ADDRESS;
+	}
+
+	size_t count;
+
+	if ( block->cls != HEAP_CLASS_LARGE ) {
+		count = HEAP_CLASS_MIN << block->cls;
+
+		if ( size <= count ) {
+			return address;
+		}
+	}else if ( vm->memorySandbox == false && size != 0 ) {
+		// Let libc grow the chunk in place when it can
+		void* moved = realloc( (void*)address, size );
+		if ( moved == NULL ) {
+			return NULL_ADDRESS;
+		}
+
+		// The table just lost an entry, putting it back cannot grow it
+		heapRemove( vm, block );
+		block->address = (x8000_address_t)moved;
+		block->size = size;
+		heapInsert( vm, block );
+
+		return block->address;
+	}else {
+		count = block->size;
+	}
+
+	x8000_address_t moved = heapAlloc( vm, size );
+	if ( moved == NULL_ADDRESS ) {
+		return NULL_ADDRESS;
+	}
+
+	if ( count > size ) count = size;
+	if ( count != 0 ) memcpy( GUEST_ACCESS( vm, moved ), GUEST_ACCESS( vm, address ), count );
+	heapRelease( vm, address );
+
+	return moved;
+}
+
+bool heapRelease( struct x8000_vm* vm, x8000_address_t address ) {
+	if ( address == NULL_ADDRESS ) {
+		return true;
+	}
+
+	size_t slot;
+	struct heapBlock* block = heapLookup( vm, address, &slot );
+
+	if ( block == NULL ) {
+		fprintf( stderr, "Error: FREE of an invalid address 0x%lx.\n", (unsigned long)address );
+		return false;
+	}
+
+	if ( block->cls == HEAP_CLASS_LARGE ) {
+		heapRemove( vm, block );
+		heapChunkRelease( vm, address, block->size );
+		free( block );
+		vm->heapLargeFrees++;
+
+		return true;
+	}
+
+	struct heapClass* cls = &vm->heapClasses[ block->cls ];
+
+	block->used[ slot / 64 ] &= ~( (uint64_t)1 << ( slot % 64 ) );
+
+	if ( cls->freeCount == cls->freeCapacity ) {
+		size_t capacity = cls->freeCapacity == 0 ? HEAP_TABLE_MIN : cls->freeCapacity * 2;
+		x8000_address_t* list = (x8000_address_t*)realloc( cls->freeList, capacity * sizeof( x8000_address_t ) );
+
+		if ( list != NULL ) {
+			cls->freeList = list;
+			cls->freeCapacity = capacity;
+		}
+	}
+
+	// A slot that did not fit on the list is only lost until exit
+	if ( cls->freeCount < cls->freeCapacity ) {
+		cls->freeList[ cls->freeCount++ ] = address;
+	}
+
+	cls->frees++;
+	cls->live--;
+
+	return true;
+}
+
+struct heapBlock* heapNewBlock( struct x8000_vm* vm, x8000_address_t address, size_t cls, size_t size ) {
+	size_t bitmap = cls == HEAP_CLASS_LARGE ? 0 : HEAP_SLAB_WORDS * sizeof( uint64_t );
+	struct heapBlock* block = (struct heapBlock*)malloc( sizeof( struct heapBlock ) + bitmap );
+
+	if ( block == NULL ) {
+		return NULL;
+	}
+
+	block->address = address;
+	block->cls = cls;
+	block->size = size;
+	memset( block->used, 0, bitmap );
+
+	if ( heapInsert( vm, block ) == false ) {
+		free( block );
+		return NULL;
+	}
+
+	return block;
+}
+
+bool heapInsert( struct x8000_vm* vm, struct heapBlock* block ) {
+	if ( vm->heapBlocks >= vm->heapTableSize ) {
+		size_t size = vm->heapTableSize == 0 ? HEAP_TABLE_MIN : vm->heapTableSize * 2;
+		struct heapBlock** table = (struct heapBlock**)calloc( size, sizeof( struct heapBlock* ) );
+
+		if ( table == NULL ) {
+			return false;
+		}
+
+		struct heapBlock** old = vm->heapTable;
+		size_t oldSize = vm->heapTableSize;
+
+		vm->heapTable = table;
+		vm->heapTableSize = size;
+
+		for ( size_t i = 0; i < oldSize; i++ ) {
+			struct heapBlock* node = old[ i ];
+
+			while ( node != NULL ) {
+				struct heapBlock* _next = node->next;
+				size_t bucket = heapHash( vm, node->address );
+
+				node->next = table[ bucket ];
+				table[ bucket ] = node;
+				node = _next;
+			}
+		}
+
+		free( old );
+	}
+
+	size_t bucket = heapHash( vm, block->address );
+
+	block->next = vm->heapTable[ bucket ];
+	vm->heapTable[ bucket ] = block;
+	vm->heapBlocks++;
+
+	return true;
+}
+
+void heapRemove( struct x8000_vm* vm, struct heapBlock* block ) {
+	struct heapBlock** link = &vm->heapTable[ heapHash( vm, block->address ) ];
+
+	while ( *link != block ) {
+		link = &( *link )->next;
+	}
+
+	*link = block->next;
+	vm->heapBlocks--;
+}
+
+struct heapBlock* heapFind( struct x8000_vm* vm, x8000_address_t address, bool large ) {
+	if ( vm->heapTableSize == 0 ) {
+		return NULL;
+	}
+
+	struct heapBlock* block = vm->heapTable[ heapHash( vm, address ) ];
+
+	while ( block != NULL && ( block->address != address || ( block->cls == HEAP_CLASS_LARGE ) != large ) ) {
+		block = block->next;
+	}
+
+	return block;
+}
+
+struct heapBlock* heapLookup( struct x8000_vm* vm, x8000_address_t address, size_t* slot ) {
+	// No large chunk overlaps a slab, so an address inside one is a slot or nothing
+	struct heapBlock* block = heapFind( vm, address & ~( HEAP_SLAB_SIZE - 1 ), false );
+
+	if ( block == NULL ) {
+		return heapFind( vm, address, true );
+	}
+
+	size_t width = HEAP_CLASS_MIN << block->cls;
+	size_t offset = address - block->address;
+
+	if ( offset % width != 0 ) {
+		return NULL;
+	}
+
+	*slot = offset / width;
+
+	return ( block->used[ *slot / 64 ] >> ( *slot % 64 ) ) & 1 ? block : NULL;
+}
+
+size_t heapHash( struct x8000_vm* vm, x8000_address_t address ) {
+	// Multiplicative hashing, the low bits of the addresses are mostly zero
+	return (size_t)( ( (uint64_t)address * 0x9E3779B97F4A7C15ULL ) >> 32 ) & ( vm->heapTableSize - 1 );
+}
+// ==================== Heap ====================
+
+// ==================== Output ====================
+void initOutput( struct x8000_vm* vm ) {
+	initOutputBuffer( &vm->outputStdout );
+	initOutputBuffer( &vm->outputStderr );
+}
+
+void freeOutput( struct x8000_vm* vm ) {
+	flushOutput( vm );
+
+	if ( vm->outputStdout.data != NULL ) free( vm->outputStdout.data );
+	if ( vm->outputStderr.data != NULL ) free( vm->outputStderr.data );
+
+	vm->outputStdout.data = NULL;
+	vm->outputStderr.data = NULL;
+}
+
+void initOutputBuffer( struct outputBuffer* output ) {
+	output->size = 0;
+	output->lineBuffered = isatty( output->fd ) == 1;
+	output->data = NULL;
+
+	if ( output->capacity != 0 ) {
+		output->data = (ubyte_t*)malloc( output->capacity );
+
+		if ( output->data == NULL ) {
+			output->capacity = 0;
+		}
+	}
+}
+
+bool flushOutput( struct x8000_vm* vm ) {
+	bool status = outputFlush( &vm->outputStdout );
+	return outputFlush( &vm->outputStderr ) && status;
+}
+
+bool outputFlush( struct outputBuffer* output ) {
+	if ( output->size == 0 ) {
+		return true;
+	}
+
+	bool status = outputWrite( output->fd, output->data, output->size );
+	output->size = 0;
+
+	return status;
+}
+
+bool outputAppend( struct outputBuffer* output, const ubyte_t* data, size_t size ) {
+	if ( size > output->capacity - output->size ) {
+		if ( outputFlush( output ) == false ) {
+			return false;
+		}
+
+		// Too big to be worth copying
+		if ( size >= output->capacity ) {
+			return outputWrite( output->fd, data, size );
+		}
+	}
+
+	memcpy( output->data + output->size, data, size );
+	output->size += size;
+
+	if ( output->lineBuffered && memchr( data, '\n', size ) != NULL ) {
+		return outputFlush( output );
+	}
+
+	return true;
+}
+
+bool outputWrite( int fd, const ubyte_t* data, size_t size ) {
+	while ( size > 0 ) {
+		ssize_t res = write( fd, data, size );
+
+		if ( res < 0 ) {
+			if ( errno == EINTR ) continue;
+			return false;
+		}
+
+		data += res;
+		size -= (size_t)res;
+	}
+
+	return true;
+}
+
+bool outputAppendv( struct outputBuffer* output, struct iovec* vec, int count, size_t total ) {
+	if ( total <= output->capacity - output->size ) {
+		for ( int i = 0; i < count; i++ ) {
+			if ( outputAppend( output, (ubyte_t*)vec[ i ].iov_base, vec[ i ].iov_len ) == false ) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Doesn't fit, send what is buffered and the whole vector to the kernel
+	if ( outputFlush( output ) == false ) {
+		return false;
+	}
+
+	return outputWritev( output->fd, vec, count );
+}
+
+bool outputWritev( int fd, struct iovec* vec, int count ) {
+	while ( count > 0 ) {
+		ssize_t res = writev( fd, vec, count );
+
+		if ( res < 0 ) {
+			if ( errno == EINTR ) continue;
+			return false;
+		}
+
+		// Skip what was written, including a partially written entry
+		while ( count > 0 && (size_t)res >= vec->iov_len ) {
+			res -= (ssize_t)vec->iov_len;
+			vec++;
+			count--;
+		}
+
+		if ( count > 0 ) {
+			vec->iov_base = (ubyte_t*)vec->iov_base + res;
+			vec->iov_len -= (size_t)res;
+		}
+	}
+
+	return true;
+}
+// ==================== Output ====================
+
+// ==================== Async ====================
+void initAsync( struct x8000_vm* vm ) {
+	memset( vm->asyncSlots, 0, sizeof( vm->asyncSlots ) );
+	vm->asyncBackend = ASYNC_BACKEND_NONE;
+	vm->asyncQueue = NULL;
+	vm->asyncQueueTail = NULL;
+	vm->asyncThreadsCount = 0;
+
+#ifdef X8000_IO_URING
+	vm->uringFd = -1;
+	vm->uringSqRing = NULL;
+	vm->uringCqRing = NULL;
+	vm->uringSqes = NULL;
+#endif
+
+	pthread_mutex_init( &vm->asyncLock, NULL );
+	pthread_cond_init( &vm->asyncWork, NULL );
+	pthread_cond_init( &vm->asyncDone, NULL );
+}
+
+void freeAsync( struct x8000_vm* vm ) {
+	if ( vm->asyncBackend != ASYNC_BACKEND_NONE ) {
+		stopAsync( vm );
+	}
+
+	pthread_cond_destroy( &vm->asyncDone );
+	pthread_cond_destroy( &vm->asyncWork );
+	pthread_mutex_destroy( &vm->asyncLock );
+}
+
+void stopAsync( struct x8000_vm* vm ) {
+	// Writes still in flight must reach their descriptor, reads are dropped
+	for ( size_t i = 0; i < ASYNC_SLOTS_COUNT; i++ ) {
+		struct asyncSlot* slot = &vm->asyncSlots[ i ];
+
+		if ( slot->write ) {
+			asyncComplete( vm, slot, true );
+		}
+	}
+
+	if ( vm->asyncBackend == ASYNC_BACKEND_URING ) {
+		uringFree( vm );
+	}else {
+		for ( size_t i = 0; i < vm->asyncThreadsCount; i++ ) {
+			pthread_cancel( vm->asyncThreads[ i ] );
+		}
+
+		for ( size_t i = 0; i < vm->asyncThreadsCount; i++ ) {
+			pthread_join( vm->asyncThreads[ i ], NULL );
+		}
+
+		vm->asyncThreadsCount = 0;
+	}
+
+	vm->asyncBackend = ASYNC_BACKEND_NONE;
+}
+
+bool asyncStart( struct x8000_vm* vm ) {
+	if ( vm->asyncBackend != ASYNC_BACKEND_NONE ) {
+		return true;
+	}
+
+	if ( vm->asyncUring && uringSetup( vm ) ) {
+		vm->asyncBackend = ASYNC_BACKEND_URING;
+		return true;
+	}
+
+	// Keep the workers that did start, one is enough to make progress
+	while ( vm->asyncThreadsCount < ASYNC_THREADS_COUNT &&
+		pthread_create( &vm->asyncThreads[ vm->asyncThreadsCount ], NULL, asyncWorker, vm ) == 0 ) {
+		vm->asyncThreadsCount++;
+	}
+
+	if ( vm->asyncThreadsCount == 0 ) {
+		return false;
+	}
+
+	vm->asyncBackend = ASYNC_BACKEND_THREADS;
+	return true;
+}
+
+x8000_register_t asyncSubmit( struct x8000_vm* vm, bool write, int fd, void* buff, size_t size ) {
+	if ( asyncStart( vm ) == false ) {
+		return NULL_REG;
+	}
+
+	struct asyncSlot* slot = NULL;
+
+	for ( size_t i = 0; i < ASYNC_SLOTS_COUNT; i++ ) {
+		if ( vm->asyncSlots[ i ].state == ASYNC_STATE_FREE ) {
+			slot = &vm->asyncSlots[ i ];
+			break;
+		}
+	}
+
+	if ( slot == NULL ) {
+		return NULL_REG;
+	}
+
+	// Tickets encode the slot and how many times it was used, so stale ones are rejected
+	slot->generation++;
+	slot->ticket = slot->generation * (x8000_register_t)ASYNC_SLOTS_COUNT + ( slot - vm->asyncSlots );
+	slot->write = write;
+	slot->fd = fd;
+	slot->vec.iov_base = buff;
+	slot->vec.iov_len = size;
+	slot->result = NULL_REG;
+	slot->next = NULL;
+
+	if ( vm->asyncBackend == ASYNC_BACKEND_URING ) {
+		slot->state = ASYNC_STATE_PENDING;
+		uringSubmit( vm, slot );
+	}else {
+		pthread_mutex_lock( &vm->asyncLock );
+		slot->state = ASYNC_STATE_PENDING;
+
+		if ( vm->asyncQueueTail == NULL ) {
+			vm->asyncQueue = slot;
+		}else {
+			vm->asyncQueueTail->next = slot;
+		}
+		vm->asyncQueueTail = slot;
+
+		pthread_cond_signal( &vm->asyncWork );
+		pthread_mutex_unlock( &vm->asyncLock );
+	}
+
+	return slot->ticket;
+}
+
+struct asyncSlot* asyncLookup( struct x8000_vm* vm, x8000_register_t ticket ) {
+	if ( ticket < (x8000_register_t)ASYNC_SLOTS_COUNT ) {
+		return NULL;
+	}
+
+	struct asyncSlot* slot = &vm->asyncSlots[ ticket % (x8000_register_t)ASYNC_SLOTS_COUNT ];
+
+	if ( slot->ticket != ticket || slot->state == ASYNC_STATE_FREE ) {
+		return NULL;
+	}
+
+	return slot;
+}
+
+bool asyncComplete( struct x8000_vm* vm, struct asyncSlot* slot, bool wait ) {
+	if ( vm->asyncBackend == ASYNC_BACKEND_URING ) {
+		uringReap( vm, false );
+
+		while ( wait && slot->state == ASYNC_STATE_PENDING ) {
+			// A ring that cannot be waited on any more fails the ticket instead of hanging
+			if ( uringReap( vm, true ) == false ) {
+				slot->result = (x8000_register_t)-errno;
+				slot->state = ASYNC_STATE_DONE;
+			}
+		}
+
+		return slot->state == ASYNC_STATE_DONE;
+	}
+
+	pthread_mutex_lock( &vm->asyncLock );
+
+	while ( wait && slot->state == ASYNC_STATE_PENDING ) {
+		pthread_cond_wait( &vm->asyncDone, &vm->asyncLock );
+	}
+
+	bool done = slot->state == ASYNC_STATE_DONE;
+	pthread_mutex_unlock( &vm->asyncLock );
+
+	return done;
+}
+
+bool uringSetup( struct x8000_vm* vm ) {
+#ifdef X8000_IO_URING
+	struct io_uring_params params;
+	memset( &params, 0, sizeof( params ) );
+
+	int fd = (int)syscall( __NR_io_uring_setup, (unsigned)ASYNC_SLOTS_COUNT, &params );
+	if ( fd < 0 ) {
+		return false;
+	}
+
+	vm->uringFd = fd;
+	vm->uringSqRingSize = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+	vm->uringCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof( struct io_uring_cqe );
+	vm->uringSqesSize = params.sq_entries * sizeof( struct io_uring_sqe );
+
+	if ( params.features & IORING_FEAT_SINGLE_MMAP ) {
+		if ( vm->uringCqRingSize > vm->uringSqRingSize ) vm->uringSqRingSize = vm->uringCqRingSize;
+		vm->uringCqRingSize = 0;
+	}
+
+	vm->uringSqRing = mmap( NULL, vm->uringSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING );
+	if ( vm->uringSqRing == MAP_FAILED ) {
+		vm->uringSqRing = NULL;
+		uringFree( vm );
+		return false;
+	}
+
+	if ( vm->uringCqRingSize == 0 ) {
+		vm->uringCqRing = vm->uringSqRing;
+	}else {
+		vm->uringCqRing = mmap( NULL, vm->uringCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING );
+		if ( vm->uringCqRing == MAP_FAILED ) {
+			vm->uringCqRing = NULL;
+			uringFree( vm );
+			return false;
+		}
+	}
+
+	void* sqes = mmap( NULL, vm->uringSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES );
+	if ( sqes == MAP_FAILED ) {
+		uringFree( vm );
+		return false;
+	}
+
+	vm->uringSqes = (struct io_uring_sqe*)sqes;
+	vm->uringSqHead = (unsigned*)( (ubyte_t*)vm->uringSqRing + params.sq_off.head );
+	vm->uringSqTail = (unsigned*)( (ubyte_t*)vm->uringSqRing + params.sq_off.tail );
+	vm->uringSqMask = (unsigned*)( (ubyte_t*)vm->uringSqRing + params.sq_off.ring_mask );
+	vm->uringSqArray = (unsigned*)( (ubyte_t*)vm->uringSqRing + params.sq_off.array );
+	vm->uringCqHead = (unsigned*)( (ubyte_t*)vm->uringCqRing + params.cq_off.head );
+	vm->uringCqTail = (unsigned*)( (ubyte_t*)vm->uringCqRing + params.cq_off.tail );
+	vm->uringCqMask = (unsigned*)( (ubyte_t*)vm->uringCqRing + params.cq_off.ring_mask );
+	vm->uringCqes = (struct io_uring_cqe*)( (ubyte_t*)vm->uringCqRing + params.cq_off.cqes );
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+void uringFree( struct x8000_vm* vm ) {
+#ifdef X8000_IO_URING
+	if ( vm->uringSqes != NULL ) munmap( vm->uringSqes, vm->uringSqesSize );
+	if ( vm->uringCqRing != NULL && vm->uringCqRing != vm->uringSqRing ) munmap( vm->uringCqRing, vm->uringCqRingSize );
+	if ( vm->uringSqRing != NULL ) munmap( vm->uringSqRing, vm->uringSqRingSize );
+	if ( vm->uringFd >= 0 ) close( vm->uringFd );
+
+	vm->uringSqes = NULL;
+	vm->uringCqRing = NULL;
+	vm->uringSqRing = NULL;
+	vm->uringFd = -1;
+#endif
+}
+
+void uringSubmit( struct x8000_vm* vm, struct asyncSlot* slot ) {
+#ifdef X8000_IO_URING
+	// At most ASYNC_SLOTS_COUNT requests are in flight, so the ring never fills up
+	unsigned tail = *vm->uringSqTail;
+	unsigned index = tail & *vm->uringSqMask;
+	struct io_uring_sqe* sqe = &vm->uringSqes[ index ];
+
+	memset( sqe, 0, sizeof( *sqe ) );
+	sqe->opcode = slot->write ? IORING_OP_WRITEV : IORING_OP_READV;
+	sqe->fd = slot->fd;
+	sqe->addr = (uint64_t)(uintptr_t)&slot->vec;
+	sqe->len = 1;
+	sqe->off = (uint64_t)-1;
+	sqe->user_data = (uint64_t)slot->ticket;
+
+	vm->uringSqArray[ index ] = index;
+	__atomic_store_n( vm->uringSqTail, tail + 1, __ATOMIC_RELEASE );
+
+	long res;
+
+	do {
+		res = syscall( __NR_io_uring_enter, vm->uringFd, 1, 0, 0, NULL, 0 );
+	} while ( res < 0 && errno == EINTR );
+
+	if ( res > 0 ) {
+		return;
+	}
+
+	int error = res < 0 ? errno : EAGAIN;
+
+	// The kernel did not take the entry: take it back and fail the ticket
+	if ( __atomic_load_n( vm->uringSqHead, __ATOMIC_ACQUIRE ) == tail ) {
+		__atomic_store_n( vm->uringSqTail, tail, __ATOMIC_RELEASE );
+		slot->result = (x8000_register_t)-error;
+		slot->state = ASYNC_STATE_DONE;
+	}
+#endif
+}
+
+bool uringReap( struct x8000_vm* vm, bool wait ) {
+#ifdef X8000_IO_URING
+	if ( wait ) {
+		// Interrupted waits just go round again in asyncComplete
+		long res = syscall( __NR_io_uring_enter, vm->uringFd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0 );
+
+		if ( res < 0 && errno != EINTR ) {
+			return false;
+		}
+	}
+
+	unsigned head = *vm->uringCqHead;
+	unsigned tail = __atomic_load_n( vm->uringCqTail, __ATOMIC_ACQUIRE );
+
+	while ( head != tail ) {
+		struct io_uring_cqe* cqe = &vm->uringCqes[ head & *vm->uringCqMask ];
+		x8000_register_t ticket = (x8000_register_t)cqe->user_data;
+		struct asyncSlot* slot = &vm->asyncSlots[ ticket % (x8000_register_t)ASYNC_SLOTS_COUNT ];
+
+		// A ticket already failed by asyncComplete may still finish late
+		if ( slot->ticket == ticket && slot->state == ASYNC_STATE_PENDING ) {
+			slot->result = (x8000_register_t)cqe->res;
+			slot->state = ASYNC_STATE_DONE;
+		}
+
+		head++;
+	}
+
+	__atomic_store_n( vm->uringCqHead, head, __ATOMIC_RELEASE );
+#endif
+
+	return true;
+}
+
+void* asyncWorker( void* arg ) {
+	struct x8000_vm* vm = (struct x8000_vm*)arg;
+
+	// A SIGUSR1 taken here would find no traced VM
+	sigset_t set;
+	sigemptyset( &set );
+	sigaddset( &set, SIGUSR1 );
+	pthread_sigmask( SIG_BLOCK, &set, NULL );
+
+	while ( true ) {
+		struct asyncSlot* slot = NULL;
+
+		// Cancelled while waiting at exit, the lock must not stay held
+		pthread_mutex_lock( &vm->asyncLock );
+		pthread_cleanup_push( asyncUnlock, vm );
+
+		while ( vm->asyncQueue == NULL ) {
+			pthread_cond_wait( &vm->asyncWork, &vm->asyncLock );
+		}
+
+		slot = vm->asyncQueue;
+		vm->asyncQueue = slot->next;
+		if ( vm->asyncQueue == NULL ) vm->asyncQueueTail = NULL;
+
+		pthread_cleanup_pop( 1 );
+
+		ssize_t res = slot->write ? writev( slot->fd, &slot->vec, 1 ) : readv( slot->fd, &slot->vec, 1 );
+
+		pthread_mutex_lock( &vm->asyncLock );
+		slot->result = res < 0 ? (x8000_register_t)-errno : (x8000_register_t)res;
+		slot->state = ASYNC_STATE_DONE;
+		pthread_cond_broadcast( &vm->asyncDone );
+		pthread_mutex_unlock( &vm->asyncLock );
+	}
+
+	return arg;
+}
+
+void asyncUnlock( void* arg ) {
+	struct x8000_vm* vm = (struct x8000_vm*)arg;
+
+	pthread_mutex_unlock( &vm->asyncLock );
+}
+// ==================== Async ====================
+
+// ==================== Snapshot ====================
+bool snapshotSave( struct x8000_vm* vm, const char* path ) {
+	struct snapshotHeader header;
+	size_t stackBytes = vm->stackPointerSize * sizeof( x8000_address_t );
+	size_t heapBytes = vm->heapBlocks * sizeof( struct snapshotBlock );
+
+	for ( size_t i = 0; i < HEAP_CLASSES_COUNT; i++ ) {
+		heapBytes += vm->heapClasses[ i ].freeCount * sizeof( x8000_address_t );
+	}
+
+	heapBytes += vm->memoryRangesCount * sizeof( struct memoryRange );
+
+	memset( &header, 0, sizeof( header ) );
+	memcpy( header.magic, SNAPSHOT_MAGIC, sizeof( header.magic ) );
+	header.version = SNAPSHOT_VERSION;
+	header.headerSize = sizeof( header );
+
+	// The INT that took the snapshot has already moved the cursor past itself
+	header.ip = vm->ops[ vm->opCursor ].ip;
+	materializeFlags( vm );
+	memcpy( header.regs, vm->registers.regs, sizeof( header.regs ) );
+	header.stackSize = vm->stackPointerSize;
+
+	header.programOffset = SNAPSHOT_ALIGN( sizeof( header ) + stackBytes + heapBytes );
+	header.programSize = vm->programSize;
+	header.memoryOffset = SNAPSHOT_ALIGN( header.programOffset + vm->programSize );
+	header.memorySize = SNAPSHOT_ALIGN( vm->memoryTop - MEMORY_GUARD_SIZE );
+	header.memoryLimit = vm->memoryLimit;
+	header.memoryTop = vm->memoryTop;
+	header.memoryRanges = vm->memoryRangesCount;
+	header.memoryBase = (uint64_t)(uintptr_t)vm->memoryBase;
+
+	memcpy( header.heapClasses, vm->heapClasses, sizeof( header.heapClasses ) );
+	header.heapBlocks = vm->heapBlocks;
+	header.heapLargeAllocs = vm->heapLargeAllocs;
+	header.heapLargeFrees = vm->heapLargeFrees;
+
+	int fd = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+	if ( fd < 0 ) {
+		return false;
+	}
+
+	bool status = snapshotWrite( fd, &header, sizeof( header ), 0 )
+		&& snapshotWrite( fd, vm->stackPointer, stackBytes, sizeof( header ) )
+		&& snapshotSaveHeap( vm, fd, (off_t)( sizeof( header ) + stackBytes ) )
+		&& snapshotWrite( fd, vm->program, vm->programSize, header.programOffset )
+		&& snapshotWrite( fd, vm->memoryBase + MEMORY_GUARD_SIZE, header.memorySize, header.memoryOffset )
+		// Pads the last section so it can be mapped in whole pages
+		&& ftruncate( fd, header.memoryOffset + header.memorySize ) == 0;
+
+	if ( close( fd ) != 0 ) {
+		status = false;
+	}
+
+	return status;
+}
+
+bool snapshotOpen( struct x8000_vm* vm, const char* path, struct snapshotHeader* header, int* fd ) {
+	struct stat st;
+
+	*fd = open( path, O_RDONLY );
+	if ( *fd < 0 ) {
+		fprintf( stdout, "Error: Cannot open the specified file.\n" );
+		return false;
+	}
+
+	if (
+		fstat( *fd, &st ) != 0
+		|| !snapshotRead( *fd, header, sizeof( *header ), 0 )
+		|| memcmp( header->magic, SNAPSHOT_MAGIC, sizeof( header->magic ) ) != 0
+		|| header->version != SNAPSHOT_VERSION
+		|| header->headerSize != sizeof( *header )
+		|| header->programSize == 0
+		|| header->memoryLimit == 0
+		|| header->memoryLimit > MEMORY_LIMIT_MAX
+		|| header->memoryLimit != SNAPSHOT_ALIGN( header->memoryLimit )
+		|| header->memorySize > header->memoryLimit
+		|| header->memoryTop < MEMORY_GUARD_SIZE
+		|| header->memoryTop > MEMORY_GUARD_SIZE + header->memorySize
+		|| header->ip > header->programSize
+		|| header->stackSize > ( header->programOffset - sizeof( *header ) ) / sizeof( x8000_address_t )
+		|| header->heapBlocks > ( header->programOffset - sizeof( *header ) - header->stackSize * sizeof( x8000_address_t ) ) / sizeof( struct snapshotBlock )
+		|| header->programOffset != SNAPSHOT_ALIGN( header->programOffset )
+		|| header->memoryOffset != SNAPSHOT_ALIGN( header->memoryOffset )
+		|| header->programOffset + header->programSize > header->memoryOffset
+		|| header->memoryOffset + header->memorySize != (uint64_t)st.st_size
+	) {
+		fprintf( stdout, "Error: Invalid snapshot file.\n" );
+		close( *fd );
+		return false;
+	}
+
+	void* image = mmap( NULL, header->programSize, PROT_READ, MAP_PRIVATE, *fd, (off_t)header->programOffset );
+	if ( image == MAP_FAILED ) {
+		fprintf( stdout, "Error: Cannot read the specified file.\n" );
+		close( *fd );
+		return false;
+	}
+
+	if ( !verifyProgram( (const ubyte_t*)image, header->programSize ) ) {
+		munmap( image, header->programSize );
+		close( *fd );
+		return false;
+	}
+
+	vm->program = (ubyte_t*)image;
+	vm->programSize = header->programSize;
+	vm->programMapSize = header->programSize;
+	vm->programShared = false;
+
+	return true;
+}
+
+bool snapshotRestore( struct x8000_vm* vm, const struct snapshotHeader* header, int fd ) {
+	if ( header->stackSize > vm->stackPointerCapacity ) {
+		fprintf( stdout, "Error: The snapshot call stack is deeper than --stack-depth.\n" );
+		return false;
+	}
+
+	if ( !snapshotRead( fd, vm->stackPointer, header->stackSize * sizeof( x8000_address_t ), sizeof( *header ) ) ) {
+		fprintf( stdout, "Error: Cannot read the specified file.\n" );
+		return false;
+	}
+
+	vm->stackPointerSize = header->stackSize;
+
+	// Mapped over the committed region, untouched pages are never read
+	if ( header->memorySize != 0 ) {
+		void* memory = mmap(
+			vm->memoryBase + MEMORY_GUARD_SIZE,
+			header->memorySize,
+			PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_FIXED,
+			fd,
+			(off_t)header->memoryOffset
+		);
+
+		if ( memory == MAP_FAILED ) {
+			fprintf( stdout, "Error: Cannot map the snapshot memory.\n" );
+			return false;
+		}
+	}
+
+	vm->memoryTop = header->memoryTop;
+
+	if ( !snapshotRestoreHeap( vm, header, fd, (off_t)( sizeof( *header ) + header->stackSize * sizeof( x8000_address_t ) ) ) ) {
+		fprintf( stdout, "Error: Invalid snapshot file.\n" );
+		return false;
+	}
+
+	vm->opCursor = lookupOp( vm, (x8000_address_t)header->ip );
+	if ( vm->opCursor == OP_INDEX_NONE ) {
+		fprintf( stdout, "Error: Invalid snapshot file.\n" );
+		return false;
+	}
+
+	memcpy( vm->registers.regs, header->regs, sizeof( vm->registers.regs ) );
+	restoreFlags( vm );
+
+	// Lets the program tell a resumed run from the one that took the snapshot
+	vm->registers.RR1 = (x8000_register_t)0x1;
+
+	return true;
+}
+
+bool snapshotSaveHeap( struct x8000_vm* vm, int fd, off_t offset ) {
+	struct snapshotBlock record;
+
+	for ( size_t i = 0; i < vm->heapTableSize; i++ ) {
+		for ( struct heapBlock* block = vm->heapTable[ i ]; block != NULL; block = block->next ) {
+			memset( &record, 0, sizeof( record ) );
+			record.address = block->address;
+			record.cls = block->cls;
+			record.size = block->size;
+
+			if ( block->cls != HEAP_CLASS_LARGE ) {
+				memcpy( record.used, block->used, sizeof( record.used ) );
+			}
+
+			if ( !snapshotWrite( fd, &record, sizeof( record ), offset ) ) {
+				return false;
+			}
+
+			offset += sizeof( record );
+		}
+	}
+
+	for ( size_t i = 0; i < HEAP_CLASSES_COUNT; i++ ) {
+		struct heapClass* cls = &vm->heapClasses[ i ];
+		size_t bytes = cls->freeCount * sizeof( x8000_address_t );
+
+		if ( !snapshotWrite( fd, cls->freeList, bytes, offset ) ) {
+			return false;
+		}
+
+		offset += bytes;
+	}
+
+	return snapshotWrite( fd, vm->memoryRanges, vm->memoryRangesCount * sizeof( struct memoryRange ), offset );
+}
+
+bool snapshotRestoreHeap( struct x8000_vm* vm, const struct snapshotHeader* header, int fd, off_t offset ) {
+	struct snapshotBlock record;
+	size_t limit = MEMORY_GUARD_SIZE + vm->memoryLimit;
+
+	memcpy( vm->heapClasses, header->heapClasses, sizeof( vm->heapClasses ) );
+	vm->heapLargeAllocs = header->heapLargeAllocs;
+	vm->heapLargeFrees = header->heapLargeFrees;
+
+	// The saved list pointers mean nothing here, the lists follow the blocks
+	for ( size_t i = 0; i < HEAP_CLASSES_COUNT; i++ ) {
+		vm->heapClasses[ i ].freeList = NULL;
+		vm->heapClasses[ i ].freeCapacity = 0;
+	}
+
+	for ( uint64_t i = 0; i < header->heapBlocks; i++ ) {
+		if ( !snapshotRead( fd, &record, sizeof( record ), offset ) ) {
+			return false;
+		}
+
+		offset += sizeof( record );
+
+		bool large = record.cls == HEAP_CLASS_LARGE;
+
+		if (
+			( large == false && ( record.cls >= HEAP_CLASSES_COUNT || record.address % HEAP_SLAB_SIZE != 0 ) )
+			|| record.address < MEMORY_GUARD_SIZE
+			|| record.address > limit
+			|| record.size > limit - record.address
+		) {
+			return false;
+		}
+
+		struct heapBlock* block = heapNewBlock( vm, (x8000_address_t)record.address, (size_t)record.cls, (size_t)record.size );
+		if ( block == NULL ) {
+			return false;
+		}
+
+		if ( large == false ) {
+			memcpy( block->used, record.used, sizeof( record.used ) );
+		}
+	}
+
+	for ( size_t i = 0; i < HEAP_CLASSES_COUNT; i++ ) {
+		struct heapClass* cls = &vm->heapClasses[ i ];
+		size_t count = cls->freeCount;
+		size_t width = HEAP_CLASS_MIN << i;
+
+		cls->freeCount = 0;
+
+		// The cursor has to point into a slab of its own class
+		if ( cls->cursor != cls->end ) {
+			struct heapBlock* slab = heapFind( vm, cls->end - HEAP_SLAB_SIZE, false );
+
+			if ( slab == NULL || slab->cls != i || cls->cursor < slab->address || cls->cursor > cls->end || ( cls->cursor - slab->address ) % width != 0 ) {
+				return false;
+			}
+		}
+
+		if ( count == 0 ) {
+			continue;
+		}
+
+		if ( count > vm->memoryLimit / HEAP_CLASS_MIN ) {
+			return false;
+		}
+
+		cls->freeList = (x8000_address_t*)malloc( count * sizeof( x8000_address_t ) );
+		if ( cls->freeList == NULL ) {
+			return false;
+		}
+
+		cls->freeCapacity = count;
+
+		if ( !snapshotRead( fd, cls->freeList, count * sizeof( x8000_address_t ), offset ) ) {
+			return false;
+		}
+
+		offset += count * sizeof( x8000_address_t );
+		cls->freeCount = count;
+
+		// Every entry has to be a free slot of this class
+		for ( size_t j = 0; j < count; j++ ) {
+			size_t slot;
+			struct heapBlock* slab = heapFind( vm, cls->freeList[ j ] & ~( HEAP_SLAB_SIZE - 1 ), false );
+
+			if ( slab == NULL || slab->cls != i || heapLookup( vm, cls->freeList[ j ], &slot ) != NULL || ( cls->freeList[ j ] - slab->address ) % width != 0 ) {
+				return false;
+			}
+		}
+	}
+
+	if ( header->memoryRanges == 0 ) {
+		return true;
+	}
+
+	if ( header->memoryRanges > vm->memoryLimit / MEMORY_ALIGN ) {
+		return false;
+	}
+
+	vm->memoryRangesCount = 0;
+	vm->memoryRangesCapacity = (size_t)header->memoryRanges;
+	vm->memoryRanges = (struct memoryRange*)malloc( vm->memoryRangesCapacity * sizeof( struct memoryRange ) );
+
+	if ( vm->memoryRanges == NULL || !snapshotRead( fd, vm->memoryRanges, vm->memoryRangesCapacity * sizeof( struct memoryRange ), offset ) ) {
+		return false;
+	}
+
+	vm->memoryRangesCount = vm->memoryRangesCapacity;
+
+	// Sorted, apart from each other and below memoryTop, as memoryRelease leaves them
+	size_t previous = MEMORY_GUARD_SIZE;
+
+	for ( size_t i = 0; i < vm->memoryRangesCount; i++ ) {
+		struct memoryRange* range = &vm->memoryRanges[ i ];
+
+		if (
+			range->address < previous
+			|| ( i != 0 && range->address == previous )
+			|| range->address % MEMORY_ALIGN != 0
+			|| range->address >= vm->memoryTop
+			|| range->size == 0
+			|| range->size % MEMORY_ALIGN != 0
+			|| range->size >= vm->memoryTop - range->address
+		) {
+			return false;
+		}
+
+		previous = range->address + range->size;
+	}
+
+	return true;
+}
+
+bool snapshotWrite( int fd, const void* data, size_t size, off_t offset ) {
+	const ubyte_t* bytes = (const ubyte_t*)data;
+
+	while ( size > 0 ) {
+		ssize_t n = pwrite( fd, bytes, size, offset );
+
+		if ( n < 0 ) {
+			if ( errno == EINTR ) {
+				continue;
+			}
+
+			return false;
+		}
+
+		bytes += n;
+		size -= (size_t)n;
+		offset += n;
+	}
+
+	return true;
+}
+
+bool snapshotRead( int fd, void* data, size_t size, off_t offset ) {
+	ubyte_t* bytes = (ubyte_t*)data;
+
+	while ( size > 0 ) {
+		ssize_t n = pread( fd, bytes, size, offset );
+
+		if ( n == 0 ) {
+			return false;
+		}else if ( n < 0 ) {
+			if ( errno == EINTR ) {
+				continue;
+			}
+
+			return false;
+		}
+
+		bytes += n;
+		size -= (size_t)n;
+		offset += n;
+	}
+
+	return true;
+}
+// ==================== Snapshot ====================
+
+// ==================== Fork Server ====================
+bool forkServe( struct x8000_vm* vm ) {
+	struct sockaddr_un address;
+
+	if ( vm->asyncBackend != ASYNC_BACKEND_NONE ) {
+		fprintf( stdout, "Error: The fork server cannot start after asynchronous I/O.\n" );
+		return false;
+	}
+
+	if ( strlen( vm->forkServer ) >= sizeof( address.sun_path ) ) {
+		fprintf( stdout, "Error: The fork server path is too long.\n" );
+		return false;
+	}
+
+	struct forkResult* result = (struct forkResult*)mmap( NULL, sizeof( struct forkResult ), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+	if ( result == MAP_FAILED ) {
+		fprintf( stdout, "Error: Cannot start the fork server.\n" );
+		return false;
+	}
+
+	memset( &address, 0, sizeof( address ) );
+	address.sun_family = AF_UNIX;
+	strcpy( address.sun_path, vm->forkServer );
+	unlink( vm->forkServer );
+
+	int server = socket( AF_UNIX, SOCK_STREAM, 0 );
+
+	if ( server < 0 || bind( server, (struct sockaddr*)&address, sizeof( address ) ) != 0 || listen( server, FORK_BACKLOG ) != 0 ) {
+		fprintf( stdout, "Error: Cannot listen on %s.\n", vm->forkServer );
+		if ( server >= 0 ) close( server );
+		munmap( result, sizeof( struct forkResult ) );
+		return false;
+	}
+
+	// Every child would write out whatever is still buffered again
+	flushOutput( vm );
+
+	while ( true ) {
+		int fds[ FORK_FDS_COUNT ];
+		int client = accept( server, NULL, NULL );
+
+		if ( client < 0 ) {
+			if ( errno == EINTR || errno == ECONNABORTED ) {
+				continue;
+			}
+
+			fprintf( stdout, "Error: The fork server stopped accepting requests.\n" );
+			exit( EXIT_FAILURE );
+		}
+
+		if ( !forkRequest( client, fds ) ) {
+			close( client );
+			continue;
+		}
+
+		result->exitCode = X8000_EXIT_FAILURE;
+		result->instructionCount = 0;
+
+		pid_t pid = fork();
+
+		if ( pid == 0 ) {
+			close( server );
+			close( client );
+
+			for ( int i = 0; i < FORK_FDS_COUNT; i++ ) {
+				if ( fds[ i ] != i ) {
+					dup2( fds[ i ], i );
+					close( fds[ i ] );
+				}
+			}
+
+			vm->inputFd = STDIN_FILENO;
+			vm->outputStdout.fd = STDOUT_FILENO;
+			vm->outputStdout.lineBuffered = isatty( STDOUT_FILENO ) == 1;
+			vm->outputStderr.fd = STDERR_FILENO;
+			vm->outputStderr.lineBuffered = isatty( STDERR_FILENO ) == 1;
+
+			// Only the run after the fork point is counted, and it does not serve again
+			vm->instructionCount = 0;
+			vm->forkServer = NULL;
+			vm->forkResult = result;
+
+			return true;
+		}
+
+		for ( int i = 0; i < FORK_FDS_COUNT; i++ ) {
+			close( fds[ i ] );
+		}
+
+		if ( pid > 0 ) {
+			int status = 0;
+
+			while ( waitpid( pid, &status, 0 ) < 0 && errno == EINTR );
+
+			if ( WIFSIGNALED( status ) ) {
+				result->exitCode = FORK_SIGNAL_EXIT + WTERMSIG( status );
+			}
+		}
+
+		send( client, result, sizeof( struct forkResult ), MSG_NOSIGNAL );
+		close( client );
+	}
+}
+
+bool forkRequest( int client, int* fds ) {
+	ubyte_t bt;
+	struct iovec vec = { &bt, sizeof( bt ) };
+	union {
+		char buff[ CMSG_SPACE( sizeof( int ) * FORK_FDS_COUNT ) ];
+		struct cmsghdr align;
+	} control;
+	struct msghdr message;
+	int received = 0;
+
+	memset( &message, 0, sizeof( message ) );
+	message.msg_iov = &vec;
+	message.msg_iovlen = 1;
+	message.msg_control = control.buff;
+	message.msg_controllen = sizeof( control.buff );
+
+	ssize_t n;
+	while ( ( n = recvmsg( client, &message, 0 ) ) < 0 && errno == EINTR );
+
+	if ( n <= 0 ) {
+		return false;
+	}
+
+	for ( struct cmsghdr* cmsg = CMSG_FIRSTHDR( &message ); cmsg != NULL; cmsg = CMSG_NXTHDR( &message, cmsg ) ) {
+		if ( cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS ) {
+			received = (int)( ( cmsg->cmsg_len - CMSG_LEN( 0 ) ) / sizeof( int ) );
+			memcpy( fds, CMSG_DATA( cmsg ), sizeof( int ) * received );
+			break;
+		}
+	}
+
+	for ( int i = received; i < FORK_FDS_COUNT; i++ ) {
+		fds[ i ] = open( "/dev/null", O_RDWR );
+
+		if ( fds[ i ] < 0 ) {
+			while ( i-- > 0 ) close( fds[ i ] );
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void forkFinish( struct x8000_vm* vm ) {
+	if ( vm->forkResult != NULL ) {
+		vm->forkResult->exitCode = vm->exitCode;
+		vm->forkResult->instructionCount = vm->instructionCount;
+	}
+}
+// ==================== Fork Server ====================
+
+// ==================== Profile ====================
+void initProfile( struct x8000_vm* vm ) {
+#ifdef X8000_PROFILE
+	vm->profileOps = NULL;
+	vm->profileLast = NULL;
+	vm->profileTime = 0;
+	memset( vm->profileSyscalls, 0, sizeof( vm->profileSyscalls ) );
+
+	if ( vm->profile ) {
+		vm->profileOps = (struct profileCounter*)calloc( vm->opsSize, sizeof( struct profileCounter ) );
+	}
+#endif
+}
+
+void freeProfile( struct x8000_vm* vm ) {
+#ifdef X8000_PROFILE
+	if ( vm->profileOps == NULL ) {
+		return;
+	}
+
+	profileReport( vm, stderr );
+
+	if ( vm->profileJsonPath != NULL ) {
+		FILE* file = fopen( vm->profileJsonPath, "w" );
+
+		if ( file != NULL ) {
+			profileJson( vm, file );
+		}
+
+		if ( file == NULL || fclose( file ) != 0 ) {
+			fprintf( stderr, "Error: Cannot write %s.\n", vm->profileJsonPath );
+		}
+	}
+
+	free( vm->profileOps );
+	vm->profileOps = NULL;
+#endif
+}
+
+uint64_t profileClock() {
+#if defined( X8000_PROFILE ) && defined( __x86_64__ )
+	return __rdtsc();
+#else
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+#endif
+}
+
+void profileStep( struct x8000_vm* vm, struct x8000_op* op ) {
+#ifdef X8000_PROFILE
+	uint64_t now = profileClock();
+
+	// An op is charged everything up to the next dispatch
+	if ( vm->profileLast != NULL ) {
+		vm->profileOps[ vm->profileLast - vm->ops ].ticks += now - vm->profileTime;
+	}
+
+	vm->profileOps[ op - vm->ops ].count++;
+	vm->profileLast = op;
+	vm->profileTime = now;
+#endif
+}
+
+void profileStop( struct x8000_vm* vm ) {
+#ifdef X8000_PROFILE
+	if ( vm->profileOps != NULL && vm->profileLast != NULL ) {
+		vm->profileOps[ vm->profileLast - vm->ops ].ticks += profileClock() - vm->profileTime;
+		vm->profileLast = NULL;
+	}
+#endif
+}
+
+ubyte_t profileSyscall( struct x8000_vm* vm ) {
+	x8000_register_t rk = vm->registers.RK;
+#ifdef X8000_PROFILE
+	uint64_t start = profileClock();
+#endif
+
+	ubyte_t status = x8000_syscall(
+		vm,
+		rk,
+		vm->registers.RP1,
+		vm->registers.RP2,
+		vm->registers.RP3,
+		vm->registers.RP4,
+		vm->registers.RP5,
+		vm->registers.RP6,
+		vm->registers.RP7,
+		vm->registers.RP8
+	);
+
+#ifdef X8000_PROFILE
+	if ( rk < PROFILE_SYSCALLS_COUNT ) {
+		vm->profileSyscalls[ rk ].count++;
+		vm->profileSyscalls[ rk ].ticks += profileClock() - start;
+	}
+#endif
+
+	return status;
+}
+
+void profileReport( struct x8000_vm* vm, FILE* file ) {
+#ifdef X8000_PROFILE
+	struct profileRow* rows = (struct profileRow*)malloc( sizeof( struct profileRow ) * ( vm->opsSize + PROFILE_OPCODES_COUNT ) );
+	uint64_t total = 0;
+
+	if ( rows == NULL ) {
+		return;
+	}
+
+	for ( size_t i = 0; i < vm->opsSize; i++ ) {
+		total += vm->profileOps[ i ].ticks;
+	}
+
+	if ( total == 0 ) {
+		total = 1;
+	}
+
+	size_t count = profileRows( vm, PROFILE_TABLE_OPCODES, rows );
+
+	fprintf( file, "%-10s %14s %18s %7s\n", "opcode", "count", "ticks", "ticks%" );
+
+	for ( size_t i = 0; i < count; i++ ) {
+		fprintf(
+			file,
+			"%-10s %14llu %18llu %6.2f%%\n",
+			opcodeName( (ubyte_t)rows[ i ].index ),
+			(unsigned long long)rows[ i ].counter.count,
+			(unsigned long long)rows[ i ].counter.ticks,
+			100.0 * rows[ i ].counter.ticks / total
+		);
+	}
+
+	count = profileRows( vm, PROFILE_TABLE_SYSCALLS, rows );
+
+	if ( count != 0 ) {
+		fprintf( file, "\n%-10s %14s %18s %7s\n", "syscall", "count", "ticks", "ticks%" );
+	}
+
+	for ( size_t i = 0; i < count; i++ ) {
+		fprintf(
+			file,
+			"%-10s %14llu %18llu %6.2f%%\n",
+			syscallName( rows[ i ].index ),
+			(unsigned long long)rows[ i ].counter.count,
+			(unsigned long long)rows[ i ].counter.ticks,
+			100.0 * rows[ i ].counter.ticks / total
+		);
+	}
+
+	count = profileRows( vm, PROFILE_TABLE_IPS, rows );
+
+	fprintf( file, "\n%-10s %-10s %14s %18s %7s\n", "ip", "opcode", "count", "ticks", "ticks%" );
+
+	for ( size_t i = 0; i < count && i < PROFILE_TOP_IPS; i++ ) {
+		struct x8000_op* op = &vm->ops[ rows[ i ].index ];
+
+		fprintf(
+			file,
+			"0x%08llx %-10s %14llu %18llu %6.2f%%\n",
+			(unsigned long long)op->ip,
+			opcodeName( op->opcode ),
+			(unsigned long long)rows[ i ].counter.count,
+			(unsigned long long)rows[ i ].counter.ticks,
+			100.0 * rows[ i ].counter.ticks / total
+		);
+	}
+
+	free( rows );
+#endif
+}
+
+void profileJson( struct x8000_vm* vm, FILE* file ) {
+#ifdef X8000_PROFILE
+	struct profileRow* rows = (struct profileRow*)malloc( sizeof( struct profileRow ) * ( vm->opsSize + PROFILE_OPCODES_COUNT ) );
+
+	if ( rows == NULL ) {
+		return;
+	}
+
+	fprintf( file, "{\n\t\"instructions\": %llu,\n\t\"opcodes\": [", (unsigned long long)vm->instructionCount );
+
+	size_t count = profileRows( vm, PROFILE_TABLE_OPCODES, rows );
+
+	for ( size_t i = 0; i < count; i++ ) {
+		fprintf(
+			file,
+			"%s\n\t\t{ \"opcode\": \"%s\", \"count\": %llu, \"ticks\": %llu }",
+			i == 0 ? "" : ",",
+			opcodeName( (ubyte_t)rows[ i ].index ),
+			(unsigned long long)rows[ i ].counter.count,
+			(unsigned long long)rows[ i ].counter.ticks
+		);
+	}
+
+	fprintf( file, "\n\t],\n\t\"syscalls\": [" );
+	count = profileRows( vm, PROFILE_TABLE_SYSCALLS, rows );
+
+	for ( size_t i = 0; i < count; i++ ) {
+		fprintf(
+			file,
+			"%s\n\t\t{ \"code\": %zu, \"name\": \"%s\", \"count\": %llu, \"ticks\": %llu }",
+			i == 0 ? "" : ",",
+			rows[ i ].index,
+			syscallName( rows[ i ].index ),
+			(unsigned long long)rows[ i ].counter.count,
+			(unsigned long long)rows[ i ].counter.ticks
+		);
+	}
+
+	fprintf( file, "\n\t],\n\t\"ips\": [" );
+	count = profileRows( vm, PROFILE_TABLE_IPS, rows );
+
+	for ( size_t i = 0; i < count; i++ ) {
+		struct x8000_op* op = &vm->ops[ rows[ i ].index ];
+
+		fprintf(
+			file,
+			"%s\n\t\t{ \"ip\": %llu, \"opcode\": \"%s\", \"count\": %llu, \"ticks\": %llu }",
+			i == 0 ? "" : ",",
+			(unsigned long long)op->ip,
+			opcodeName( op->opcode ),
+			(unsigned long long)rows[ i ].counter.count,
+			(unsigned long long)rows[ i ].counter.ticks
+		);
+	}
+
+	fprintf( file, "\n\t]\n}\n" );
+	free( rows );
+#endif
+}
+
+size_t profileRows( struct x8000_vm* vm, ubyte_t table, struct profileRow* rows ) {
+	size_t count = 0;
+
+#ifdef X8000_PROFILE
+	if ( table == PROFILE_TABLE_OPCODES ) {
+		memset( rows, 0, sizeof( struct profileRow ) * PROFILE_OPCODES_COUNT );
+
+		for ( size_t i = 0; i < PROFILE_OPCODES_COUNT; i++ ) {
+			rows[ i ].index = i;
+		}
+
+		for ( size_t i = 0; i < vm->opsSize; i++ ) {
+			struct profileRow* row = &rows[ vm->ops[ i ].opcode ];
+
+			row->counter.count += vm->profileOps[ i ].count;
+			row->counter.ticks += vm->profileOps[ i ].ticks;
+		}
+
+		count = PROFILE_OPCODES_COUNT;
+	}else {
+		struct profileCounter* counters = table == PROFILE_TABLE_SYSCALLS ? vm->profileSyscalls : vm->profileOps;
+		count = table == PROFILE_TABLE_SYSCALLS ? PROFILE_SYSCALLS_COUNT : vm->opsSize;
+
+		for ( size_t i = 0; i < count; i++ ) {
+			rows[ i ].index = i;
+			rows[ i ].counter = counters[ i ];
+		}
+	}
+
+	// Only what ran, most expensive first
+	size_t used = 0;
+
+	for ( size_t i = 0; i < count; i++ ) {
+		if ( rows[ i ].counter.count != 0 ) {
+			rows[ used++ ] = rows[ i ];
+		}
+	}
+
+	count = used;
+	qsort( rows, count, sizeof( struct profileRow ), profileCompare );
+#endif
+
+	return count;
+}
+
+int profileCompare( const void* a, const void* b ) {
+	const struct profileRow* x = (const struct profileRow*)a;
+	const struct profileRow* y = (const struct profileRow*)b;
+
+	if ( x->counter.ticks != y->counter.ticks ) {
+		return x->counter.ticks < y->counter.ticks ? 1 : -1;
+	}
+
+	if ( x->counter.count != y->counter.count ) {
+		return x->counter.count < y->counter.count ? 1 : -1;
+	}
+
+	return x->index < y->index ? -1 : ( x->index > y->index );
+}
+
+const char* opcodeName( ubyte_t opcode ) {
+	switch ( opcode ) {
+	case X8000_LOAD_8: return "LOAD_8";
+	case X8000_LOAD_16: return "LOAD_16";
+	case X8000_LOAD_32: return "LOAD_32";
+	case X8000_LOAD_64: return "LOAD_64";
+	case X8000_STORE_8: return "STORE_8";
+	case X8000_STORE_16: return "STORE_16";
+	case X8000_STORE_32: return "STORE_32";
+	case X8000_STORE_64: return "STORE_64";
+	case X8000_MOV_R: return "MOV_R";
+	case X8000_MOV_8: return "MOV_8";
+	case X8000_MOV_16: return "MOV_16";
+	case X8000_MOV_32: return "MOV_32";
+	case X8000_MOV_64: return "MOV_64";
+	case X8000_CMP_R: return "CMP_R";
+	case X8000_CMP_8: return "CMP_8";
+	case X8000_CMP_16: return "CMP_16";
+	case X8000_CMP_32: return "CMP_32";
+	case X8000_CMP_64: return "CMP_64";
+	case X8000_JMP: return "JMP";
+	case X8000_JE: return "JE";
+	case X8000_JNE: return "JNE";
+	case X8000_JNZ: return "JNZ";
+	case X8000_CALL: return "CALL";
+	case X8000_RET: return "RET";
+	case X8000_INC: return "INC";
+	case X8000_DEC: return "DEC";
+	case X8000_ADD_R: return "ADD_R";
+	case X8000_ADD_8: return "ADD_8";
+	case X8000_ADD_16: return "ADD_16";
+	case X8000_ADD_32: return "ADD_32";
+	case X8000_ADD_64: return "ADD_64";
+	case X8000_SUB_R: return "SUB_R";
+	case X8000_SUB_8: return "SUB_8";
+	case X8000_SUB_16: return "SUB_16";
+	case X8000_SUB_32: return "SUB_32";
+	case X8000_SUB_64: return "SUB_64";
+	case X8000_MUL_R: return "MUL_R";
+	case X8000_MUL_8: return "MUL_8";
+	case X8000_MUL_16: return "MUL_16";
+	case X8000_MUL_32: return "MUL_32";
+	case X8000_MUL_64: return "MUL_64";
+	case X8000_DIV_R: return "DIV_R";
+	case X8000_DIV_8: return "DIV_8";
+	case X8000_DIV_16: return "DIV_16";
+	case X8000_DIV_32: return "DIV_32";
+	case X8000_DIV_64: return "DIV_64";
+	case X8000_INT: return "INT";
+	default: return "BAD";
+	}
+}
+
+const char* syscallName( size_t code ) {
+	switch ( code ) {
+	case SYSCALL_CODE_WRITE: return "write";
+	case SYSCALL_CODE_READ: return "read";
+	case SYSCALL_CODE_FLUSH: return "flush";
+	case SYSCALL_CODE_WRITEV: return "writev";
+	case SYSCALL_CODE_READV: return "readv";
+	case SYSCALL_CODE_SUBMIT_READ: return "submit_read";
+	case SYSCALL_CODE_SUBMIT_WRITE: return "submit_write";
+	case SYSCALL_CODE_POLL: return "poll";
+	case SYSCALL_CODE_WAIT: return "wait";
+	case SYSCALL_CODE_EXIT: return "exit";
+	case SYSCALL_CODE_SNAPSHOT: return "snapshot";
+	case SYSCALL_CODE_MALLOC: return "malloc";
+	case SYSCALL_CODE_REALLOC: return "realloc";
+	case SYSCALL_CODE_FREE: return "free";
+	case SYSCALL_CODE_WBUFF: return "wbuff";
+	case SYSCALL_CODE_MEMCPY: return "memcpy";
+	case SYSCALL_CODE_MEMMOVE: return "memmove";
+	case SYSCALL_CODE_MEMSET: return "memset";
+	case SYSCALL_CODE_MEMCMP: return "memcmp";
+	case SYSCALL_CODE_MEMCHR: return "memchr";
+	default: return "unknown";
+	}
+}
+// ==================== Profile ====================
+
+// ==================== Sample ====================
+void initSample( struct x8000_vm* vm ) {
+	vm->samples = NULL;
+	vm->samplesSize = 0;
+	vm->samplesDropped = 0;
+	vm->symbols = NULL;
+	vm->symbolsCount = 0;
+
+	if ( vm->samplePath == NULL ) {
+		return;
+	}
+
+	vm->samples = (uint64_t*)malloc( SAMPLE_BUFFER_SIZE * sizeof( uint64_t ) );
+	if ( vm->samples == NULL ) {
+		fprintf( stdout, "Error: Cannot allocate the sample buffer.\n" );
+		exit( EXIT_FAILURE );
+	}
+
+	if ( vm->symbolsPath != NULL && !loadSymbols( vm, vm->symbolsPath ) ) {
+		fprintf( stdout, "Error: Cannot read the symbol map.\n" );
+		exit( EXIT_FAILURE );
+	}
+}
+
+void freeSample( struct x8000_vm* vm ) {
+	if ( vm->samples != NULL ) {
+		FILE* file = fopen( vm->samplePath, "w" );
+
+		if ( file == NULL || !sampleWrite( vm, file ) || fclose( file ) != 0 ) {
+			fprintf( stderr, "Error: Cannot write %s.\n", vm->samplePath );
+		}
+
+		if ( vm->samplesDropped != 0 ) {
+			fprintf( stderr, "Error: The sample buffer is full, %zu samples were dropped.\n", vm->samplesDropped );
+		}
+
+		free( vm->samples );
+		vm->samples = NULL;
+	}
+
+	for ( size_t i = 0; i < vm->symbolsCount; i++ ) {
+		free( vm->symbols[ i ].name );
+	}
+
+	if ( vm->symbols != NULL ) free( vm->symbols );
+	vm->symbols = NULL;
+	vm->symbolsCount = 0;
+}
+
+void sampleStart( struct x8000_vm* vm ) {
+	if ( vm->samples == NULL ) {
+		return;
+	}
+
+	struct sigaction action;
+	memset( &action, 0, sizeof( action ) );
+	action.sa_handler = sampleSignal;
+	action.sa_flags = SA_RESTART;
+	sigemptyset( &action.sa_mask );
+	sigaction( SIGPROF, &action, NULL );
+
+	struct itimerval timer;
+	timer.it_interval.tv_sec = 0;
+	timer.it_interval.tv_usec = 1000000 / SAMPLE_HZ;
+	timer.it_value = timer.it_interval;
+
+	sampleVm = vm;
+	setitimer( ITIMER_PROF, &timer, NULL );
+}
+
+void sampleStop( struct x8000_vm* vm ) {
+	if ( vm->samples == NULL ) {
+		return;
+	}
+
+	struct itimerval timer;
+	memset( &timer, 0, sizeof( timer ) );
+	setitimer( ITIMER_PROF, &timer, NULL );
+
+	sampleVm = NULL;
+}
+
+void sampleSignal( int sig ) {
+	struct x8000_vm* vm = sampleVm;
+
+	if ( vm == NULL ) {
+		return;
+	}
+
+	size_t size = vm->stackPointerSize;
+	size_t depth = size < SAMPLE_DEPTH_MAX ? size : SAMPLE_DEPTH_MAX;
+	size_t cursor = vm->opCursor;
+
+	if ( vm->samplesSize + depth + 2 > SAMPLE_BUFFER_SIZE ) {
+		vm->samplesDropped++;
+		return;
+	}
+
+	// depth, IP, then the return addresses from the outermost kept one in
+	uint64_t* sample = vm->samples + vm->samplesSize;
+	sample[ 0 ] = depth;
+	sample[ 1 ] = cursor == 0 ? 0 : vm->ops[ cursor - 1 ].ip;
+
+	for ( size_t i = 0; i < depth; i++ ) {
+		sample[ 2 + i ] = vm->stackPointer[ size - depth + i ];
+	}
+
+	vm->samplesSize += depth + 2;
+}
+
+bool sampleWrite( struct x8000_vm* vm, FILE* file ) {
+	size_t count = 0;
+
+	for ( size_t pos = 0; pos < vm->samplesSize; pos += vm->samples[ pos ] + 2 ) {
+		count++;
+	}
+
+	char** stacks = (char**)calloc( count + 1, sizeof( char* ) );
+	if ( stacks == NULL ) {
+		return false;
+	}
+
+	bool status = true;
+	size_t index = 0;
+
+	for ( size_t pos = 0; pos < vm->samplesSize && status; pos += vm->samples[ pos ] + 2, index++ ) {
+		uint64_t* sample = vm->samples + pos;
+		char name[ SAMPLE_NAME_SIZE ];
+		char* stack = NULL;
+		size_t stackSize = 0;
+		FILE* out = open_memstream( &stack, &stackSize );
+
+		if ( out == NULL ) {
+			status = false;
+			break;
+		}
+
+		// A return address follows its CALL, the byte before it names the caller
+		for ( size_t i = 0; i < sample[ 0 ]; i++ ) {
+			fprintf( out, "%s;", symbolOf( vm, (x8000_address_t)( sample[ 2 + i ] - 1 ), name ) );
+		}
+
+		fprintf( out, "%s", symbolOf( vm, (x8000_address_t)sample[ 1 ], name ) );
+
+		if ( fclose( out ) != 0 ) {
+			status = false;
+		}
+
+		stacks[ index ] = stack;
+	}
+
+	// Identical stacks end up next to each other and are counted once
+	if ( status ) {
+		qsort( stacks, count, sizeof( char* ), sampleCompare );
+
+		for ( size_t i = 0; i < count; ) {
+			size_t j = i + 1;
+
+			while ( j < count && strcmp( stacks[ i ], stacks[ j ] ) == 0 ) {
+				j++;
+			}
+
+			fprintf( file, "%s %zu\n", stacks[ i ], j - i );
+			i = j;
+		}
+	}
+
+	for ( size_t i = 0; i < count; i++ ) {
+		if ( stacks[ i ] != NULL ) free( stacks[ i ] );
+	}
+
+	free( stacks );
+	return status;
+}
+
+int sampleCompare( const void* a, const void* b ) {
+	return strcmp( *(char* const*)a, *(char* const*)b );
+}
+
+bool loadSymbols( struct x8000_vm* vm, const char* path ) {
+	FILE* file = fopen( path, "r" );
+	if ( file == NULL ) {
+		return false;
+	}
+
+	char* line = NULL;
+	size_t lineSize = 0;
+	size_t capacity = 0;
+
+	while ( getline( &line, &lineSize, file ) != -1 ) {
+		char* end = NULL;
+		x8000_address_t address = (x8000_address_t)strtoull( line, &end, 0 );
+		char* name = strtok( end, " \t\r\n" );
+
+		if ( end == line || name == NULL ) {
+			continue;
+		}
+
+		if ( vm->symbolsCount == capacity ) {
+			capacity = capacity == 0 ? 0x40 : capacity * 2;
+			struct symbol* grown = (struct symbol*)realloc( vm->symbols, capacity * sizeof( struct symbol ) );
+
+			if ( grown == NULL ) {
+				break;
+			}
+
+			vm->symbols = grown;
+		}
+
+		vm->symbols[ vm->symbolsCount ].address = address;
+		vm->symbols[ vm->symbolsCount ].name = strdup( name );
+		vm->symbolsCount++;
+	}
+
+	free( line );
+	fclose( file );
+
+	qsort( vm->symbols, vm->symbolsCount, sizeof( struct symbol ), symbolCompare );
+	return true;
+}
+
+const char* symbolOf( struct x8000_vm* vm, x8000_address_t address, char* buff ) {
+	// The last label at or before the address
+	size_t low = 0;
+	size_t high = vm->symbolsCount;
+
+	while ( low < high ) {
+		size_t mid = low + ( high - low ) / 2;
+
+		if ( vm->symbols[ mid ].address <= address ) {
+			low = mid + 1;
+		}else {
+			high = mid;
+		}
+	}
+
+	if ( low == 0 ) {
+		snprintf( buff, SAMPLE_NAME_SIZE, "0x%llx", (unsigned long long)address );
+		return buff;
+	}
+
+	return vm->symbols[ low - 1 ].name;
+}
+
+int symbolCompare( const void* a, const void* b ) {
+	const struct symbol* x = (const struct symbol*)a;
+	const struct symbol* y = (const struct symbol*)b;
+
+	return x->address < y->address ? -1 : ( x->address > y->address );
+}
+
+const char* symbolsSidecar( const char* program, char* buff, size_t size ) {
+	// prog.bin -> prog.map, only when tasm -m left one there
+	const char* slash = strrchr( program, '/' );
+	const char* dot = strrchr( program, '.' );
+	size_t length = dot != NULL && ( slash == NULL || dot > slash ) ? (size_t)( dot - program ) : strlen( program );
+
+	if ( snprintf( buff, size, "%.*s.map", (int)length, program ) >= (int)size || access( buff, R_OK ) != 0 ) {
+		return NULL;
+	}
+
+	return buff;
+}
+// ==================== Sample ====================
+
+// ==================== Trace ====================
+void initTrace( struct x8000_vm* vm ) {
+	vm->traceRing = NULL;
+	vm->traceEntry = NULL;
+	vm->traceCount = 0;
+	vm->traceLast = TRACE_LAST_NONE;
+	vm->traceSyscalls = NULL;
+	vm->traceSyscallsCount = 0;
+	vm->traceStartIP = 0;
+
+	if ( vm->tracePath == NULL ) {
+		return;
+	}
+
+	if ( vm->programSize >= TRACE_RET ) {
+		fprintf( stdout, "Error: The program is too large to trace.\n" );
+		exit( EXIT_FAILURE );
+	}
+
+	vm->traceRing = (struct traceEntry*)calloc( TRACE_ENTRIES, sizeof( struct traceEntry ) );
+	vm->traceSyscalls = (struct traceSyscall*)calloc( TRACE_SYSCALLS, sizeof( struct traceSyscall ) );
+	if ( vm->traceRing == NULL || vm->traceSyscalls == NULL ) {
+		fprintf( stdout, "Error: Cannot allocate the trace buffer.\n" );
+		exit( EXIT_FAILURE );
+	}
+}
+
+void freeTrace( struct x8000_vm* vm ) {
+	if ( vm->traceRing != NULL ) free( vm->traceRing );
+	if ( vm->traceSyscalls != NULL ) free( vm->traceSyscalls );
+	vm->traceRing = NULL;
+	vm->traceSyscalls = NULL;
+}
+
+void traceStart( struct x8000_vm* vm ) {
+	if ( vm->traceRing == NULL ) {
+		return;
+	}
+
+	// A restored VM does not start at 0
+	vm->traceStartIP = vm->ops[ vm->opCursor ].ip;
+
+	struct sigaction action;
+	memset( &action, 0, sizeof( action ) );
+	action.sa_handler = traceSignal;
+	action.sa_flags = SA_RESTART;
+	sigemptyset( &action.sa_mask );
+
+	traceVm = vm;
+	sigaction( SIGUSR1, &action, NULL );
+}
+
+void traceStop( struct x8000_vm* vm ) {
+	if ( vm->traceRing == NULL ) {
+		return;
+	}
+
+	signal( SIGUSR1, SIG_DFL );
+	traceVm = NULL;
+}
+
+void traceBranch( struct x8000_vm* vm, x8000_address_t end ) {
+	// The same branch again only bumps its count, until that would wrap
+	if ( vm->traceLast == end ) {
+		if ( ++vm->traceEntry->value != 0 ) {
+			return;
+		}
+
+		vm->traceEntry->value = UINT32_MAX;
+	}
+
+	traceAdd( vm, (uint32_t)end, 0 );
+	vm->traceLast = end;
+}
+
+void traceJump( struct x8000_vm* vm, x8000_address_t end, x8000_address_t target ) {
+	traceAdd( vm, TRACE_JUMP | (uint32_t)target, (uint32_t)end );
+	vm->traceLast = TRACE_LAST_NONE;
+}
+
+void traceAdd( struct x8000_vm* vm, uint32_t address, uint32_t value ) {
+	struct traceEntry* entry = &vm->traceRing[ vm->traceCount & ( TRACE_ENTRIES - 1 ) ];
+	entry->address = address;
+	entry->value = value;
+	vm->traceEntry = entry;
+
+	// The entry is complete before the handler can see it
+	__atomic_signal_fence( __ATOMIC_RELEASE );
+	vm->traceCount++;
+}
+
+void traceSyscall( struct x8000_vm* vm, struct x8000_op* op ) {
+	struct traceSyscall* record = &vm->traceSyscalls[ vm->traceSyscallsCount & ( TRACE_SYSCALLS - 1 ) ];
+	record->entries = vm->traceCount;
+	record->ip = (uint32_t)op->ip;
+	record->repeat = vm->traceCount != 0 ? vm->traceEntry->value : 0;
+	record->rk = vm->registers.RK;
+	record->rp1 = vm->registers.RP1;
+	record->rp2 = vm->registers.RP2;
+	record->rp3 = vm->registers.RP3;
+	record->rr1 = vm->registers.RR1;
+
+	__atomic_signal_fence( __ATOMIC_RELEASE );
+	vm->traceSyscallsCount++;
+}
+
+void traceFault( struct x8000_vm* vm ) {
+	if ( vm->traceRing == NULL ) {
+		return;
+	}
+
+	if ( !traceDump( vm, TRACE_REASON_FAULT ) ) {
+		fprintf( stderr, "Error: Cannot write %s.\n", vm->tracePath );
+	}
+}
+
+void traceSignal( int sig ) {
+	int saved = errno;
+
+	if ( traceVm != NULL ) {
+		traceDump( traceVm, TRACE_REASON_SIGNAL );
+	}
+
+	errno = saved;
+}
+
+bool traceDump( struct x8000_vm* vm, uint32_t reason ) {
+	// Only open, write and close, this also runs in the SIGUSR1 handler
+	struct traceHeader header;
+	uint64_t entriesCount = vm->traceCount;
+	uint64_t syscallsCount = vm->traceSyscallsCount;
+	uint64_t entries = entriesCount < TRACE_ENTRIES ? entriesCount : TRACE_ENTRIES;
+	uint64_t syscalls = syscallsCount < TRACE_SYSCALLS ? syscallsCount : TRACE_SYSCALLS;
+
+	memcpy( header.magic, TRACE_MAGIC, sizeof( header.magic ) );
+	header.version = TRACE_VERSION;
+	header.reason = reason;
+	header.instructionCount = vm->instructionCount;
+	header.entriesCount = entriesCount;
+	header.entries = entries;
+	header.syscalls = syscalls;
+	header.programSize = vm->programSize;
+	header.start = vm->traceStartIP;
+	// The op that failed, or the one running when the signal came
+	header.ip = vm->ops[ vm->opCursor > 0 ? vm->opCursor - 1 : 0 ].ip;
+	memcpy( header.regs, vm->registers.regs, sizeof( header.regs ) );
+
+	int fd = open( vm->tracePath, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+	if ( fd == -1 ) {
+		return false;
+	}
+
+	bool status = write( fd, &header, sizeof( header ) ) == (ssize_t)sizeof( header );
+
+	// Oldest first, in at most two runs each
+	for ( uint64_t i = entriesCount - entries; i < entriesCount && status; ) {
+		size_t first = (size_t)( i & ( TRACE_ENTRIES - 1 ) );
+		size_t count = (size_t)( entriesCount - i ) < TRACE_ENTRIES - first ? (size_t)( entriesCount - i ) : TRACE_ENTRIES - first;
+		size_t size = count * sizeof( struct traceEntry );
+
+		status = write( fd, &vm->traceRing[ first ], size ) == (ssize_t)size;
+		i += count;
+	}
+
+	for ( uint64_t i = syscallsCount - syscalls; i < syscallsCount && status; ) {
+		size_t first = (size_t)( i & ( TRACE_SYSCALLS - 1 ) );
+		size_t count = (size_t)( syscallsCount - i ) < TRACE_SYSCALLS - first ? (size_t)( syscallsCount - i ) : TRACE_SYSCALLS - first;
+		size_t size = count * sizeof( struct traceSyscall );
+
+		status = write( fd, &vm->traceSyscalls[ first ], size ) == (ssize_t)size;
+		i += count;
+	}
+
+	if ( status && vm->programSize != 0 ) {
+		status = write( fd, vm->program, vm->programSize ) == (ssize_t)vm->programSize;
+	}
+
+	return close( fd ) == 0 && status;
+}
+// ==================== Trace ====================
+
+// ==================== Syscall ====================
+ubyte_t x8000_syscall(
+	struct x8000_vm* vm,
+	x8000_register_t rk,
+	x8000_register_t rp1,
+	x8000_register_t rp2,
+	x8000_register_t rp3,
+	x8000_register_t rp4,
+	x8000_register_t rp5,
+	x8000_register_t rp6,
+	x8000_register_t rp7,
+	x8000_register_t rp8
+) {
+	switch ( rk ) {
+	case SYSCALL_CODE_WRITE: {
+		return syscall_write( vm, rp1, (x8000_address_t)rp2, (size_t)rp3 );
+	}
+	case SYSCALL_CODE_READ: {
+		return syscall_read( vm, rp1, (x8000_address_t)rp2, (size_t)rp3 );
+	}
+	case SYSCALL_CODE_FLUSH: {
+		return syscall_flush( vm, rp1 );
+	}
+	case SYSCALL_CODE_WRITEV: {
+		return syscall_writev( vm, rp1, (x8000_address_t)rp2, (size_t)rp3 );
+	}
+	case SYSCALL_CODE_READV: {
+		return syscall_readv( vm, rp1, (x8000_address_t)rp2, (size_t)rp3 );
+	}
+	case SYSCALL_CODE_SUBMIT_READ: {
+		return syscall_submit( vm, false, rp1, (x8000_address_t)rp2, (size_t)rp3 );
+	}
+	case SYSCALL_CODE_SUBMIT_WRITE: {
+		return syscall_submit( vm, true, rp1, (x8000_address_t)rp2, (size_t)rp3 );
+	}
+	case SYSCALL_CODE_POLL: {
+		return syscall_poll( vm, rp1 );
+	}
+	case SYSCALL_CODE_WAIT: {
+		return syscall_wait( vm, rp1 );
+	}
+	case SYSCALL_CODE_EXIT: {
+		return syscall_exit( vm, rp1 );
+	}
+	case SYSCALL_CODE_SNAPSHOT: {
+		return syscall_snapshot( vm, (x8000_address_t)rp1, (size_t)rp2 );
+	}
+	case SYSCALL_CODE_MALLOC: {
+		x8000_address_t address = syscall_malloc( vm, rp1 );
+		if ( address == (x8000_address_t)NULL ) {
+			return SYSCALL_STATUS_FAILURE;
+		}
+		vm->registers.RR1 = (x8000_address_t)address;
+		return SYSCALL_STATUS_SUCCESS;
+	}
+	case SYSCALL_CODE_REALLOC: {
+		x8000_address_t address = syscall_realloc( vm, (x8000_address_t)rp1, rp2 );
+		if ( address == (x8000_address_t)NULL ) {
+			return SYSCALL_STATUS_FAILURE;
+		}
+		vm->registers.RR1 = (x8000_address_t)address;
+		return SYSCALL_STATUS_SUCCESS;
+	}
+	case SYSCALL_CODE_FREE: {
+		return syscall_free( vm, (x8000_address_t)rp1 );
+	}
+	case SYSCALL_CODE_WBUFF: {
+		return syscall_wbuff( vm, (x8000_address_t)rp1, (char)rp2 );
+	}
+	case SYSCALL_CODE_MEMCPY: {
+		return syscall_memcpy( vm, (x8000_address_t)rp1, (x8000_address_t)rp2, (size_t)rp3 );
+	}
+	case SYSCALL_CODE_MEMMOVE: {
+		return syscall_memmove( vm, (x8000_address_t)rp1, (x8000_address_t)rp2, (size_t)rp3 );
+	}
+	case SYSCALL_CODE_MEMSET: {
+		return syscall_memset( vm, (x8000_address_t)rp1, (char)rp2, (size_t)rp3 );
+	}
+	case SYSCALL_CODE_MEMCMP: {
+		return syscall_memcmp( vm, (x8000_address_t)rp1, (x8000_address_t)rp2, (size_t)rp3 );
+	}
+	case SYSCALL_CODE_MEMCHR: {
+		return syscall_memchr( vm, (x8000_address_t)rp1, (char)rp2, (size_t)rp3 );
+	}
+	default:
+		return SYSCALL_STATUS_FAILURE;
+	}
+}
+
+ubyte_t syscall_write( struct x8000_vm* vm, x8000_register_t file_descriptor, x8000_address_t buff, size_t buff_size ) {
+	void* ptr = guestPointer( vm, buff, buff_size );
+
+	if ( ptr == NULL ) {
+		return SYSCALL_STATUS_FAILURE;
+	}
+
+	bool status = false;
+
+	if ( file_descriptor == FILE_DESCRIPTOR_STDOUT ) {
+		status = outputAppend( &vm->outputStdout, (ubyte_t*)ptr, buff_size );
+	}else if ( file_descriptor == FILE_DESCRIPTOR_STDERR ) {
+		status = outputAppend( &vm->outputStderr, (ubyte_t*)ptr, buff_size );
+	}
+
+	if ( status == false ) {
+		return SYSCALL_STATUS_FAILURE;
+	}
+
+	vm->registers.RR1 = (x8000_register_t)buff_size;
+
+	return SYSCALL_STATUS_SUCCESS;
+}
+
+ubyte_t syscall_read( struct x8000_vm* vm, x8000_register_t file_descriptor, x8000_address_t buff, size_t buff_size ) {
+	void* ptr = guestPointer( vm, buff, buff_size );
+
+	if ( ptr == NULL ) {
+		return SYSCALL_STATUS_FAILURE;
+	}
+
+	if ( file_descriptor == FILE_DESCRIPTOR_STDIN ) {
+		// Prompts written so far must be visible before blocking on input
+		flushOutput( vm );
+
+		ssize_t res = read( vm->inputFd, ptr, buff_size );
+		return res > 0 ? SYSCALL_STATUS_SUCCESS : SYSCALL_STATUS_FAILURE;
+	}else {
+		return SYSCALL_STATUS_FAILURE;
+	}
+}
+
+ubyte_t syscall_flush( struct x8000_vm* vm, x8000_register_t file_descriptor ) {
+	bool status = false;
+
+	if ( file_descriptor == FILE_DESCRIPTOR_STDOUT ) {
+		status = outputFlush( &vm->outputStdout );
+	}else if ( file_descriptor == FILE_DESCRIPTOR_STDERR ) {
+		status = outputFlush( &vm->outputStderr );
+	}
+
+	return status ? SYSCALL_STATUS_SUCCESS : SYSCALL_STATUS_FAILURE;
+}
+
+ubyte_t syscall_writev( struct x8000_vm* vm, x8000_register_t file_descriptor, x8000_address_t iov, size_t iov_count ) {
+	struct iovec vec[ SYSCALL_IOV_MAX ];
+	size_t total = 0;
+
+	if ( guestIovec( vm, iov, iov_count, vec, &total ) == false ) {
+		return SYSCALL_STATUS_FAILURE;
+	}
+
+	bool status = false;
+
+	if ( file_descriptor == FILE_DESCRIPTOR_STDOUT ) {
+		status = outputAppendv( &vm->outputStdout, vec, (int)iov_count, total );
+	}else if ( file_descriptor == FILE_DESCRIPTOR_STDERR ) {
+		status = outputAppendv( &vm->outputStderr, vec, (int)iov_count, total );
+	}
+
+	if ( status == false ) {
+		return SYSCALL_STATUS_FAILURE;
+	}
+
+	vm->registers.RR1 = (x8000_register_t)total;
+
+	return SYSCALL_STATUS_SUCCESS;
+}
+
+ubyte_t syscall_readv( struct x8000_vm* vm, x8000_register_t file_descriptor, x8000_address_t iov, size_t iov_count ) {
+	struct iovec vec[ SYSCALL_IOV_MAX ];
+	size_t total = 0;
+
+	if ( file_descriptor != FILE_DESCRIPTOR_STDIN || guestIovec( vm, iov, iov_count, vec, &total ) == false ) {
+		return SYSCALL_STATUS_FAILURE;
+	}
+
+	flushOutput( vm );
+
+	ssize_t res;
+
+	do {
+		res = readv( vm->inputFd, vec, (int)iov_count );
+	} while ( res < 0 && errno == EINTR );
+
+	if ( res < 0 ) {
+		return SYSCALL_STATUS_FAILURE;
+	}
+
+	vm->registers.RR1 = (x8000_register_t)res;
+
+	return SYSCALL_STATUS_SUCCESS;
+}
+
+ubyte_t syscall_submit( struct x8000_vm* vm, bool write, x8000_register_t file_descriptor, x8000_address_t buff, size_t buff_size ) {
+	void* ptr = guestPointer( vm, buff, buff_size );
+	int fd = -1;
+
+	if ( ptr == NULL || ( buff == NULL_ADDRESS && buff_size != 0 ) ) {
+		return SYSCALL_STATUS_FAILURE;
+	}
+
+	if ( write && file_descriptor == FILE_DESCRIPTOR_STDOUT ) {
+		// Whatever was written before must come out first
+		if ( outputFlush( &vm->outputStdout ) == false ) return SYSCALL_STATUS_FAILURE;
+		fd = vm->outputStdout.fd;
+	}else if ( write && file_descriptor == FILE_DESCRIPTOR_STDERR ) {
+		if ( outputFlush( &vm->outputStderr ) == false ) return SYSCALL_STATUS_FAILURE;
+		fd = vm->outputStderr.fd;
+	}else if ( !write && file_descriptor == FILE_DESCRIPTOR_STDIN ) {
+		flushOutput( vm );
+		fd = vm->inputFd;
+	}else {
+		return SYSCALL_STATUS_FAILURE;
+	}
+
+	x8000_register_t ticket = asyncSubmit( vm, write, fd, ptr, buff_size );
+
+	if ( ticket == NULL_REG ) {
+		return SYSCALL_STATUS_FAILURE;
+	}
+
+	vm->registers.RR1 = ticket;
+
+	return SYSCALL_STATUS_SUCCESS;
+}
+
+ubyte_t syscall_poll( struct x8000_vm* vm, x8000_register_t ticket ) {
+	struct asyncSlot* slot = asyncLookup( vm, ticket );
+
+	if ( slot == NULL ) {
+		return SYSCALL_STATUS_FAILURE;
+	}
+
+	if ( asyncComplete( vm, slot, false ) == false ) {
+		vm->registers.RR1 = 0;
+		return SYSCALL_STATUS_SUCCESS;
+	}
+
+	vm->registers.RR1 = 1;
+	vm->registers.RR2 = slot->result;
+	slot->state = ASYNC_STATE_FREE;
+
+	return SYSCALL_STATUS_SUCCESS;
+}
+
+ubyte_t syscall_wait( struct x8000_vm* vm, x8000_register_t ticket ) {
+	struct asyncSlot* slot = asyncLookup( vm, ticket );
+
+	if ( slot == NULL ) {
+		return SYSCALL_STATUS_FAILURE;
+	}
+
+	asyncComplete( vm, slot, true );
+
+	vm->registers.RR1 = slot->result;
+	slot->state = ASYNC_STATE_FREE;
+
+	return SYSCALL_STATUS_SUCCESS;
+}
+
+bool guestIovec( struct x8000_vm* vm, x8000_address_t iov, size_t iov_count, struct iovec* vec, size_t* total ) {
+	if ( iov_count == 0 || iov_count > SYSCALL_IOV_MAX ) {
+		return false;
+	}
+
+	ubyte_t* entries = (ubyte_t*)guestPointer( vm, iov, iov_count * SYSCALL_IOV_SIZE );
+
+	if ( iov == NULL_ADDRESS || entries == NULL ) {
+		return false;
+	}
+
+	*total = 0;
+
+	for ( size_t i = 0; i < iov_count; i++ ) {
+		x8000_address_t address;
+		size_t size;
+
+		memcpy( &address, entries + i * SYSCALL_IOV_SIZE, sizeof( address ) );
+		memcpy( &size, entries + i * SYSCALL_IOV_SIZE + 8, sizeof( size ) );
+
+		void* ptr = guestPointer( vm, address, size );
+
+		if ( ( ptr == NULL && size != 0 ) || size > SSIZE_MAX - *total ) {
+			return false;
+		}
+
+		vec[ i ].iov_base = ptr;
+		vec[ i ].iov_len = size;
+		*total += size;
+	}
+
+	return true;
+}
+
+ubyte_t syscall_exit( struct x8000_vm* vm, x8000_register_t status ) {
+	flushOutput( vm );
+	vm->programStatus = false;
+	vm->exitCode = status;
+	return SYSCALL_STATUS_SUCCESS;
+}
+
+ubyte_t syscall_snapshot( struct x8000_vm* vm, x8000_address_t path, size_t path_size ) {
+	char file[ PATH_MAX ];
+	char* name = (char*)guestPointer( vm, path, path_size );
+
+	// With --fork-at-snapshot this is where the fork server takes over
+	if ( vm->forkServer != NULL && vm->forkAtSnapshot ) {
+		if ( !forkServe( vm ) ) {
+			return SYSCALL_STATUS_FAILURE;
+		}
+
+		vm->registers.RR1 = (x8000_register_t)0x1;
+		return SYSCALL_STATUS_SUCCESS;
+	}
+
+	if ( vm->memorySandbox == false ) {
+		fprintf( stderr, "Error: SNAPSHOT needs --sandbox.\n" );
+		return SYSCALL_STATUS_FAILURE;
+	}
+
+	if ( path == NULL_ADDRESS || name == NULL || path_size == 0 || path_size >= PATH_MAX ) {
+		return SYSCALL_STATUS_FAILURE;
+	}
+
+	// A transfer in flight cannot be carried over to the restored program
+	for ( size_t i = 0; i < ASYNC_SLOTS_COUNT; i++ ) {
+		if ( vm->asyncSlots[ i ].state != ASYNC_STATE_FREE ) {
+			fprintf( stderr, "Error: SNAPSHOT with asynchronous I/O pending.\n" );
+			return SYSCALL_STATUS_FAILURE;
+		}
+	}
+
+	memcpy( file, name, path_size );
+	file[ path_size ] = '\0';
+
+	// Whatever was printed so far must not be printed again on restore
+	flushOutput( vm );
+
+	if ( !snapshotSave( vm, file ) ) {
+		fprintf( stderr, "Error: Cannot write the snapshot.\n" );
+		return SYSCALL_STATUS_FAILURE;
+	}
+
+	vm->registers.RR1 = (x8000_register_t)0x0;
+	return SYSCALL_STATUS_SUCCESS;
+}
+
+x8000_address_t syscall_malloc( struct x8000_vm* vm, size_t buff_size ) {
+	return heapAlloc( vm, buff_size );
+}
+
+x8000_address_t syscall_realloc( struct x8000_vm* vm, x8000_address_t address, size_t new_size ) {
+	return heapRealloc( vm, address, new_size );
+}
+
+ubyte_t syscall_free( struct x8000_vm* vm, x8000_address_t address ) {
+	return heapRelease( vm, address ) ? SYSCALL_STATUS_SUCCESS : SYSCALL_STATUS_FAILURE;
+}
+
+ubyte_t syscall_wbuff( struct x8000_vm* vm, x8000_address_t address, char ch ) {
+	if ( address == NULL_ADDRESS ) {
+		return SYSCALL_STATUS_FAILURE;
+	}
+
+	char* ptr = (char*)guestPointer( vm, address, 1 );
+
+	if ( ptr == NULL ) {
+		return SYSCALL_STATUS_FAILURE;
+	}
+
+	*ptr = ch;
+
+	return SYSCALL_STATUS_SUCCESS;
+}
+
+/*
+	Memory packet
+
+	Bulk operations over guest buffers. They go straight to the libc
+	string kernels, which are vectorized for the host CPU, instead of
+	one WBUFF syscall per byte.
+*/
+ubyte_t syscall_memcpy( struct x8000_vm* vm, x8000_address_t dst, x8000_address_t src, size_t size ) {
+	void* to = guestPointer( vm, dst, size );
+	void* from = guestPointer( vm, src, size );
+
+	if ( size != 0 && ( dst == NULL_ADDRESS || src == NULL_ADDRESS || to == NULL || from == NULL ) ) {
+		return SYSCALL_STATUS_FAILURE;
+	}
+
+	if ( size != 0 ) memcpy( to, from, size );
+	vm->registers.RR1 = (x8000_register_t)dst;
+
+	return SYSCALL_STATUS_SUCCESS;
+}
+
+ubyte_t syscall_memmove( struct x8000_vm* vm, x8000_address_t dst, x8000_address_t src, size_t size ) {
+	void* to = guestPointer( vm, dst, size );
+	void* from = guestPointer( vm, src, size );
+
+	if ( size != 0 && ( dst == NULL_ADDRESS || src == NULL_ADDRESS || to == NULL || from == NULL ) ) {
+		return SYSCALL_STATUS_FAILURE;
+	}
+
+	if ( size != 0 ) memmove( to, from, size );
+	vm->registers.RR1 = (x8000_register_t)dst;
+
+	return SYSCALL_STATUS_SUCCESS;
+}
+
+ubyte_t syscall_memset( struct x8000_vm* vm, x8000_address_t dst, char ch, size_t size ) {
+	void* to = guestPointer( vm, dst, size );
+
+	if ( size != 0 && ( dst == NULL_ADDRESS || to == NULL ) ) {
+		return SYSCALL_STATUS_FAILURE;
+	}
+
+	if ( size != 0 ) memset( to, ch, size );
+	vm->registers.RR1 = (x8000_register_t)dst;
+
+	return SYSCALL_STATUS_SUCCESS;
+}
+
+ubyte_t syscall_memcmp( struct x8000_vm* vm, x8000_address_t buff1, x8000_address_t buff2, size_t size ) {
+	void* ptr1 = guestPointer( vm, buff1, size );
+	void* ptr2 = guestPointer( vm, buff2, size );
+
+	if ( size != 0 && ( buff1 == NULL_ADDRESS || buff2 == NULL_ADDRESS || ptr1 == NULL || ptr2 == NULL ) ) {
+		return SYSCALL_STATUS_FAILURE;
+	}
+
+	int res = size != 0 ? memcmp( ptr1, ptr2, size ) : 0;
+	vm->registers.RR1 = res < 0 ? -1 : ( res > 0 ? 1 : 0 );
+
+	return SYSCALL_STATUS_SUCCESS;
+}
+
+ubyte_t syscall_memchr( struct x8000_vm* vm, x8000_address_t buff, char ch, size_t size ) {
+	ubyte_t* ptr = (ubyte_t*)guestPointer( vm, buff, size );
 
-		if ( isValidRegister( vreg ) == false ) {
-			return INSTRUCTION_STATUS_FAILURE;
+	if ( size != 0 && ( buff == NULL_ADDRESS || ptr == NULL ) ) {
+		return SYSCALL_STATUS_FAILURE;
+	}
+
+	ubyte_t* found = size != 0 ? (ubyte_t*)memchr( ptr, ch, size ) : NULL;
+	vm->registers.RR1 = found == NULL ? NULL_REG : (x8000_register_t)( buff + (x8000_address_t)( found - ptr ) );
+
+	return SYSCALL_STATUS_SUCCESS;
+}
+// ==================== Syscall ====================
+
+// ==================== Program ====================
+/*
+	A regular file is mapped read-only instead of copied, so startup does
+	not scale with the image size and every process running the same
+	binary shares its page-cache pages. The verifier and the decoder are
+	the only readers and walk the image front to back, so the mapping is advised
+	sequential for readahead and released with releaseProgram() once the
+	ops are built. Anything that cannot be mapped (pipes, /dev/stdin) or
+	is empty falls back to a plain read into the heap.
+
+	An image opened once with openProgram can be handed to any number of
+	VMs with shareProgram; they decode it but leave freeing it to the
+	owner (the batch runner).
+*/
+bool loadProgram( struct x8000_vm* vm, const char* path ) {
+	vm->programShared = false;
+
+	return openProgram( path, &vm->program, &vm->programSize, &vm->programMapSize );
+}
+
+void shareProgram( struct x8000_vm* vm, ubyte_t* _program, size_t _programSize ) {
+	vm->program = _program;
+	vm->programSize = _programSize;
+	vm->programMapSize = 0;
+	vm->programShared = true;
+}
+
+bool openProgram( const char* path, ubyte_t** _program, size_t* _programSize, size_t* _programMapSize ) {
+	int fd = open( path, O_RDONLY );
+	if ( fd < 0 ) {
+		fprintf( stdout, "Error: Cannot open the specified file.\n" );
+		return false;
+	}
+
+	*_program = NULL;
+	*_programSize = 0;
+	*_programMapSize = 0;
+
+	struct stat st;
+	if ( fstat( fd, &st ) == 0 && S_ISREG( st.st_mode ) && st.st_size > 0 ) {
+		void* image = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+		if ( image != MAP_FAILED ) {
+			close( fd );
+			madvise( image, (size_t)st.st_size, MADV_SEQUENTIAL );
+
+			*_program = (ubyte_t*)image;
+			*_programSize = (size_t)st.st_size;
+			*_programMapSize = (size_t)st.st_size;
 		}
+	}
 
-		r2 = getRegister( vreg );
-		setRegister( reg, ( r1 * r2 ) );
+	if ( *_program == NULL ) {
+		bool status = readProgram( fd, _program, _programSize );
+		close( fd );
 
-		return INSTRUCTION_STATUS_SUCCESS;
+		if ( !status ) {
+			fprintf( stdout, "Error: Cannot read the specified file.\n" );
+			return false;
+		}
 	}
 
-	union {
-		ubyte_t bt[ 8 ];
-		register_t reg;
-	} buffUnion;
-	buffUnion.reg = 0;
+	if ( !verifyProgram( *_program, *_programSize ) ) {
+		closeProgram( *_program, *_programMapSize );
+		*_program = NULL;
+		*_programSize = 0;
+		*_programMapSize = 0;
+		return false;
+	}
 
+	return true;
+}
 
-	if ( mode == X8000_MUL_8 ) {
-		buffUnion.bt[ 0 ] = instructionNext();
-		r2 = buffUnion.reg;
-	}else if ( mode == X8000_MUL_16 ) {
-		buffUnion.bt[ 0 ] = instructionNext();
-		buffUnion.bt[ 1 ] = instructionNext();
-		r2 = buffUnion.reg;
-	}else if ( mode == X8000_MUL_32 ) {
-		buffUnion.bt[ 0 ] = instructionNext();
-		buffUnion.bt[ 1 ] = instructionNext();
-		buffUnion.bt[ 2 ] = instructionNext();
-		buffUnion.bt[ 3 ] = instructionNext();
-		r2 = buffUnion.reg;
-	}else if ( mode == X8000_MUL_64 ) {
-		buffUnion.bt[ 0 ] = instructionNext();
-		buffUnion.bt[ 1 ] = instructionNext();
-		buffUnion.bt[ 2 ] = instructionNext();
-		buffUnion.bt[ 3 ] = instructionNext();
-		buffUnion.bt[ 4 ] = instructionNext();
-		buffUnion.bt[ 5 ] = instructionNext();
-		buffUnion.bt[ 6 ] = instructionNext();
-		buffUnion.bt[ 7 ] = instructionNext();
-		r2 = buffUnion.reg;
-	}else {
-		return INSTRUCTION_STATUS_FAILURE;
+bool readProgram( int fd, ubyte_t** _program, size_t* _programSize ) {
+	size_t size = 0;
+	size_t capacity = PROGRAM_READ_CHUNK;
+	ubyte_t* buff = (ubyte_t*)malloc( capacity );
+
+	if ( buff == NULL ) {
+		return false;
 	}
 
-	setRegister( reg, ( r1 * r2 ) );
+	while ( true ) {
+		if ( size == capacity ) {
+			ubyte_t* grown = (ubyte_t*)realloc( buff, capacity * 2 );
 
-	return INSTRUCTION_STATUS_SUCCESS;
+			if ( grown == NULL ) {
+				free( buff );
+				return false;
+			}
+
+			buff = grown;
+			capacity *= 2;
+		}
+
+		ssize_t n = read( fd, buff + size, capacity - size );
+
+		if ( n == 0 ) {
+			break;
+		}else if ( n < 0 ) {
+			if ( errno == EINTR ) {
+				continue;
+			}
+
+			free( buff );
+			return false;
+		}
+
+		size += (size_t)n;
+	}
+
+	*_program = buff;
+	*_programSize = size;
+	return true;
 }
 
-ubyte_t x8000_div() {
-	// DIV RK, 0xFF
+void initProgram( struct x8000_vm* vm ) {
+	vm->programStatus = true;
+	vm->exitCode = X8000_EXIT_SUCCESS;
+	vm->instructionCount = 0;
+}
 
-	ubyte_t mode = instructionPeek();
-	ubyte_t reg = instructionNext();
+void releaseProgram( struct x8000_vm* vm ) {
+	// The mapping stays valid, the pages just go back to the page cache
+	if ( vm->programMapSize != 0 ) {
+		madvise( vm->program, vm->programMapSize, MADV_DONTNEED );
+	}
+}
 
-	if ( isValidRegister( reg ) == false ) {
-		return INSTRUCTION_STATUS_FAILURE;
+void freeProgram( struct x8000_vm* vm ) {
+	if ( vm->programShared == false ) {
+		closeProgram( vm->program, vm->programMapSize );
 	}
 
-	register_t r1 = getRegister( reg );
-	register_t r2;
+	vm->program = NULL;
+	vm->programMapSize = 0;
+}
 
-	if ( mode == X8000_DIV_R ) {
-		ubyte_t vreg = instructionNext();
+void closeProgram( ubyte_t* _program, size_t _programMapSize ) {
+	if ( _programMapSize != 0 ) {
+		munmap( _program, _programMapSize );
+	}else {
+		free( _program );
+	}
+}
 
-		if ( isValidRegister( vreg ) == false ) {
-			return INSTRUCTION_STATUS_FAILURE;
+/*
+	With GCC/Clang every op ends in its own indirect jump through the
+	dispatch table (threaded code), so the branch predictor sees one
+	dispatch site per op kind instead of a single shared one. Other
+	compilers, or building with -DX8000_NO_THREADED, fall back to a
+	switch over the same op bodies.
+*/
+#if ( defined( __GNUC__ ) || defined( __clang__ ) ) && !defined( X8000_NO_THREADED )
+#define X8000_THREADED
+#endif
+
+void x8000_exe( struct x8000_vm* vm ) {
+	struct x8000_op* op;
+
+#ifdef X8000_PROFILE
+	#define OP_PROFILE() if ( vm->profileOps != NULL ) profileStep( vm, op )
+#else
+	#define OP_PROFILE()
+#endif
+
+#ifdef X8000_THREADED
+	static void* dispatch[ X8000_OPS_COUNT ] = {
+		&&op_bad,
+		&&op_ip,
+		&&op_mov_r,
+		&&op_mov,
+		&&op_cmp_r,
+		&&op_cmp,
+		&&op_jmp,
+		&&op_je,
+		&&op_jne,
+		&&op_jnz,
+		&&op_call,
+		&&op_ret,
+		&&op_inc,
+		&&op_dec,
+		&&op_add_r,
+		&&op_add,
+		&&op_sub_r,
+		&&op_sub,
+		&&op_mul_r,
+		&&op_mul,
+		&&op_div_r,
+		&&op_div,
+		&&op_int,
+		&&op_mov_int,
+		&&op_cmp_jcc,
+		&&op_cmp_r_jcc,
+		&&op_step_cmp_jcc,
+		&&op_step_cmp_r_jcc,
+		&&op_jit,
+		&&op_load_8,
+		&&op_load_16,
+		&&op_load_32,
+		&&op_load_64,
+		&&op_store_8,
+		&&op_store_16,
+		&&op_store_32,
+		&&op_store_64,
+		&&op_rc,
+	};
+
+	#define OP_CASE( kind, label ) label
+	#define OP_NEXT() op = &vm->ops[ vm->opCursor++ ]; vm->instructionCount += op->length; OP_PROFILE(); goto *dispatch[ op->kind ]
+
+	OP_NEXT();
+#else
+	#define OP_CASE( kind, label ) case kind
+	#define OP_NEXT() continue
+
+	while ( true ) {
+		op = &vm->ops[ vm->opCursor++ ];
+		vm->instructionCount += op->length;
+		OP_PROFILE();
+
+		switch ( op->kind ) {
+#endif
+
+	OP_CASE( X8000_OP_IP, op_ip ):
+		if ( x8000_ip( vm, op ) == INSTRUCTION_STATUS_FAILURE ) goto failure;
+		OP_NEXT();
+	OP_CASE( X8000_OP_MOV_R, op_mov_r ):
+		x8000_mov_r( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_MOV, op_mov ):
+		x8000_mov( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_CMP_R, op_cmp_r ):
+		x8000_cmp_r( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_CMP, op_cmp ):
+		x8000_cmp( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_JMP, op_jmp ):
+		x8000_jmp( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_JE, op_je ):
+		x8000_je( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_JNE, op_jne ):
+		x8000_jne( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_JNZ, op_jnz ):
+		x8000_jnz( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_CALL, op_call ):
+		if ( x8000_call( vm, op ) == INSTRUCTION_STATUS_FAILURE ) goto failure;
+		OP_NEXT();
+	OP_CASE( X8000_OP_RET, op_ret ):
+		if ( x8000_ret( vm, op ) == INSTRUCTION_STATUS_FAILURE ) goto failure;
+		OP_NEXT();
+	OP_CASE( X8000_OP_INC, op_inc ):
+		x8000_inc( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_DEC, op_dec ):
+		x8000_dec( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_ADD_R, op_add_r ):
+		x8000_add_r( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_ADD, op_add ):
+		x8000_add( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_SUB_R, op_sub_r ):
+		x8000_sub_r( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_SUB, op_sub ):
+		x8000_sub( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_MUL_R, op_mul_r ):
+		x8000_mul_r( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_MUL, op_mul ):
+		x8000_mul( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_DIV_R, op_div_r ):
+		x8000_div_r( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_DIV, op_div ):
+		x8000_div( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_INT, op_int ):
+		if ( x8000_int( vm, op ) == INSTRUCTION_STATUS_FAILURE ) goto failure;
+		// Only a syscall can stop the program
+		if ( vm->programStatus == false ) return;
+		OP_NEXT();
+	OP_CASE( X8000_OP_MOV_INT, op_mov_int ):
+		if ( x8000_mov_int( vm, op ) == INSTRUCTION_STATUS_FAILURE ) goto failure;
+		if ( vm->programStatus == false ) return;
+		OP_NEXT();
+	OP_CASE( X8000_OP_CMP_JCC, op_cmp_jcc ):
+		x8000_cmp_jcc( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_CMP_R_JCC, op_cmp_r_jcc ):
+		x8000_cmp_r_jcc( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_STEP_CMP_JCC, op_step_cmp_jcc ):
+		x8000_step_cmp_jcc( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_STEP_CMP_R_JCC, op_step_cmp_r_jcc ):
+		x8000_step_cmp_r_jcc( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_JIT, op_jit ):
+		// The block counts its own instructions
+		vm->instructionCount -= op->length;
+		x8000_jit( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_LOAD_8, op_load_8 ):
+		x8000_load_8( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_LOAD_16, op_load_16 ):
+		x8000_load_16( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_LOAD_32, op_load_32 ):
+		x8000_load_32( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_LOAD_64, op_load_64 ):
+		x8000_load_64( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_STORE_8, op_store_8 ):
+		x8000_store_8( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_STORE_16, op_store_16 ):
+		x8000_store_16( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_STORE_32, op_store_32 ):
+		x8000_store_32( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_STORE_64, op_store_64 ):
+		x8000_store_64( vm, op );
+		OP_NEXT();
+	OP_CASE( X8000_OP_RC, op_rc ):
+		if ( x8000_rc( vm, op ) == INSTRUCTION_STATUS_FAILURE ) goto failure;
+		OP_NEXT();
+	OP_CASE( X8000_OP_BAD, op_bad ):
+		goto failure;
+
+#ifndef X8000_THREADED
 		}
+	}
+#endif
 
-		r2 = getRegister( vreg );
+	#undef OP_CASE
+	#undef OP_NEXT
+	#undef OP_PROFILE
 
-		if ( r1 == 0 || r2 == 0 ) {
-			setRegister( reg, 0 );
-		}else {
-			setRegister( reg, ( r1 / r2 ) );
+	failure:
+		vm->programStatus = false;
+
+		if ( vm->exitCode == X8000_EXIT_SUCCESS ) {
+			vm->exitCode = X8000_EXIT_FAILURE;
 		}
 
-		return INSTRUCTION_STATUS_SUCCESS;
+		traceFault( vm );
+}
+// ==================== Program ====================
+
+// ==================== X8000 ====================
+void x8000_init( struct x8000_vm* vm, const struct x8000_options* options ) {
+	vm->stackPointerCapacity = options->stackDepth;
+	vm->memorySandbox = options->sandbox;
+	vm->memoryLimit = options->memoryLimit;
+	vm->heapStats = options->heapStats;
+	vm->inputFd = options->inputFd;
+	vm->outputStdout.fd = options->outputFd;
+	vm->outputStdout.capacity = options->stdoutBuffer;
+	vm->outputStderr.fd = options->errorFd;
+	vm->outputStderr.capacity = options->stderrBuffer;
+	vm->asyncUring = options->ioUring;
+	vm->forkServer = options->forkServer;
+	vm->forkAtSnapshot = options->forkAtSnapshot;
+	vm->forkResult = NULL;
+	vm->profile = options->profile;
+	vm->profileJsonPath = options->profileJson;
+	vm->samplePath = options->sample;
+	vm->symbolsPath = options->symbols;
+	vm->tracePath = options->trace;
+
+	initProgram( vm );
+	initRegisters( vm );
+	initMemory( vm );
+	initHeap( vm );
+	initOutput( vm );
+	initAsync( vm );
+	initDecoder( vm );
+	releaseProgram( vm );
+	initJit( vm );
+	initProfile( vm );
+	initSample( vm );
+	initTrace( vm );
+}
+
+bool x8000_restore( struct x8000_vm* vm, const char* path, const struct x8000_options* options ) {
+	struct x8000_options restored = *options;
+	struct snapshotHeader header;
+	int fd;
+
+	if ( !snapshotOpen( vm, path, &header, &fd ) ) {
+		return false;
 	}
 
-	union {
-		ubyte_t bt[ 8 ];
-		register_t reg;
-	} buffUnion;
-	buffUnion.reg = 0;
+	// The saved memory only makes sense in a region like the one it came from
+	restored.sandbox = true;
+	restored.memoryLimit = header.memoryLimit;
 
+	x8000_init( vm, &restored );
 
-	if ( mode == X8000_DIV_8 ) {
-		buffUnion.bt[ 0 ] = instructionNext();
-		r2 = buffUnion.reg;
-	}else if ( mode == X8000_DIV_16 ) {
-		buffUnion.bt[ 0 ] = instructionNext();
-		buffUnion.bt[ 1 ] = instructionNext();
-		r2 = buffUnion.reg;
-	}else if ( mode == X8000_DIV_32 ) {
-		buffUnion.bt[ 0 ] = instructionNext();
-		buffUnion.bt[ 1 ] = instructionNext();
-		buffUnion.bt[ 2 ] = instructionNext();
-		buffUnion.bt[ 3 ] = instructionNext();
-		r2 = buffUnion.reg;
-	}else if ( mode == X8000_DIV_64 ) {
-		buffUnion.bt[ 0 ] = instructionNext();
-		buffUnion.bt[ 1 ] = instructionNext();
-		buffUnion.bt[ 2 ] = instructionNext();
-		buffUnion.bt[ 3 ] = instructionNext();
-		buffUnion.bt[ 4 ] = instructionNext();
-		buffUnion.bt[ 5 ] = instructionNext();
-		buffUnion.bt[ 6 ] = instructionNext();
-		buffUnion.bt[ 7 ] = instructionNext();
-		r2 = buffUnion.reg;
-	}else {
-		return INSTRUCTION_STATUS_FAILURE;
+	bool status = snapshotRestore( vm, &header, fd );
+	close( fd );
+
+	if ( !status ) {
+		x8000_free( vm );
 	}
 
-	if ( r1 == 0 || r2 == 0 ) {
-		setRegister( reg, 0 );
+	return status;
+}
+
+void x8000_run( struct x8000_vm* vm ) {
+	memoryFaultVm = vm;
+
+	if ( sigsetjmp( vm->memoryFaultJump, 1 ) == 0 ) {
+		sampleStart( vm );
+		traceStart( vm );
+		x8000_exe( vm );
 	}else {
-		setRegister( reg, ( r1 / r2 ) );
+		flushOutput( vm );
+		fprintf( stderr, "Error: Guest memory fault at 0x%lx.\n", (unsigned long)vm->memoryFaultAddress );
+		vm->programStatus = false;
+		vm->exitCode = X8000_EXIT_FAILURE;
+		traceFault( vm );
 	}
 
-	return INSTRUCTION_STATUS_SUCCESS;
+	traceStop( vm );
+	sampleStop( vm );
+	profileStop( vm );
+	memoryFaultVm = NULL;
 }
 
-ubyte_t x8000_int() {
-	return syscall(
-		registers.RK,
-		registers.RP1,
-		registers.RP2,
-		registers.RP3,
-		registers.RP4,
-		registers.RP5,
-		registers.RP6,
-		registers.RP7,
-		registers.RP8
-	);
+void x8000_free( struct x8000_vm* vm ) {
+	freeAsync( vm );
+	freeOutput( vm );
+	freeProfile( vm );
+	freeSample( vm );
+	freeTrace( vm );
+	freeJit( vm );
+	freeDecoder( vm );
+	freeProgram( vm );
+	freeRegisters( vm );
+	freeHeap( vm );
+	freeMemory( vm );
 }
-// ==================== Instruction ====================
+// ==================== X8000 ====================
 
-// ==================== Syscall ====================
-ubyte_t syscall(
-	register_t rk,
-	register_t rp1,
-	register_t rp2,
-	register_t rp3,
-	register_t rp4,
-	register_t rp5,
-	register_t rp6,
-	register_t rp7,
-	register_t rp8
-) {
-	switch ( rk ) {
-	case SYSCALL_CODE_WRITE: {
-		return syscall_write( rp1, (x8000_address_t)rp2, (size_t)rp3 );
-	}
-	case SYSCALL_CODE_READ: {
-		return syscall_read( rp1, (x8000_address_t)rp2, (size_t)rp3 );
+// ==================== Batch ====================
+int x8000_batch( const char* path, size_t workers, const struct x8000_options* options ) {
+	if ( batchLoad( path ) == false ) {
+		batchFree();
+		return EXIT_FAILURE;
 	}
-	case SYSCALL_CODE_EXIT: {
-		return syscall_exit( rp1 );
+
+	if ( workers > batchJobsCount ) workers = batchJobsCount;
+	if ( workers == 0 ) workers = 1;
+
+	batchOptions = *options;
+	batchQueuesCount = workers;
+	batchQueues = (struct batchQueue*)calloc( workers, sizeof( struct batchQueue ) );
+
+	size_t capacity = batchJobsCount / workers + 1;
+
+	for ( size_t i = 0; i < workers; i++ ) {
+		pthread_mutex_init( &batchQueues[ i ].lock, NULL );
+		batchQueues[ i ].jobs = (size_t*)malloc( capacity * sizeof( size_t ) );
 	}
-	case SYSCALL_CODE_MALLOC: {
-		x8000_address_t address = syscall_malloc( rp1 );
-		if ( address == (x8000_address_t)NULL ) {
-			return SYSCALL_STATUS_FAILURE;
-		}
-		registers.RR1 = (x8000_address_t)address;
-		return SYSCALL_STATUS_SUCCESS;
+
+	for ( size_t i = 0; i < batchJobsCount; i++ ) {
+		struct batchQueue* queue = &batchQueues[ i % workers ];
+		queue->jobs[ queue->tail++ ] = i;
 	}
-	case SYSCALL_CODE_REALLOC: {
-		x8000_address_t address = syscall_realloc( (x8000_address_t)rp1, rp2 );
-		if ( address == (x8000_address_t)NULL ) {
-			return SYSCALL_STATUS_FAILURE;
-		}
-		registers.RR1 = (x8000_address_t)address;
-		return SYSCALL_STATUS_SUCCESS;
+
+	pthread_t* threads = (pthread_t*)malloc( workers * sizeof( pthread_t ) );
+	size_t started = 0;
+
+	while ( started < workers && pthread_create( &threads[ started ], NULL, batchWorker, (void*)(uintptr_t)started ) == 0 ) {
+		started++;
 	}
-	case SYSCALL_CODE_FREE: {
-		return syscall_free( (x8000_address_t)rp1 );
+
+	// Jobs of workers that could not start are stolen by the others
+	if ( started == 0 ) {
+		batchWorker( (void*)(uintptr_t)0 );
 	}
-	case SYSCALL_CODE_WBUFF: {
-		return syscall_wbuff( (x8000_address_t)rp1, (char)rp2 );
+
+	for ( size_t i = 0; i < started; i++ ) {
+		pthread_join( threads[ i ], NULL );
 	}
-	default:
-		return SYSCALL_STATUS_FAILURE;
+
+	free( threads );
+	batchReport();
+
+	int status = EXIT_SUCCESS;
+
+	for ( size_t i = 0; i < batchJobsCount; i++ ) {
+		if ( batchJobs[ i ].started == false || batchJobs[ i ].exitCode != X8000_EXIT_SUCCESS ) {
+			status = EXIT_FAILURE;
+		}
 	}
+
+	batchFree();
+
+	return status;
 }
 
-ubyte_t syscall_write( register_t file_descriptor, x8000_address_t buff, size_t buff_size ) {
-	if ( file_descriptor == FILE_DESCRIPTOR_STDOUT ) {
-		write( STDOUT_FILENO, (void*)buff, buff_size );
-	}else if ( file_descriptor == FILE_DESCRIPTOR_STDERR ) {
-		write( STDERR_FILENO, (void*)buff, buff_size );
-	}else {
-		return SYSCALL_STATUS_FAILURE;
+bool batchLoad( const char* path ) {
+	FILE* fptr = fopen( path, "r" );
+	if ( fptr == NULL ) {
+		fprintf( stdout, "Error: Cannot open the batch file.\n" );
+		return false;
 	}
 
-	return SYSCALL_STATUS_SUCCESS;
-}
+	char* line = NULL;
+	size_t lineSize = 0;
+	size_t lineNumber = 0;
+	size_t capacity = 0;
+	bool status = true;
 
-ubyte_t syscall_read( register_t file_descriptor, x8000_address_t buff, size_t buff_size ) {
-	if ( file_descriptor == FILE_DESCRIPTOR_STDIN ) {
-		ssize_t res = read( STDIN_FILENO, (void*)buff, buff_size );
-		return res > 0 ? SYSCALL_STATUS_SUCCESS : SYSCALL_STATUS_FAILURE;
-	}else {
-		return SYSCALL_STATUS_FAILURE;
+	while ( getline( &line, &lineSize, fptr ) >= 0 ) {
+		char* save = NULL;
+		char* program = strtok_r( line, BATCH_LINE_SEPARATORS, &save );
+		lineNumber++;
+
+		if ( program == NULL || program[ 0 ] == '#' ) {
+			continue;
+		}
+
+		char* input = strtok_r( NULL, BATCH_LINE_SEPARATORS, &save );
+		char* output = input == NULL ? NULL : strtok_r( NULL, BATCH_LINE_SEPARATORS, &save );
+
+		if ( output != NULL && strtok_r( NULL, BATCH_LINE_SEPARATORS, &save ) != NULL ) {
+			fprintf( stdout, "Error: Invalid batch job at line %zu.\n", lineNumber );
+			status = false;
+			break;
+		}
+
+		if ( batchJobsCount == capacity ) {
+			capacity = capacity == 0 ? 0x40 : capacity * 2;
+			batchJobs = (struct batchJob*)realloc( batchJobs, capacity * sizeof( struct batchJob ) );
+		}
+
+		struct batchJob* job = &batchJobs[ batchJobsCount++ ];
+
+		job->program = batchProgramOf( program );
+		job->input = input == NULL || strcmp( input, "-" ) == 0 ? NULL : strdup( input );
+		job->output = output == NULL || strcmp( output, "-" ) == 0 ? NULL : strdup( output );
+		job->started = false;
+		job->exitCode = X8000_EXIT_FAILURE;
+		job->time = 0;
 	}
-}
 
-ubyte_t syscall_exit( register_t status ) {
-	programStatus = false;
-	exitCode = status;
-	return SYSCALL_STATUS_SUCCESS;
-}
+	free( line );
+	fclose( fptr );
 
-x8000_address_t syscall_malloc( size_t buff_size ) {
-	return (x8000_address_t)malloc( buff_size );
+	return status;
 }
 
-x8000_address_t syscall_realloc( x8000_address_t address, size_t new_size ) {
-	return (x8000_address_t)realloc( (void*)address, new_size );
-}
+struct batchProgram* batchProgramOf( const char* path ) {
+	struct batchProgram* current = batchPrograms;
 
-ubyte_t syscall_free( x8000_address_t address ) {
-	free( (void*)address );
-	return SYSCALL_STATUS_SUCCESS;
-}
+	while ( current != NULL ) {
+		if ( strcmp( current->path, path ) == 0 ) {
+			return current;
+		}
 
-ubyte_t syscall_wbuff( x8000_address_t address, char ch ) {
-	if ( address == NULL_ADDRESS ) {
-		return SYSCALL_STATUS_FAILURE;
+		current = current->next;
 	}
 
-	char* ptr = (char*)address;
-	*ptr = ch;
+	current = (struct batchProgram*)malloc( sizeof( struct batchProgram ) );
+	current->path = strdup( path );
+	current->loaded = openProgram( path, &current->data, &current->size, &current->mapSize );
+	current->next = batchPrograms;
+	batchPrograms = current;
 
-	return SYSCALL_STATUS_SUCCESS;
+	if ( current->loaded == false ) {
+		fprintf( stderr, "Error: Cannot load %s, its jobs are skipped.\n", path );
+	}
+
+	return current;
 }
-// ==================== Syscall ====================
 
-// ==================== Program ====================
-void initProgram( ubyte_t* _program ) {
-	program = _program;
+void batchFree() {
+	for ( size_t i = 0; i < batchJobsCount; i++ ) {
+		if ( batchJobs[ i ].input != NULL ) free( batchJobs[ i ].input );
+		if ( batchJobs[ i ].output != NULL ) free( batchJobs[ i ].output );
+	}
+
+	for ( size_t i = 0; i < batchQueuesCount; i++ ) {
+		pthread_mutex_destroy( &batchQueues[ i ].lock );
+		free( batchQueues[ i ].jobs );
+	}
+
+	struct batchProgram* current = batchPrograms;
+
+	while ( current != NULL ) {
+		struct batchProgram* _next = current->next;
+
+		if ( current->loaded ) {
+			closeProgram( current->data, current->mapSize );
+		}
+
+		free( current->path );
+		free( current );
+		current = _next;
+	}
+
+	if ( batchJobs != NULL ) free( batchJobs );
+	if ( batchQueues != NULL ) free( batchQueues );
+
+	batchPrograms = NULL;
+	batchJobs = NULL;
+	batchJobsCount = 0;
+	batchQueues = NULL;
+	batchQueuesCount = 0;
 }
 
-void freeProgram() {
-	free( program );
+void* batchWorker( void* arg ) {
+	size_t self = (size_t)(uintptr_t)arg;
+	size_t job = 0;
+
+	// A VM is large, it is reused for every job of this worker
+	struct x8000_vm* vm = (struct x8000_vm*)malloc( sizeof( struct x8000_vm ) );
+	if ( vm == NULL ) {
+		return arg;
+	}
+
+	while ( batchNext( self, &job ) ) {
+		batchRun( vm, &batchJobs[ job ] );
+	}
+
+	free( vm );
+
+	return arg;
 }
 
-void x8000_exe() {
-	while ( programStatus ) {
-		ubyte_t ins = instructionNext();
-		ubyte_t res = handleInstruction( ins );
+bool batchNext( size_t self, size_t* job ) {
+	for ( size_t i = 0; i < batchQueuesCount; i++ ) {
+		struct batchQueue* queue = &batchQueues[ ( self + i ) % batchQueuesCount ];
+		bool found = false;
 
-		if ( res == INSTRUCTION_STATUS_FAILURE ) {
-			programStatus = false;
+		pthread_mutex_lock( &queue->lock );
 
-			if ( exitCode == X8000_EXIT_SUCCESS ) {
-				exitCode = X8000_EXIT_FAILURE;
-			}
+		if ( queue->head < queue->tail ) {
+			// Our own queue from the front, anyone else's from the back
+			*job = i == 0 ? queue->jobs[ queue->head++ ] : queue->jobs[ --queue->tail ];
+			found = true;
+		}
+
+		pthread_mutex_unlock( &queue->lock );
+
+		if ( found ) {
+			return true;
 		}
 	}
+
+	return false;
 }
-// ==================== Program ====================
 
-// ==================== X8000 ====================
-void x8000_init( ubyte_t* _program ) {
-	initProgram( _program );
-	initRegisters();
+void batchRun( struct x8000_vm* vm, struct batchJob* job ) {
+	struct timespec start;
+	struct timespec end;
+	clock_gettime( CLOCK_MONOTONIC, &start );
+
+	struct x8000_options options = batchOptions;
+	int input = open( job->input != NULL ? job->input : "/dev/null", O_RDONLY );
+	int output = job->output != NULL ? open( job->output, O_WRONLY | O_CREAT | O_TRUNC, 0644 ) : open( "/dev/null", O_WRONLY );
+
+	if ( input < 0 || output < 0 ) {
+		fprintf( stderr, "Error: Cannot open %s.\n", input < 0 ? job->input : job->output );
+	}else if ( job->program->loaded ) {
+		options.inputFd = input;
+		options.outputFd = output;
+
+		shareProgram( vm, job->program->data, job->program->size );
+		x8000_init( vm, &options );
+		x8000_run( vm );
+		x8000_free( vm );
+
+		job->exitCode = vm->exitCode;
+		job->started = true;
+	}
+
+	if ( input >= 0 ) close( input );
+	if ( output >= 0 ) close( output );
+
+	clock_gettime( CLOCK_MONOTONIC, &end );
+	job->time = (double)( end.tv_sec - start.tv_sec ) * 1e3 + (double)( end.tv_nsec - start.tv_nsec ) / 1e6;
 }
 
-void x8000_free() {
-	freeProgram();
-	freeRegisters();
+void batchReport() {
+	fprintf( stdout, "%-8s %10s %12s  %s\n", "job", "exit", "time(ms)", "program < input" );
+
+	for ( size_t i = 0; i < batchJobsCount; i++ ) {
+		struct batchJob* job = &batchJobs[ i ];
+		const char* input = job->input != NULL ? job->input : "-";
+
+		if ( job->started ) {
+			fprintf( stdout, "%-8zu %10lld %12.3f  %s < %s\n", i, job->exitCode, job->time, job->program->path, input );
+		}else {
+			fprintf( stdout, "%-8zu %10s %12.3f  %s < %s\n", i, "-", job->time, job->program->path, input );
+		}
+	}
 }
-// ==================== X8000 ====================
+// ==================== Batch ====================
 
 // ==================== Main ====================
+size_t optionValue( int argc, char* argv[], int* i ) {
+	char* option = argv[ *i ];
+	char* end = NULL;
+
+	if ( *i + 1 >= argc ) {
+		fprintf( stdout, "Error: Missing value for %s.\n", option );
+		exit( EXIT_FAILURE );
+	}
+
+	size_t value = (size_t)strtoull( argv[ ++*i ], &end, 0 );
+
+	if ( *end != '\0' ) {
+		fprintf( stdout, "Error: Invalid value for %s.\n", option );
+		exit( EXIT_FAILURE );
+	}
+
+	return value;
+}
+
 int main( int argc, char* argv[] ) {
-	if ( argc != 2 ) {
-		if ( argc == 1 ) {
-			fprintf( stdout, "Error: No file specified.\n" );
-			exit( EXIT_FAILURE );
+	struct x8000_options options = X8000_OPTIONS_DEFAULT;
+	struct x8000_vm vm;
+	char* fileAddress = NULL;
+	char* batchAddress = NULL;
+	char* restoreAddress = NULL;
+	char symbolsAddress[ PATH_MAX ];
+	size_t batchWorkers = 0;
+	bool printStats = false;
+
+	for ( int i = 1; i < argc; i++ ) {
+		if ( strcmp( argv[ i ], "--stack-depth" ) == 0 ) {
+			options.stackDepth = optionValue( argc, argv, &i );
+
+			if ( options.stackDepth == 0 ) {
+				fprintf( stdout, "Error: Invalid stack depth.\n" );
+				exit( EXIT_FAILURE );
+			}
+		}else if ( strcmp( argv[ i ], "--heap-stats" ) == 0 ) {
+			options.heapStats = true;
+		}else if ( strcmp( argv[ i ], "--stats" ) == 0 ) {
+			printStats = true;
+		}else if ( strcmp( argv[ i ], "--sandbox" ) == 0 ) {
+			options.sandbox = true;
+		}else if ( strcmp( argv[ i ], "--memory-limit" ) == 0 ) {
+			options.memoryLimit = optionValue( argc, argv, &i );
+
+			if ( options.memoryLimit == 0 || options.memoryLimit > MEMORY_LIMIT_MAX ) {
+				fprintf( stdout, "Error: Invalid memory limit.\n" );
+				exit( EXIT_FAILURE );
+			}
+
+			// The limit is enforced with page protection, round it to whole pages
+			options.memoryLimit = ( options.memoryLimit + MEMORY_GUARD_SIZE - 1 ) & ~( MEMORY_GUARD_SIZE - 1 );
+			options.sandbox = true;
+		}else if ( strcmp( argv[ i ], "--no-io-uring" ) == 0 ) {
+			options.ioUring = false;
+		}else if ( strcmp( argv[ i ], "--stdout-buffer" ) == 0 ) {
+			options.stdoutBuffer = optionValue( argc, argv, &i );
+		}else if ( strcmp( argv[ i ], "--stderr-buffer" ) == 0 ) {
+			options.stderrBuffer = optionValue( argc, argv, &i );
+		}else if ( strcmp( argv[ i ], "--batch" ) == 0 ) {
+			if ( i + 1 >= argc ) {
+				fprintf( stdout, "Error: Missing value for --batch.\n" );
+				exit( EXIT_FAILURE );
+			}
+
+			batchAddress = argv[ ++i ];
+		}else if ( strcmp( argv[ i ], "--restore" ) == 0 ) {
+			if ( i + 1 >= argc ) {
+				fprintf( stdout, "Error: Missing value for --restore.\n" );
+				exit( EXIT_FAILURE );
+			}
+
+			restoreAddress = argv[ ++i ];
+		}else if ( strcmp( argv[ i ], "--fork-server" ) == 0 ) {
+			if ( i + 1 >= argc ) {
+				fprintf( stdout, "Error: Missing value for --fork-server.\n" );
+				exit( EXIT_FAILURE );
+			}
+
+			options.forkServer = argv[ ++i ];
+		}else if ( strcmp( argv[ i ], "--fork-at-snapshot" ) == 0 ) {
+			options.forkAtSnapshot = true;
+		}else if ( strcmp( argv[ i ], "--profile" ) == 0 ) {
+			options.profile = true;
+		}else if ( strcmp( argv[ i ], "--profile-json" ) == 0 ) {
+			if ( i + 1 >= argc ) {
+				fprintf( stdout, "Error: Missing value for --profile-json.\n" );
+				exit( EXIT_FAILURE );
+			}
+
+			options.profileJson = argv[ ++i ];
+			options.profile = true;
+		}else if ( strcmp( argv[ i ], "--sample" ) == 0 ) {
+			if ( i + 1 >= argc ) {
+				fprintf( stdout, "Error: Missing value for --sample.\n" );
+				exit( EXIT_FAILURE );
+			}
+
+			options.sample = argv[ ++i ];
+		}else if ( strcmp( argv[ i ], "--symbols" ) == 0 ) {
+			if ( i + 1 >= argc ) {
+				fprintf( stdout, "Error: Missing value for --symbols.\n" );
+				exit( EXIT_FAILURE );
+			}
+
+			options.symbols = argv[ ++i ];
+		}else if ( strcmp( argv[ i ], "--trace" ) == 0 ) {
+			if ( i + 1 >= argc ) {
+				fprintf( stdout, "Error: Missing value for --trace.\n" );
+				exit( EXIT_FAILURE );
+			}
+
+			options.trace = argv[ ++i ];
+		}else if ( strcmp( argv[ i ], "-j" ) == 0 ) {
+			batchWorkers = optionValue( argc, argv, &i );
+
+			if ( batchWorkers == 0 ) {
+				fprintf( stdout, "Error: Invalid worker count.\n" );
+				exit( EXIT_FAILURE );
+			}
+		}else if ( fileAddress == NULL ) {
+			fileAddress = argv[ i ];
 		}else {
 			fprintf( stdout, "Error: Invalid argv.\n" );
 			exit( EXIT_FAILURE );
 		}
 	}
 
-	char* fileAddress = argv[ 1 ];
+#ifndef X8000_PROFILE
+	if ( options.profile ) {
+		fprintf( stdout, "Error: This build has no profiler, use x8000-profile.\n" );
+		exit( EXIT_FAILURE );
+	}
+#endif
 
-	FILE* fptr = fopen( fileAddress, "rb" );
-	if ( fptr == NULL ) {
-		fprintf( stdout, "Error: Cannot open the specified file.\n" );
+	if ( batchAddress != NULL ) {
+		if ( fileAddress != NULL || restoreAddress != NULL || options.forkServer != NULL || options.profile || options.sample != NULL || options.trace != NULL ) {
+			fprintf( stdout, "Error: Invalid argv.\n" );
+			exit( EXIT_FAILURE );
+		}
+
+		if ( batchWorkers == 0 ) {
+			long online = sysconf( _SC_NPROCESSORS_ONLN );
+			batchWorkers = online > 0 ? (size_t)online : 1;
+		}
+
+		exit( x8000_batch( batchAddress, batchWorkers, &options ) );
+	}
+
+	if ( restoreAddress != NULL ) {
+		if ( fileAddress != NULL ) {
+			fprintf( stdout, "Error: Invalid argv.\n" );
+			exit( EXIT_FAILURE );
+		}
+
+		if ( !x8000_restore( &vm, restoreAddress, &options ) ) {
+			exit( EXIT_FAILURE );
+		}
+	}else {
+		if ( fileAddress == NULL ) {
+			fprintf( stdout, "Error: No file specified.\n" );
+			exit( EXIT_FAILURE );
+		}
+
+		if ( !loadProgram( &vm, fileAddress ) ) {
+			exit( EXIT_FAILURE );
+		}
+
+		if ( options.sample != NULL && options.symbols == NULL ) {
+			options.symbols = symbolsSidecar( fileAddress, symbolsAddress, sizeof( symbolsAddress ) );
+		}
+
+		x8000_init( &vm, &options );
+	}
+
+	if ( options.forkServer != NULL && options.forkAtSnapshot == false && !forkServe( &vm ) ) {
+		x8000_free( &vm );
 		exit( EXIT_FAILURE );
 	}
 
-	fseek( fptr, 0L, SEEK_END );
-	size_t fileSize = ftell( fptr );
-	rewind( fptr );
+	struct timespec start;
+	struct timespec end;
+	clock_gettime( CLOCK_MONOTONIC, &start );
 
-	ubyte_t* file = (ubyte_t*)malloc( fileSize );
-	fread( file, 1, fileSize, fptr );
+	x8000_run( &vm );
+	forkFinish( &vm );
 
-	// printf( "SIZE=%d\n", fileSize );
-	// for ( size_t i = 0; i < fileSize; i++ ) {
-	// 	printf( "%d\n", file[ i ] );
-	// }
+	// One line a benchmark harness can parse, the time leaves out loading and decoding
+	if ( printStats ) {
+		clock_gettime( CLOCK_MONOTONIC, &end );
+		long long ns = ( end.tv_sec - start.tv_sec ) * 1000000000LL + ( end.tv_nsec - start.tv_nsec );
 
-	x8000_init( file );
-	x8000_exe();
+		flushOutput( &vm );
+		fprintf( stderr, "Stats: %llu instructions in %lld ns\n", (unsigned long long)vm.instructionCount, ns );
+	}
 
-	out:
-		x8000_free();
-		exit( exitCode );
+	x8000_free( &vm );
+	exit( vm.exitCode );
 }
 // ==================== Main ====================
 
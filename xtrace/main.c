@@ -0,0 +1,654 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+// ==================== XTRACE Define ====================
+typedef unsigned char ubyte_t;
+
+/*
+	Reads the trace x8000 --trace writes on a failure or on SIGUSR1 and
+	prints every instruction it covers, oldest first. The trace only
+	holds taken branches, runs of RETs and writes to IP, so the
+	instructions in between are found by walking the program image
+	stored with it, and where each RET went is taken from the CALLs
+	walked before it. A loop is listed once with the number of times it
+	ran again, except for the passes that made a syscall still in the
+	trace. See the Trace section of x8000/main.c for the layout.
+*/
+#define TRACE_MAGIC		"X8000TRC"
+#define TRACE_VERSION		2
+#define TRACE_JUMP		(uint32_t) 0x80000000
+#define TRACE_RET		(uint32_t) 0x40000000
+#define TRACE_NONE		UINT64_MAX
+#define TRACE_STACK_MAX		(size_t) 0x1000000
+#define TRACE_REGISTERS_COUNT	28
+#define TRACE_COLUMN_WIDTH	10
+#define TRACE_BRANCH_SIZE	9
+#define TRACE_WALK_MAX		(uint64_t) 0x100000
+
+#define TRACE_REASON_FAULT	(uint32_t) 0x1
+#define TRACE_REASON_SIGNAL	(uint32_t) 0x2
+
+struct traceHeader {
+	char magic[ 8 ];
+	uint32_t version;
+	uint32_t reason;
+	uint64_t instructionCount;
+	uint64_t entriesCount;
+	uint64_t entries;
+	uint64_t syscalls;
+	uint64_t programSize;
+	uint64_t start;
+	uint64_t ip;
+	int64_t regs[ TRACE_REGISTERS_COUNT ];
+};
+
+struct traceEntry {
+	uint32_t address;
+	uint32_t value;
+};
+
+struct traceSyscall {
+	uint64_t entries;
+	uint32_t ip;
+	uint32_t repeat;
+	int64_t rk;
+	int64_t rp1;
+	int64_t rp2;
+	int64_t rp3;
+	int64_t rr1;
+};
+
+struct trace {
+	struct traceHeader header;
+	struct traceEntry* entries;
+	struct traceSyscall* syscalls;
+	ubyte_t* program;
+	uint64_t syscall;
+	// Return addresses of the CALLs walked so far, RET entries pop them
+	uint64_t* stack;
+	size_t stackSize;
+	size_t stackCapacity;
+};
+
+bool readTrace( FILE* file );
+void printTrace( struct trace* trace );
+uint64_t printBranch( struct trace* trace, uint64_t ip, uint64_t index, struct traceEntry* entry );
+uint64_t printReturns( struct trace* trace, uint64_t ip, uint64_t index, struct traceEntry* entry );
+uint64_t walkTrace( struct trace* trace, uint64_t ip, uint64_t end, uint64_t entries, uint64_t repeat, uint64_t jump, bool print );
+void printInstruction( struct trace* trace, uint64_t ip, uint64_t entries, uint64_t repeat, uint64_t jump );
+void printRepeat( uint64_t from, uint64_t to, uint64_t count );
+void printRegisters( struct trace* trace );
+struct traceSyscall* nextSyscall( struct trace* trace, uint64_t entries, uint64_t repeat );
+void pushReturn( struct trace* trace, uint64_t address );
+uint64_t popReturn( struct trace* trace );
+uint64_t branchTarget( const ubyte_t* program, uint64_t ip );
+size_t instructionSize( ubyte_t ins );
+bool isTransferInstruction( const ubyte_t* in );
+const char* opcodeName( ubyte_t opcode );
+const char* registerName( ubyte_t code );
+const char* syscallName( int64_t code );
+// ==================== XTRACE Define ====================
+
+// ==================== X8000 Utils ====================
+#define X8000_LOAD_8	(ubyte_t) 0x11
+#define X8000_LOAD_16	(ubyte_t) 0x12
+#define X8000_LOAD_32	(ubyte_t) 0x13
+#define X8000_LOAD_64	(ubyte_t) 0x14
+#define X8000_STORE_8	(ubyte_t) 0x15
+#define X8000_STORE_16	(ubyte_t) 0x16
+#define X8000_STORE_32	(ubyte_t) 0x17
+#define X8000_STORE_64	(ubyte_t) 0x18
+#define X8000_MOV_R	(ubyte_t) 0x20
+#define X8000_MOV_8	(ubyte_t) 0x21
+#define X8000_MOV_16	(ubyte_t) 0x22
+#define X8000_MOV_32	(ubyte_t) 0x23
+#define X8000_MOV_64	(ubyte_t) 0x24
+#define X8000_CMP_R	(ubyte_t) 0x31
+#define X8000_CMP_8	(ubyte_t) 0x32
+#define X8000_CMP_16	(ubyte_t) 0x33
+#define X8000_CMP_32	(ubyte_t) 0x34
+#define X8000_CMP_64	(ubyte_t) 0x35
+#define X8000_JMP	(ubyte_t) 0x40
+#define X8000_JE	(ubyte_t) 0x41
+#define X8000_JNE	(ubyte_t) 0x42
+#define X8000_JNZ	(ubyte_t) 0x43
+#define X8000_CALL	(ubyte_t) 0x51
+#define X8000_RET	(ubyte_t) 0x52
+#define X8000_INC	(ubyte_t) 0x61
+#define X8000_DEC	(ubyte_t) 0x62
+#define X8000_ADD_R	(ubyte_t) 0x66
+#define X8000_ADD_8	(ubyte_t) 0x67
+#define X8000_ADD_16	(ubyte_t) 0x68
+#define X8000_ADD_32	(ubyte_t) 0x69
+#define X8000_ADD_64	(ubyte_t) 0x70
+#define X8000_SUB_R	(ubyte_t) 0x76
+#define X8000_SUB_8	(ubyte_t) 0x77
+#define X8000_SUB_16	(ubyte_t) 0x78
+#define X8000_SUB_32	(ubyte_t) 0x79
+#define X8000_SUB_64	(ubyte_t) 0x80
+#define X8000_MUL_R	(ubyte_t) 0x86
+#define X8000_MUL_8	(ubyte_t) 0x87
+#define X8000_MUL_16	(ubyte_t) 0x88
+#define X8000_MUL_32	(ubyte_t) 0x89
+#define X8000_MUL_64	(ubyte_t) 0x90
+#define X8000_DIV_R	(ubyte_t) 0x96
+#define X8000_DIV_8	(ubyte_t) 0x97
+#define X8000_DIV_16	(ubyte_t) 0x98
+#define X8000_DIV_32	(ubyte_t) 0x99
+#define X8000_DIV_64	(ubyte_t) 0x9A
+#define X8000_INT	(ubyte_t) 0xFF
+
+#define REGISTER_IP	(ubyte_t) 0xA0
+
+#define SYSCALL_CODE_WRITE	(ubyte_t) 0x01
+#define SYSCALL_CODE_READ	(ubyte_t) 0x02
+#define SYSCALL_CODE_FLUSH	(ubyte_t) 0x03
+#define SYSCALL_CODE_WRITEV	(ubyte_t) 0x04
+#define SYSCALL_CODE_READV	(ubyte_t) 0x05
+#define SYSCALL_CODE_SUBMIT_READ	(ubyte_t) 0x06
+#define SYSCALL_CODE_SUBMIT_WRITE	(ubyte_t) 0x07
+#define SYSCALL_CODE_POLL	(ubyte_t) 0x08
+#define SYSCALL_CODE_WAIT	(ubyte_t) 0x09
+#define SYSCALL_CODE_EXIT	(ubyte_t) 0x0A
+#define SYSCALL_CODE_SNAPSHOT	(ubyte_t) 0x0B
+#define SYSCALL_CODE_MALLOC	(ubyte_t) 0x61
+#define SYSCALL_CODE_REALLOC	(ubyte_t) 0x62
+#define SYSCALL_CODE_FREE	(ubyte_t) 0x63
+#define SYSCALL_CODE_WBUFF	(ubyte_t) 0x64
+#define SYSCALL_CODE_MEMCPY	(ubyte_t) 0x71
+#define SYSCALL_CODE_MEMMOVE	(ubyte_t) 0x72
+#define SYSCALL_CODE_MEMSET	(ubyte_t) 0x73
+#define SYSCALL_CODE_MEMCMP	(ubyte_t) 0x74
+#define SYSCALL_CODE_MEMCHR	(ubyte_t) 0x75
+
+const char* registerNames[ TRACE_REGISTERS_COUNT ] = {
+	"IP", "RK", "RC", "SP",
+	"R1", "R2", "R3", "R4", "R5", "R6", "R7", "R8",
+	"RP1", "RP2", "RP3", "RP4", "RP5", "RP6", "RP7", "RP8",
+	"RR1", "RR2", "RR3", "RR4", "RR5", "RR6", "RR7", "RR8",
+};
+// ==================== X8000 Utils ====================
+
+// ==================== XTRACE ====================
+bool readTrace( FILE* file ) {
+	struct trace trace;
+
+	if ( fread( &trace.header, sizeof( trace.header ), 1, file ) != 1 || memcmp( trace.header.magic, TRACE_MAGIC, sizeof( trace.header.magic ) ) != 0 ) {
+		fprintf( stderr, "Error: Not an x8000 trace.\n" );
+		return false;
+	}
+
+	if ( trace.header.version != TRACE_VERSION ) {
+		fprintf( stderr, "Error: Unsupported trace version %u.\n", trace.header.version );
+		return false;
+	}
+
+	struct traceHeader* header = &trace.header;
+
+	if ( header->entries > header->entriesCount || header->programSize >= TRACE_RET || header->start > header->programSize || header->ip > header->programSize ) {
+		fprintf( stderr, "Error: The trace is corrupt.\n" );
+		return false;
+	}
+
+	trace.entries = (struct traceEntry*)malloc( header->entries * sizeof( struct traceEntry ) + 1 );
+	trace.syscalls = (struct traceSyscall*)malloc( header->syscalls * sizeof( struct traceSyscall ) + 1 );
+	// Zeroed past the end, so decoding the last instruction never reads outside
+	trace.program = (ubyte_t*)calloc( header->programSize + TRACE_BRANCH_SIZE + 1, 1 );
+	trace.syscall = 0;
+	trace.stack = NULL;
+	trace.stackSize = 0;
+	trace.stackCapacity = 0;
+
+	bool status = trace.entries != NULL && trace.syscalls != NULL && trace.program != NULL;
+
+	if ( !status ) {
+		fprintf( stderr, "Error: Cannot allocate memory.\n" );
+	}else if (
+		fread( trace.entries, sizeof( struct traceEntry ), header->entries, file ) != header->entries ||
+		fread( trace.syscalls, sizeof( struct traceSyscall ), header->syscalls, file ) != header->syscalls ||
+		fread( trace.program, 1, header->programSize, file ) != header->programSize
+	) {
+		fprintf( stderr, "Error: The trace is truncated.\n" );
+		status = false;
+	}
+
+	if ( status ) {
+		printTrace( &trace );
+	}
+
+	if ( trace.entries != NULL ) free( trace.entries );
+	if ( trace.syscalls != NULL ) free( trace.syscalls );
+	if ( trace.program != NULL ) free( trace.program );
+	if ( trace.stack != NULL ) free( trace.stack );
+	return status;
+}
+
+void printTrace( struct trace* trace ) {
+	struct traceHeader* header = &trace->header;
+	uint64_t first = header->entriesCount - header->entries;
+	uint64_t ip = header->start;
+
+	fprintf( stdout, "# %s after %llu instructions, %llu of %llu branches\n",
+		header->reason == TRACE_REASON_FAULT ? "fault" : header->reason == TRACE_REASON_SIGNAL ? "signal" : "dump",
+		(unsigned long long)header->instructionCount, (unsigned long long)header->entries, (unsigned long long)header->entriesCount );
+
+	if ( first != 0 ) {
+		// What led up to the oldest entry is gone, walking starts after the first branch
+		fprintf( stdout, "# older branches were overwritten\n" );
+		ip = TRACE_NONE;
+	}
+
+	for ( uint64_t i = 0; i < header->entries; i++ ) {
+		struct traceEntry* entry = &trace->entries[ i ];
+
+		if ( entry->address & TRACE_JUMP ) {
+			if ( ip != TRACE_NONE ) {
+				walkTrace( trace, ip, entry->value, first + i, TRACE_NONE, entry->address & ~TRACE_JUMP, true );
+			}
+
+			ip = entry->address & ~TRACE_JUMP;
+		}else if ( entry->address == TRACE_RET ) {
+			ip = printReturns( trace, ip, first + i, entry );
+		}else {
+			ip = printBranch( trace, ip, first + i, entry );
+		}
+	}
+
+	// Up to the instruction running when the dump was taken
+	if ( ip != TRACE_NONE ) {
+		uint64_t end = header->ip < header->programSize ? header->ip + instructionSize( trace->program[ header->ip ] ) : header->programSize;
+
+		// A signal inside a compiled block only knows which block was entered
+		if ( header->reason == TRACE_REASON_SIGNAL && walkTrace( trace, ip, end, header->entriesCount, TRACE_NONE, TRACE_NONE, false ) == TRACE_NONE ) {
+			fprintf( stdout, "# running in a compiled block after 0x%08llx when the signal came\n", (unsigned long long)ip );
+		}else if ( walkTrace( trace, ip, end, header->entriesCount, TRACE_NONE, TRACE_NONE, true ) != TRACE_NONE ) {
+			if ( header->ip == header->programSize ) {
+				fprintf( stdout, "0x%08llx  end of the program\n", (unsigned long long)header->ip );
+			}
+
+			fprintf( stdout, "# %s\n", header->reason == TRACE_REASON_FAULT ? "the last instruction failed" : "running here when the signal came" );
+		}
+	}
+
+	printRegisters( trace );
+}
+
+uint64_t printBranch( struct trace* trace, uint64_t ip, uint64_t index, struct traceEntry* entry ) {
+	uint64_t end = entry->address;
+	uint64_t branch = end - TRACE_BRANCH_SIZE;
+	uint64_t target = branchTarget( trace->program, branch );
+	bool call = trace->program[ branch ] == X8000_CALL;
+
+	// Lost track before, this branch is where it picks up again
+	if ( ip != TRACE_NONE ) {
+		walkTrace( trace, ip, end, index, TRACE_NONE, TRACE_NONE, true );
+	}
+
+	if ( call ) pushReturn( trace, end );
+
+	// Passes that made a syscall are listed, the ones between them only counted
+	for ( uint64_t i = 1; i <= entry->value; ) {
+		struct traceSyscall* record = nextSyscall( trace, index + 1, i - 1 );
+		uint64_t next = record != NULL && record->entries == index + 1 && record->repeat < entry->value ? record->repeat + 1 : (uint64_t)entry->value + 1;
+
+		if ( next > i ) {
+			printRepeat( target, branch, next - i );
+
+			for ( ; call && i < next; i++ ) {
+				pushReturn( trace, end );
+			}
+
+			i = next;
+			continue;
+		}
+
+		walkTrace( trace, target, end, index + 1, i - 1, TRACE_NONE, true );
+		if ( call ) pushReturn( trace, end );
+		i++;
+	}
+
+	return target;
+}
+
+uint64_t printReturns( struct trace* trace, uint64_t ip, uint64_t index, struct traceEntry* entry ) {
+	uint64_t from = TRACE_NONE;
+	uint64_t to = TRACE_NONE;
+	uint64_t same = 0;
+
+	for ( uint64_t i = 0; i <= entry->value; i++ ) {
+		uint64_t entries = i == 0 ? index : index + 1;
+		uint64_t repeat = i == 0 ? TRACE_NONE : i - 1;
+		uint64_t target = trace->stackSize != 0 ? trace->stack[ trace->stackSize - 1 ] : TRACE_NONE;
+
+		if ( ip == TRACE_NONE ) {
+			popReturn( trace );
+			continue;
+		}
+
+		// The same path to the same RET as last time, unless a syscall on it is still in the trace
+		struct traceSyscall* record = nextSyscall( trace, entries, repeat );
+		bool quiet = ip == from && !( record != NULL && record->entries == entries && ( repeat == TRACE_NONE || record->repeat == repeat ) );
+
+		if ( !quiet && same != 0 ) {
+			printRepeat( from, to, same );
+			same = 0;
+		}
+
+		uint64_t last = walkTrace( trace, ip, TRACE_RET, entries, repeat, target, !quiet );
+
+		if ( last == TRACE_NONE ) {
+			ip = TRACE_NONE;
+			popReturn( trace );
+			continue;
+		}
+
+		if ( quiet ) same++;
+		from = ip;
+		to = last;
+		ip = popReturn( trace );
+
+		if ( ip == TRACE_NONE ) {
+			fprintf( stdout, "# returned into a frame from before the trace\n" );
+		}
+	}
+
+	if ( same != 0 ) {
+		printRepeat( from, to, same );
+	}
+
+	return ip;
+}
+
+uint64_t walkTrace( struct trace* trace, uint64_t ip, uint64_t end, uint64_t entries, uint64_t repeat, uint64_t jump, bool print ) {
+	// Nothing was taken in between, so execution went straight from ip to end, or to the next RET
+	for ( uint64_t steps = 0; ip < trace->header.programSize && steps < TRACE_WALK_MAX; steps++ ) {
+		const ubyte_t* in = &trace->program[ ip ];
+		uint64_t next = ip + instructionSize( in[ 0 ] );
+		bool last = end == TRACE_RET ? in[ 0 ] == X8000_RET : next == end;
+
+		if ( next > trace->header.programSize || ( !last && ( ( end != TRACE_RET && next > end ) || isTransferInstruction( in ) ) ) ) {
+			break;
+		}
+
+		if ( print ) {
+			printInstruction( trace, ip, entries, repeat, last ? jump : TRACE_NONE );
+		}
+
+		if ( last ) {
+			return ip;
+		}
+
+		ip = next;
+	}
+
+	if ( print ) {
+		fprintf( stdout, "# lost track at 0x%08llx\n", (unsigned long long)ip );
+	}
+
+	return TRACE_NONE;
+}
+
+void printInstruction( struct trace* trace, uint64_t ip, uint64_t entries, uint64_t repeat, uint64_t jump ) {
+	const ubyte_t* in = &trace->program[ ip ];
+	ubyte_t opcode = in[ 0 ];
+	size_t size = instructionSize( opcode );
+	const char* name = opcodeName( opcode );
+
+	fprintf( stdout, "0x%08llx  %s%*s", (unsigned long long)ip, name, TRACE_COLUMN_WIDTH - (int)strlen( name ), "" );
+
+	switch ( opcode ) {
+	case X8000_JMP: case X8000_JE: case X8000_JNE: case X8000_JNZ: case X8000_CALL:
+		fprintf( stdout, "0x%08llx", (unsigned long long)branchTarget( trace->program, ip ) );
+		break;
+	case X8000_RET:
+		break;
+	case X8000_INT: {
+		struct traceSyscall* record = nextSyscall( trace, entries, repeat );
+
+		if ( record != NULL && record->entries == entries && ( repeat == TRACE_NONE || record->repeat == repeat ) && record->ip == ip ) {
+			fprintf( stdout, "%s( 0x%llx, 0x%llx, 0x%llx ) = 0x%llx", syscallName( record->rk ),
+				(unsigned long long)record->rp1, (unsigned long long)record->rp2, (unsigned long long)record->rp3, (unsigned long long)record->rr1 );
+			trace->syscall++;
+		}
+		break;
+	}
+	case X8000_INC: case X8000_DEC:
+		fprintf( stdout, "%s", registerName( in[ 1 ] ) );
+		break;
+	case X8000_LOAD_8: case X8000_LOAD_16: case X8000_LOAD_32: case X8000_LOAD_64:
+	case X8000_STORE_8: case X8000_STORE_16: case X8000_STORE_32: case X8000_STORE_64: {
+		int32_t offset;
+		memcpy( &offset, &in[ 3 ], sizeof( offset ) );
+		fprintf( stdout, "%s, %s, %d", registerName( in[ 1 ] ), registerName( in[ 2 ] ), offset );
+		break;
+	}
+	case X8000_MOV_R: case X8000_CMP_R: case X8000_ADD_R: case X8000_SUB_R: case X8000_MUL_R: case X8000_DIV_R:
+		fprintf( stdout, "%s, %s", registerName( in[ 1 ] ), registerName( in[ 2 ] ) );
+		break;
+	default: {
+		// An immediate fills the rest of the instruction
+		uint64_t imm = 0;
+		memcpy( &imm, &in[ 2 ], size > 2 ? size - 2 : 0 );
+		fprintf( stdout, "%s, 0x%llx", registerName( in[ 1 ] ), (unsigned long long)imm );
+		break;
+	}
+	}
+
+	if ( jump != TRACE_NONE ) {
+		fprintf( stdout, " -> 0x%08llx", (unsigned long long)jump );
+	}
+
+	fprintf( stdout, "\n" );
+}
+
+void printRepeat( uint64_t from, uint64_t to, uint64_t count ) {
+	fprintf( stdout, "# 0x%08llx to 0x%08llx ran %llu more time%s\n", (unsigned long long)from, (unsigned long long)to, (unsigned long long)count, count == 1 ? "" : "s" );
+}
+
+void printRegisters( struct trace* trace ) {
+	fprintf( stdout, "# registers%s\n", trace->header.reason == TRACE_REASON_SIGNAL ? ", a compiled block may hold newer values" : "" );
+
+	for ( ubyte_t i = 0; i < TRACE_REGISTERS_COUNT; i++ ) {
+		fprintf( stdout, "%s%-3s = 0x%016llx", i % 4 == 0 ? "" : "  ", registerNames[ i ], (unsigned long long)trace->header.regs[ i ] );
+
+		if ( i % 4 == 3 ) {
+			fprintf( stdout, "\n" );
+		}
+	}
+}
+
+struct traceSyscall* nextSyscall( struct trace* trace, uint64_t entries, uint64_t repeat ) {
+	// Records from passes that were not walked are dropped on the way
+	while ( trace->syscall < trace->header.syscalls ) {
+		struct traceSyscall* record = &trace->syscalls[ trace->syscall ];
+
+		if ( record->entries > entries || ( record->entries == entries && ( repeat == TRACE_NONE || record->repeat >= repeat ) ) ) {
+			return record;
+		}
+
+		trace->syscall++;
+	}
+
+	return NULL;
+}
+
+void pushReturn( struct trace* trace, uint64_t address ) {
+	if ( trace->stackSize == trace->stackCapacity ) {
+		size_t capacity = trace->stackCapacity == 0 ? 0x100 : trace->stackCapacity * 2;
+		uint64_t* stack = capacity <= TRACE_STACK_MAX ? (uint64_t*)realloc( trace->stack, capacity * sizeof( uint64_t ) ) : NULL;
+
+		if ( stack == NULL && trace->stackSize == 0 ) {
+			return;
+		}else if ( stack == NULL ) {
+			// Too deep to follow, the oldest frames are forgotten
+			memmove( trace->stack, trace->stack + trace->stackSize / 2, ( trace->stackSize - trace->stackSize / 2 ) * sizeof( uint64_t ) );
+			trace->stackSize -= trace->stackSize / 2;
+		}else {
+			trace->stack = stack;
+			trace->stackCapacity = capacity;
+		}
+	}
+
+	trace->stack[ trace->stackSize++ ] = address;
+}
+
+uint64_t popReturn( struct trace* trace ) {
+	return trace->stackSize != 0 ? trace->stack[ --trace->stackSize ] : TRACE_NONE;
+}
+
+uint64_t branchTarget( const ubyte_t* program, uint64_t ip ) {
+	uint64_t target;
+	memcpy( &target, &program[ ip + 1 ], sizeof( target ) );
+	return target;
+}
+
+size_t instructionSize( ubyte_t ins ) {
+	switch ( ins ) {
+	case X8000_INC: case X8000_DEC:
+		return 2;
+	case X8000_MOV_R: case X8000_CMP_R: case X8000_ADD_R: case X8000_SUB_R: case X8000_MUL_R: case X8000_DIV_R:
+	case X8000_MOV_8: case X8000_CMP_8: case X8000_ADD_8: case X8000_SUB_8: case X8000_MUL_8: case X8000_DIV_8:
+		return 3;
+	case X8000_MOV_16: case X8000_CMP_16: case X8000_ADD_16: case X8000_SUB_16: case X8000_MUL_16: case X8000_DIV_16:
+		return 4;
+	case X8000_MOV_32: case X8000_CMP_32: case X8000_ADD_32: case X8000_SUB_32: case X8000_MUL_32: case X8000_DIV_32:
+		return 6;
+	case X8000_LOAD_8: case X8000_LOAD_16: case X8000_LOAD_32: case X8000_LOAD_64:
+	case X8000_STORE_8: case X8000_STORE_16: case X8000_STORE_32: case X8000_STORE_64:
+		return 7;
+	case X8000_JMP: case X8000_JE: case X8000_JNE: case X8000_JNZ: case X8000_CALL:
+		return TRACE_BRANCH_SIZE;
+	case X8000_MOV_64: case X8000_CMP_64: case X8000_ADD_64: case X8000_SUB_64: case X8000_MUL_64: case X8000_DIV_64:
+		return 10;
+	default:
+		return 1;
+	}
+}
+
+bool isTransferInstruction( const ubyte_t* in ) {
+	// Always leaves the straight line, so a walk cannot go past one
+	switch ( in[ 0 ] ) {
+	case X8000_JMP: case X8000_CALL: case X8000_RET:
+		return true;
+	case X8000_JE: case X8000_JNE: case X8000_JNZ: case X8000_INT:
+	case X8000_CMP_R: case X8000_CMP_8: case X8000_CMP_16: case X8000_CMP_32: case X8000_CMP_64:
+	case X8000_STORE_8: case X8000_STORE_16: case X8000_STORE_32: case X8000_STORE_64:
+		return false;
+	default:
+		// Anything else writing IP jumps
+		return in[ 1 ] == REGISTER_IP;
+	}
+}
+
+const char* opcodeName( ubyte_t opcode ) {
+	switch ( opcode ) {
+	case X8000_LOAD_8: return "LOAD_8";
+	case X8000_LOAD_16: return "LOAD_16";
+	case X8000_LOAD_32: return "LOAD_32";
+	case X8000_LOAD_64: return "LOAD_64";
+	case X8000_STORE_8: return "STORE_8";
+	case X8000_STORE_16: return "STORE_16";
+	case X8000_STORE_32: return "STORE_32";
+	case X8000_STORE_64: return "STORE_64";
+	case X8000_MOV_R: return "MOV_R";
+	case X8000_MOV_8: return "MOV_8";
+	case X8000_MOV_16: return "MOV_16";
+	case X8000_MOV_32: return "MOV_32";
+	case X8000_MOV_64: return "MOV_64";
+	case X8000_CMP_R: return "CMP_R";
+	case X8000_CMP_8: return "CMP_8";
+	case X8000_CMP_16: return "CMP_16";
+	case X8000_CMP_32: return "CMP_32";
+	case X8000_CMP_64: return "CMP_64";
+	case X8000_JMP: return "JMP";
+	case X8000_JE: return "JE";
+	case X8000_JNE: return "JNE";
+	case X8000_JNZ: return "JNZ";
+	case X8000_CALL: return "CALL";
+	case X8000_RET: return "RET";
+	case X8000_INC: return "INC";
+	case X8000_DEC: return "DEC";
+	case X8000_ADD_R: return "ADD_R";
+	case X8000_ADD_8: return "ADD_8";
+	case X8000_ADD_16: return "ADD_16";
+	case X8000_ADD_32: return "ADD_32";
+	case X8000_ADD_64: return "ADD_64";
+	case X8000_SUB_R: return "SUB_R";
+	case X8000_SUB_8: return "SUB_8";
+	case X8000_SUB_16: return "SUB_16";
+	case X8000_SUB_32: return "SUB_32";
+	case X8000_SUB_64: return "SUB_64";
+	case X8000_MUL_R: return "MUL_R";
+	case X8000_MUL_8: return "MUL_8";
+	case X8000_MUL_16: return "MUL_16";
+	case X8000_MUL_32: return "MUL_32";
+	case X8000_MUL_64: return "MUL_64";
+	case X8000_DIV_R: return "DIV_R";
+	case X8000_DIV_8: return "DIV_8";
+	case X8000_DIV_16: return "DIV_16";
+	case X8000_DIV_32: return "DIV_32";
+	case X8000_DIV_64: return "DIV_64";
+	case X8000_INT: return "INT";
+	default: return "BAD";
+	}
+}
+
+const char* registerName( ubyte_t code ) {
+	ubyte_t index = (ubyte_t)( code - REGISTER_IP );
+	return index < TRACE_REGISTERS_COUNT ? registerNames[ index ] : "?";
+}
+
+const char* syscallName( int64_t code ) {
+	switch ( code ) {
+	case SYSCALL_CODE_WRITE: return "write";
+	case SYSCALL_CODE_READ: return "read";
+	case SYSCALL_CODE_FLUSH: return "flush";
+	case SYSCALL_CODE_WRITEV: return "writev";
+	case SYSCALL_CODE_READV: return "readv";
+	case SYSCALL_CODE_SUBMIT_READ: return "submit_read";
+	case SYSCALL_CODE_SUBMIT_WRITE: return "submit_write";
+	case SYSCALL_CODE_POLL: return "poll";
+	case SYSCALL_CODE_WAIT: return "wait";
+	case SYSCALL_CODE_EXIT: return "exit";
+	case SYSCALL_CODE_SNAPSHOT: return "snapshot";
+	case SYSCALL_CODE_MALLOC: return "malloc";
+	case SYSCALL_CODE_REALLOC: return "realloc";
+	case SYSCALL_CODE_FREE: return "free";
+	case SYSCALL_CODE_WBUFF: return "wbuff";
+	case SYSCALL_CODE_MEMCPY: return "memcpy";
+	case SYSCALL_CODE_MEMMOVE: return "memmove";
+	case SYSCALL_CODE_MEMSET: return "memset";
+	case SYSCALL_CODE_MEMCMP: return "memcmp";
+	case SYSCALL_CODE_MEMCHR: return "memchr";
+	default: return "unknown";
+	}
+}
+// ==================== XTRACE ====================
+
+// ==================== Main ====================
+int main( int argc, char* argv[] ) {
+	if ( argc != 2 ) {
+		if ( argc == 1 ) {
+			fprintf( stderr, "Error: No file specified.\n" );
+		}else {
+			fprintf( stderr, "Error: Invalid argv.\n" );
+		}
+
+		exit( EXIT_FAILURE );
+	}
+
+	FILE* file = fopen( argv[ 1 ], "rb" );
+	if ( file == NULL ) {
+		fprintf( stderr, "Error: Cannot open the specified file.\n" );
+		exit( EXIT_FAILURE );
+	}
+
+	bool status = readTrace( file );
+	fclose( file );
+
+	exit( status ? EXIT_SUCCESS : EXIT_FAILURE );
+}
+// ==================== Main ====================